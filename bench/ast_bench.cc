@@ -0,0 +1,487 @@
+#include "jnsn/js/ast_file.h"
+#include "jnsn/js/ast_ops.h"
+#include "jnsn/js/ast_walker.h"
+#include "jnsn/js/parser.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace jnsn;
+
+/// Lexes a string that lives in this benchmark
+class bench_lexer : public source_lexer<bench_lexer> {
+  string_view text;
+
+public:
+  static constexpr bool stable_text = true;
+  string_view source_text() const { return text; }
+  void set_text(string_view text) {
+    this->text = text;
+    load();
+  }
+};
+
+class bench_parser : public parser_base {
+  bench_lexer lexer;
+  lexer_base &get_lexer() override { return lexer; }
+
+public:
+  void set_text(string_view text) { lexer.set_text(text); }
+};
+
+/// Builds a program out of random statements the parser understands. Only
+/// raw engine output is used, so a seed yields the same program with every
+/// standard library.
+class program_builder {
+  mt19937_64 gen;
+
+public:
+  string out;
+
+  explicit program_builder(uint64_t seed) : gen(seed) {}
+  size_t below(size_t n) { return gen() % n; }
+  template <size_t N> const char *pick(const char *const (&items)[N]) {
+    return items[below(N)];
+  }
+
+  void identifier() {
+    static const char *const names[] = {"a",   "b",     "i",     "x",
+                                        "len", "node",  "value", "result",
+                                        "cb",  "data",  "key",   "obj"};
+    out += pick(names);
+  }
+  void expression(unsigned depth) {
+    switch (depth == 0 ? below(2) : below(9)) {
+    case 0:
+      identifier();
+      break;
+    case 1:
+      out += to_string(below(1000));
+      break;
+    case 2:
+    case 3: {
+      static const char *const ops[] = {"+",  "-",  "*",   "/",  "<",
+                                        "&&", "||", "===", "<<", "|"};
+      expression(depth - 1);
+      out += ' ';
+      out += pick(ops);
+      out += ' ';
+      expression(depth - 1);
+      break;
+    }
+    case 4:
+      identifier();
+      out += '(';
+      for (size_t n = below(4); n > 0; --n) {
+        expression(depth - 1);
+        out += n > 1 ? ", " : "";
+      }
+      out += ')';
+      break;
+    case 5:
+      identifier();
+      out += '.';
+      identifier();
+      break;
+    case 6:
+      out += '[';
+      expression(depth - 1);
+      out += ", ";
+      expression(depth - 1);
+      out += ']';
+      break;
+    case 7:
+      out += "function (a, b) { return ";
+      expression(depth - 1);
+      out += "; }";
+      break;
+    default:
+      out += "!(";
+      expression(depth - 1);
+      out += ')';
+    }
+  }
+  void statement(unsigned depth) {
+    switch (depth == 0 ? below(3) : below(5)) {
+    case 0:
+      out += "var ";
+      identifier();
+      out += " = ";
+      expression(3);
+      out += ";\n";
+      break;
+    case 1:
+      identifier();
+      out += " = ";
+      expression(3);
+      out += ";\n";
+      break;
+    case 2:
+      out += "x = (a, b) => ";
+      expression(2);
+      out += ";\n";
+      break;
+    case 3:
+      out += "if (";
+      expression(2);
+      out += ") {\n";
+      for (size_t n = 1 + below(3); n > 0; --n) {
+        statement(depth - 1);
+      }
+      out += "};\n";
+      break;
+    default:
+      out += "function ";
+      identifier();
+      out += to_string(below(100));
+      out += "(a, b) {\n";
+      for (size_t n = 1 + below(4); n > 0; --n) {
+        statement(depth - 1);
+      }
+      out += "return ";
+      expression(2);
+      out += ";\n};\n";
+    }
+  }
+};
+
+/// "a" followed by \p terms - 1 times \p op and "a"
+static string operator_chain(const char *op, size_t terms) {
+  string chain = "a";
+  for (size_t i = 1; i < terms; ++i) {
+    chain += op;
+    chain += 'a';
+  }
+  return chain;
+}
+
+/// Best time of \p reps parses of \p text
+static double measure_parse(bench_parser &parser, const string &text,
+                            int reps) {
+  double best = 1e100;
+  for (int i = 0; i < reps; ++i) {
+    auto start = chrono::steady_clock::now();
+    parser.set_text(text);
+    auto res = parser.parse(false);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count());
+    if (!std::holds_alternative<module_node *>(res)) {
+      return -1;
+    }
+  }
+  return best;
+}
+
+/// Collects every node of a tree. on_enter of the root types of the node
+/// hierarchy is called exactly once per node.
+struct node_collector : public ast_walker<node_collector> {
+  vector<const ast_node *> nodes;
+#define NODE(NAME, CHILD_NODES)                                                \
+  bool on_enter(const NAME##_node &node) {                                     \
+    nodes.emplace_back(&node);                                                 \
+    return true;                                                               \
+  }
+#include "jnsn/js/ast.def"
+};
+
+/// isa<> and get_ast_node_typename() the way they used to be done: by a
+/// visit that upcasts through the ancestors of the node's type
+template <class nodety>
+struct isa_checker : public const_ast_node_visitor<bool> {
+#define NODE(NAME, CHILDREN)                                                   \
+  bool accept(const NAME##_node &) override {                                  \
+    return std::is_same_v<NAME##_node, nodety>;                                \
+  }
+#define EXTENDS(BASE) BASE##_node
+#define DERIVED(NAME, BASE, CHILDREN)                                          \
+  bool accept(const NAME##_node &node) override {                              \
+    return std::is_same_v<NAME##_node, nodety> ||                              \
+           accept(static_cast<const BASE &>(node));                            \
+  }
+#include "jnsn/js/ast.def"
+};
+template <class nodety> static bool visitor_isa(const ast_node &node) {
+  return isa_checker<nodety>().visit(node);
+}
+static const char *visitor_typename(const ast_node &node) {
+  struct name_generator : public const_ast_node_visitor<const char *> {
+#define NODE(NAME, CHILD_NODES)                                                \
+  const char *accept(const NAME##_node &) override { return #NAME; }
+#define DERIVED(NAME, ANCESTOR, CHILD_NODES) NODE(NAME, CHILD_NODES)
+#include "jnsn/js/ast.def"
+  } name_gen;
+  return name_gen.visit(node);
+}
+struct by_visitor {
+  template <class nodety> static bool isa(const ast_node &node) {
+    return visitor_isa<nodety>(node);
+  }
+  static const char *type_name(const ast_node &node) {
+    return visitor_typename(node);
+  }
+};
+struct by_kind {
+  template <class nodety> static bool isa(const ast_node &node) {
+    return jnsn::isa<nodety>(node);
+  }
+  static const char *type_name(const ast_node &node) {
+    return get_ast_node_typename(node);
+  }
+};
+
+/// The kind of type tests IR construction does on every node
+template <class impl> static size_t classify(const ast_node &node) {
+  size_t score = 0;
+  if (impl::template isa<function_expr_node>(node)) {
+    score += 1;
+  } else if (impl::template isa<function_stmt_node>(node)) {
+    score += 2;
+  } else if (impl::template isa<arrow_function_node>(node)) {
+    score += 3;
+  } else if (impl::template isa<class_func_node>(node)) {
+    score += 4;
+  }
+  score += impl::template isa<statement_node>(node);
+  score += impl::template isa<expression_node>(node);
+  score += impl::template isa<bin_op_expr_node>(node);
+  score += impl::template isa<unary_expr_node>(node);
+  return score;
+}
+
+/// ast_walker the way it used to be: a visitor with virtual hooks, so
+/// every node costs a virtual accept(), on_enter() and on_leave() per type
+/// in its hierarchy
+template <class impl>
+struct virtual_walker : public const_ast_node_visitor<void> {
+#define NODE(NAME, CHILD_NODES)                                                \
+  virtual bool on_enter(const NAME##_node &) { return true; }                  \
+  virtual void on_leave(const NAME##_node &) {}
+#define DERIVED(NAME, ANCESTOR, CHILD_NODES) NODE(NAME, CHILD_NODES)
+#include "jnsn/js/ast.def"
+
+#define CHILDREN(...) __VA_ARGS__
+#define ONE(OF, NAME) visit(*node.NAME);
+#define MANY(OF, NAME)                                                         \
+  for (const auto *child : node.NAME)                                          \
+    visit(*child);
+#define MAYBE(OF, NAME)                                                        \
+  if (node.NAME)                                                               \
+    visit(**node.NAME);
+#define NODE(NAME, CHILD_NODES)                                                \
+  void accept(const NAME##_node &node) override {                              \
+    if (this->on_enter(node)) {                                                \
+      CHILD_NODES                                                              \
+    }                                                                          \
+    this->on_leave(node);                                                      \
+  }
+#define EXTENDS(BASE) BASE##_node
+#define DERIVED(NAME, ANCESTOR, CHILD_NODES)                                   \
+  void accept(const NAME##_node &node) override {                              \
+    if (this->on_enter(node)) {                                                \
+      accept(static_cast<const ANCESTOR &>(node));                             \
+      CHILD_NODES                                                              \
+    }                                                                          \
+    this->on_leave(node);                                                      \
+  }
+#include "jnsn/js/ast.def"
+};
+
+/// Walks like function_collector of IR construction, which only cares about
+/// a few node types
+template <template <class> class walker>
+struct function_counter : public walker<function_counter<walker>> {
+  size_t count = 0;
+  void on_leave(const function_expr_node &) { ++count; }
+  void on_leave(const function_stmt_node &) { ++count; }
+  void on_leave(const arrow_function_node &) { ++count; }
+  void on_leave(const class_func_node &) { ++count; }
+};
+/// Enters every expression through its ancestor type
+template <template <class> class walker>
+struct expression_counter : public walker<expression_counter<walker>> {
+  size_t count = 0;
+  bool on_enter(const expression_node &) {
+    ++count;
+    return true;
+  }
+};
+
+/// Best time of \p reps full walks of \p root with a fresh \p counter
+template <class counter>
+static double measure_walk(const ast_node &root, int reps, size_t &checksum) {
+  double best = 1e100;
+  for (int i = 0; i < reps; ++i) {
+    counter c;
+    auto start = chrono::steady_clock::now();
+    c.visit(root);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count());
+    checksum = c.count;
+  }
+  return best;
+}
+
+struct measurement {
+  size_t checksum = 0;
+  double isa_seconds = 1e100;
+  double name_seconds = 1e100;
+};
+
+template <class impl>
+static measurement measure(const vector<const ast_node *> &nodes, int reps) {
+  measurement best;
+  for (int i = 0; i < reps; ++i) {
+    size_t sum = 0;
+    auto start = chrono::steady_clock::now();
+    for (auto *node : nodes) {
+      sum += classify<impl>(*node);
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    best.isa_seconds = std::min(best.isa_seconds, elapsed.count());
+
+    start = chrono::steady_clock::now();
+    for (auto *node : nodes) {
+      sum += impl::type_name(*node)[0];
+    }
+    elapsed = chrono::steady_clock::now() - start;
+    best.name_seconds = std::min(best.name_seconds, elapsed.count());
+    best.checksum = sum;
+  }
+  return best;
+}
+
+static void usage(const char *argv0) {
+  cerr << "Usage: " << argv0 << " [--size=MiB] [--seed=N] [--reps=N]\n"
+          "Compares isa<> and get_ast_node_typename() on every node of a\n"
+          "generated program against visitor based implementations, and\n"
+          "walks of the whole program by ast_walker against a walker with\n"
+          "virtual hooks, and loading the program's binary AST against\n"
+          "parsing it. Also times parsing of long operator chains.\n";
+}
+
+int main(int argc, char **argv) {
+  size_t size_mb = 4;
+  uint64_t seed = 1;
+  int reps = 5;
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    if (!strncmp(arg, "--size=", 7)) {
+      size_mb = std::atoi(arg + 7);
+    } else if (!strncmp(arg, "--seed=", 7)) {
+      seed = std::strtoull(arg + 7, nullptr, 10);
+    } else if (!strncmp(arg, "--reps=", 7)) {
+      reps = std::atoi(arg + 7);
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (size_mb == 0 || reps <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  program_builder b(seed);
+  while (b.out.size() < size_mb << 20) {
+    b.statement(3);
+  }
+  bench_parser parser;
+  parser.set_text(b.out);
+  auto res = parser.parse(false);
+  if (auto *err = std::get_if<parser_error>(&res)) {
+    cerr << "Failed to parse the program: " << *err << '\n';
+    return 1;
+  }
+  node_collector collector;
+  collector.visit(*std::get<module_node *>(res));
+  auto &nodes = collector.nodes;
+
+  auto visitor = measure<by_visitor>(nodes, reps);
+  auto kind = measure<by_kind>(nodes, reps);
+  if (visitor.checksum != kind.checksum) {
+    cerr << "Results differ\n";
+    return 1;
+  }
+  cout << fixed << setprecision(1) << "nodes: " << nodes.size() << '\n';
+  auto report = [&](const char *what, double visitor_s, double kind_s) {
+    cout << setw(9) << what << ": visitor: " << visitor_s / nodes.size() * 1e9
+         << " ns/node, kind: " << kind_s / nodes.size() * 1e9
+         << " ns/node, speedup: " << visitor_s / kind_s << "x\n";
+  };
+  report("isa", visitor.isa_seconds, kind.isa_seconds);
+  report("typename", visitor.name_seconds, kind.name_seconds);
+
+  auto &root = *std::get<module_node *>(res);
+  auto report_walk = [&](const char *what, double virtual_s, double static_s) {
+    cout << setw(9) << what << ": virtual: " << virtual_s / nodes.size() * 1e9
+         << " ns/node, static: " << static_s / nodes.size() * 1e9
+         << " ns/node, speedup: " << virtual_s / static_s << "x\n";
+  };
+  size_t virtual_sum = 0, static_sum = 0;
+  auto virtual_s =
+      measure_walk<function_counter<virtual_walker>>(root, reps, virtual_sum);
+  auto static_s =
+      measure_walk<function_counter<ast_walker>>(root, reps, static_sum);
+  if (virtual_sum != static_sum) {
+    cerr << "Walks differ\n";
+    return 1;
+  }
+  report_walk("functions", virtual_s, static_s);
+  virtual_s =
+      measure_walk<expression_counter<virtual_walker>>(root, reps, virtual_sum);
+  static_s =
+      measure_walk<expression_counter<ast_walker>>(root, reps, static_sum);
+  if (virtual_sum != static_sum) {
+    cerr << "Walks differ\n";
+    return 1;
+  }
+  report_walk("exprs", virtual_s, static_s);
+
+  // Loading a tree from its binary encoding instead of parsing again
+  auto start = parser.start_location();
+  auto data = write_ast(root, start);
+  double parse_s = 1e100;
+  double load_s = 1e100;
+  ast_node_store store;
+  for (int i = 0; i < reps; ++i) {
+    auto begin = chrono::steady_clock::now();
+    parser.set_text(b.out);
+    parser.parse(false);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - begin;
+    parse_s = std::min(parse_s, elapsed.count());
+
+    store.clear();
+    begin = chrono::steady_clock::now();
+    auto loaded = read_ast(data, store, start);
+    elapsed = chrono::steady_clock::now() - begin;
+    load_s = std::min(load_s, elapsed.count());
+    if (!std::holds_alternative<module_node *>(loaded)) {
+      cerr << "Failed to load the program: " << std::get<string>(loaded)
+           << '\n';
+      return 1;
+    }
+  }
+  cout << setw(9) << "reload" << ": parse: " << parse_s * 1e3
+       << " ms, load: " << load_s * 1e3 << " ms, speedup: " << parse_s / load_s
+       << "x, encoded: " << double(data.size()) / b.out.size()
+       << " bytes/source byte\n";
+
+  // Chains of binary operators, whose parse time has to grow linearly
+  for (auto *op : {" + ", " * a - ", " ? a : "}) {
+    auto small_s = measure_parse(parser, operator_chain(op, 20000), reps);
+    auto large_s = measure_parse(parser, operator_chain(op, 160000), reps);
+    if (small_s < 0 || large_s < 0) {
+      cerr << "Failed to parse the chain of '" << op << "'\n";
+      return 1;
+    }
+    cout << setw(9) << "chain" << ": '" << op << "' 20000 terms: "
+         << small_s * 1e3 << " ms, 160000 terms: " << large_s * 1e3
+         << " ms, growth: " << large_s / small_s << "x for 8x the terms\n";
+  }
+}
@@ -0,0 +1,500 @@
+#include "jnsn/js/lexer.h"
+#include "jnsn/js/scan.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace jnsn;
+
+/// Lexes a string that lives in this benchmark
+class bench_lexer : public source_lexer<bench_lexer> {
+  string_view text;
+
+public:
+  static constexpr bool stable_text = true;
+  string_view source_text() const { return text; }
+  void set_text(string_view text) {
+    this->text = text;
+    load();
+  }
+};
+
+/// Builds a corpus out of random fragments. Only raw engine output is used,
+/// not the standard distributions, so a seed yields the same corpus with
+/// every standard library and two builds can be compared.
+class corpus_builder {
+  mt19937_64 gen;
+
+public:
+  string out;
+
+  explicit corpus_builder(uint64_t seed) : gen(seed) {}
+  size_t below(size_t n) { return gen() % n; }
+  bool chance(unsigned percent) { return below(100) < percent; }
+  template <size_t N> const char *pick(const char *const (&items)[N]) {
+    return items[below(N)];
+  }
+
+  void identifier() {
+    static const char *const common[] = {
+        "a",     "b",    "i",      "x",     "len",     "node",  "value",
+        "index", "self", "result", "count", "options", "cb",    "data",
+        "key",   "obj",  "arr",    "el",    "console", "Math",  "_"};
+    if (chance(70)) {
+      out += pick(common);
+      return;
+    }
+    static const char first[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJ_$";
+    static const char rest[] = "abcdefghijklmnopqrstuvwxyz0123456789_";
+    out += first[below(sizeof(first) - 1)];
+    for (size_t n = below(10); n > 0; --n) {
+      out += rest[below(sizeof(rest) - 1)];
+    }
+  }
+  void number() {
+    switch (below(4)) {
+    case 0:
+      out += to_string(below(100));
+      break;
+    case 1:
+      out += to_string(below(100000));
+      break;
+    case 2:
+      out += to_string(below(1000)) + '.' + to_string(below(100));
+      if (chance(30)) {
+        out += "e" + to_string(below(20));
+      }
+      break;
+    default:
+      static const char hex[] = "0123456789abcdefABCDEF";
+      out += "0x";
+      for (size_t n = 1 + below(8); n > 0; --n) {
+        out += hex[below(sizeof(hex) - 1)];
+      }
+    }
+  }
+  void words(size_t max) {
+    static const char *const dict[] = {
+        "the",   "value", "is",   "not",    "returned", "when", "called",
+        "with",  "an",    "empty", "list",  "of",       "items", "check",
+        "first", "then",  "loop", "over",   "all",      "keys",  "fast"};
+    for (size_t n = 1 + below(max); n > 0; --n) {
+      out += pick(dict);
+      out += n > 1 ? " " : "";
+    }
+  }
+  /// Expressions never contain braces, so they can go into template
+  /// substitutions, and never start with a slash
+  void expression(unsigned depth, bool spaces) {
+    auto sp = spaces ? " " : "";
+    switch (depth == 0 ? below(2) : below(8)) {
+    case 0:
+      identifier();
+      break;
+    case 1:
+      number();
+      break;
+    case 2:
+    case 3: {
+      static const char *const ops[] = {
+          "+",  "-",  "*",   "/",  "%",   "<<",  ">>",  ">>>", "&", "|",
+          "^",  "&&", "||",  "==", "===", "!==", "<=",  ">=",  "<", ">",
+          "**", "??", "instanceof"};
+      expression(depth - 1, spaces);
+      auto *op = pick(ops);
+      bool word = isalpha(op[0]);
+      out += word || spaces ? " " : "";
+      out += op;
+      out += word || spaces ? " " : "";
+      expression(depth - 1, spaces);
+      break;
+    }
+    case 4:
+      identifier();
+      out += '(';
+      for (size_t n = below(4); n > 0; --n) {
+        expression(depth - 1, spaces);
+        out += n > 1 ? "," : "";
+        out += n > 1 ? sp : "";
+      }
+      out += ')';
+      break;
+    case 5:
+      identifier();
+      out += '.';
+      identifier();
+      break;
+    case 6:
+      identifier();
+      out += '[';
+      expression(depth - 1, spaces);
+      out += ']';
+      break;
+    default:
+      out += chance(50) ? "(" : "!(";
+      expression(depth - 1, spaces);
+      out += ')';
+    }
+  }
+};
+
+/// Code without any unnecessary whitespace, as emitted by minifiers
+static void gen_minified(corpus_builder &b) {
+  switch (b.below(4)) {
+  case 0:
+    b.out += "var ";
+    b.identifier();
+    b.out += '=';
+    b.expression(3, false);
+    b.out += ';';
+    break;
+  case 1:
+    b.out += "function ";
+    b.identifier();
+    b.out += "(a,b){return ";
+    b.expression(3, false);
+    b.out += '}';
+    break;
+  case 2:
+    b.out += "if(";
+    b.expression(2, false);
+    b.out += ")return ";
+    b.expression(2, false);
+    b.out += ';';
+    break;
+  default:
+    b.out += "for(var i=0,n=";
+    b.expression(1, false);
+    b.out += ";i<n;++i)";
+    b.expression(3, false);
+    b.out += ';';
+  }
+}
+
+/// Mostly documentation, with a bit of code in between
+static void gen_comments(corpus_builder &b) {
+  if (b.chance(35)) {
+    b.out += "  ";
+    b.expression(2, true);
+    b.out += ";\n";
+  } else if (b.chance(50)) {
+    b.out += "  // ";
+    b.words(12);
+    b.out += '\n';
+  } else {
+    b.out += "/**\n";
+    for (size_t n = 1 + b.below(5); n > 0; --n) {
+      b.out += " * ";
+      b.words(10);
+      b.out += '\n';
+    }
+    b.out += " */\n";
+  }
+}
+
+/// String literals of both quote styles, full of escape sequences
+static void gen_strings(corpus_builder &b) {
+  static const char *const escapes[] = {"\\n",     "\\t",  "\\'", "\\\"",
+                                        "\\\\",    "\\x41", "\\u00e4",
+                                        "\\u{1F600}", "\\\n"};
+  b.out += "msg = ";
+  for (size_t n = 1 + b.below(3); n > 0; --n) {
+    char quote = b.chance(50) ? '\'' : '"';
+    b.out += quote;
+    for (size_t parts = 1 + b.below(6); parts > 0; --parts) {
+      b.words(4);
+      b.out += b.pick(escapes);
+    }
+    b.out += quote;
+    b.out += n > 1 ? " + " : ";\n";
+  }
+}
+
+static void template_literal(corpus_builder &b, unsigned depth) {
+  b.out += '`';
+  b.words(3);
+  for (size_t n = b.below(3); n > 0; --n) {
+    b.out += "${";
+    if (depth > 0 && b.chance(70)) {
+      template_literal(b, depth - 1);
+    } else {
+      b.expression(2, true);
+    }
+    b.out += '}';
+    b.words(2);
+  }
+  b.out += '`';
+}
+
+/// Template literals nested up to eight levels deep
+static void gen_templates(corpus_builder &b) {
+  b.out += "html += ";
+  template_literal(b, 1 + b.below(8));
+  b.out += ";\n";
+}
+
+/// Regular expressions in the places they usually appear
+static void gen_regex(corpus_builder &b) {
+  static const char *const atoms[] = {
+      "a",    "[a-z]", "[0-9]", "(ab|cd)", "[.]",   "x*",  "y+",  "z?",
+      "[^,]", "^",     "$",     "(?:q)",   "w{2,}", "\\/", "[/]", "\\d"};
+  static const char *const flags[] = {"", "g", "i", "gi", "m", "u"};
+  static const char *const uses[] = {"s.replace(", "re = ", "s.match(",
+                                     "if (", "parts = s.split("};
+  auto *use = b.pick(uses);
+  b.out += use;
+  b.out += '/';
+  for (size_t n = 1 + b.below(8); n > 0; --n) {
+    b.out += b.pick(atoms);
+  }
+  b.out += '/';
+  b.out += b.pick(flags);
+  if (use[0] == 'i') {
+    b.out += ".test(s)) x++;\n";
+  } else if (use[0] == 'r') {
+    b.out += ";\n";
+  } else {
+    b.out += ", x);\n";
+  }
+}
+
+/// Long, mostly distinct names, as in generated or enterprise code
+static void gen_identifiers(corpus_builder &b) {
+  static const char *const parts[] = {
+      "Abstract", "Factory", "Bean",    "Provider", "Manager", "Request",
+      "Handler",  "Context", "Service", "Adapter",  "Visitor", "Strategy",
+      "Config",   "Builder", "Proxy",   "Registry", "Element", "Observer"};
+  auto name = [&] {
+    b.out += b.chance(50) ? "create" : "the";
+    for (size_t n = 2 + b.below(5); n > 0; --n) {
+      b.out += b.pick(parts);
+    }
+    if (b.chance(30)) {
+      b.out += '_' + to_string(b.below(1000));
+    }
+  };
+  name();
+  b.out += '.';
+  name();
+  b.out += " = ";
+  name();
+  b.out += '(';
+  name();
+  b.out += ", ";
+  name();
+  b.out += ");\n";
+}
+
+struct corpus_kind {
+  const char *name;
+  /// Appends one random fragment
+  void (*gen)(corpus_builder &);
+};
+static void gen_mixed(corpus_builder &b);
+static const corpus_kind corpora[] = {
+    {"mixed", gen_mixed},         {"minified", gen_minified},
+    {"comments", gen_comments},   {"strings", gen_strings},
+    {"templates", gen_templates}, {"regex", gen_regex},
+    {"identifiers", gen_identifiers}};
+
+/// A bit of everything
+static void gen_mixed(corpus_builder &b) {
+  // skip ourselves
+  corpora[1 + b.below(std::size(corpora) - 1)].gen(b);
+}
+
+static string make_corpus(const corpus_kind &kind, size_t size,
+                          uint64_t seed) {
+  corpus_builder b(seed);
+  while (b.out.size() < size) {
+    kind.gen(b);
+    b.out += '\n';
+  }
+  return std::move(b.out);
+}
+
+struct measurement {
+  size_t tokens = 0;
+  double seconds = 0;
+};
+
+/// Lexes the whole input while counting tokens. Returns false on errors
+template <class lexer> static bool lex_all(lexer &lex, size_t &tokens) {
+  tokens = 0;
+  for (;;) {
+    auto res = lex.next();
+    if (std::holds_alternative<token>(res)) {
+      ++tokens;
+    } else if (auto *err = std::get_if<lexer_error>(&res)) {
+      cerr << *err << '\n';
+      return false;
+    } else {
+      return true;
+    }
+  }
+}
+
+/// Lexes the whole input into a token_buffer, on \p jobs threads if that
+/// is not zero. Returns false on errors
+template <class lexer>
+static bool tokenize_all(lexer &lex, token_buffer &buf, unsigned jobs,
+                         size_t &tokens) {
+  if (jobs) {
+    lex.tokenize_parallel(buf, jobs);
+  } else {
+    lex.tokenize_all(buf);
+  }
+  tokens = buf.size();
+  if (buf.error) {
+    cerr << *buf.error << '\n';
+    return false;
+  }
+  return true;
+}
+
+static bool measure(const string &corpus, int reps, bool bulk,
+                    unsigned jobs, measurement &best) {
+  bench_lexer lex;
+  token_buffer buf;
+  best.seconds = 1e100;
+  for (int i = 0; i < reps; ++i) {
+    lex.set_text(corpus);
+    size_t tokens;
+    auto start = chrono::steady_clock::now();
+    if (!(bulk ? tokenize_all(lex, buf, jobs, tokens)
+               : lex_all(lex, tokens))) {
+      return false;
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    if (elapsed.count() < best.seconds) {
+      best = {tokens, elapsed.count()};
+    }
+  }
+  return true;
+}
+
+static void usage(const char *argv0) {
+  cerr << "Usage: " << argv0 << " [--corpus=NAME] [--isa=scalar|sse2|avx2]"
+       << " [--size=MiB] [--seed=N] [--reps=N] [--bulk] [--jobs=N]"
+       << " [--json]\n"
+          "Runs all corpora with all supported instruction sets by default\n"
+          "Corpora:";
+  for (auto &kind : corpora) {
+    cerr << ' ' << kind.name;
+  }
+  cerr << "\n"
+          "--seed picks the random corpus contents, the default is 1\n"
+          "--bulk lexes through tokenize_all(), which drops comments\n"
+          "--jobs lexes through tokenize_parallel() on N threads, implies "
+          "--bulk\n"
+          "--json prints the results as one JSON object\n";
+}
+
+int main(int argc, char **argv) {
+  size_t size_mb = 8;
+  uint64_t seed = 1;
+  int reps = 5;
+  const char *only_corpus = nullptr;
+  const char *only_isa = nullptr;
+  bool bulk = false;
+  unsigned jobs = 0;
+  bool json = false;
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    if (!strncmp(arg, "--corpus=", 9)) {
+      only_corpus = arg + 9;
+    } else if (!strncmp(arg, "--isa=", 6)) {
+      only_isa = arg + 6;
+    } else if (!strncmp(arg, "--size=", 7)) {
+      size_mb = std::atoi(arg + 7);
+    } else if (!strncmp(arg, "--seed=", 7)) {
+      seed = std::strtoull(arg + 7, nullptr, 10);
+    } else if (!strncmp(arg, "--reps=", 7)) {
+      reps = std::atoi(arg + 7);
+    } else if (!strcmp(arg, "--bulk")) {
+      bulk = true;
+    } else if (!strncmp(arg, "--jobs=", 7)) {
+      jobs = std::atoi(arg + 7);
+      bulk = true;
+    } else if (!strcmp(arg, "--json")) {
+      json = true;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (size_mb == 0 || reps <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  vector<scan::isa> isas;
+  for (auto set : {scan::isa::scalar, scan::isa::sse2, scan::isa::avx2}) {
+    if (set > scan::best_isa()) {
+      continue;
+    }
+    if (!only_isa || !strcmp(only_isa, scan::isa_name(set))) {
+      isas.emplace_back(set);
+    }
+  }
+  if (isas.empty()) {
+    cerr << "Instruction set not supported: " << only_isa << '\n';
+    return 1;
+  }
+  bool found_corpus = false;
+  cout << fixed << setprecision(1);
+  if (json) {
+    cout << "{\"size_mib\": " << size_mb << ", \"seed\": " << seed
+         << ", \"reps\": " << reps << ", \"bulk\": " << boolalpha << bulk
+         << ", \"jobs\": " << jobs << ", \"results\": [";
+  }
+  bool first_result = true;
+  for (auto &kind : corpora) {
+    if (only_corpus && strcmp(only_corpus, kind.name)) {
+      continue;
+    }
+    found_corpus = true;
+    auto corpus = make_corpus(kind, size_mb << 20, seed);
+    for (auto set : isas) {
+      scan::use_isa(set);
+      measurement best;
+      if (!measure(corpus, reps, bulk, jobs, best)) {
+        cerr << "Failed to lex corpus " << kind.name << '\n';
+        return 1;
+      }
+      auto mb_per_s = corpus.size() / best.seconds / 1e6;
+      auto mtokens_per_s = best.tokens / best.seconds / 1e6;
+      if (json) {
+        cout << (first_result ? "" : ",") << "\n  {\"corpus\": \""
+             << kind.name << "\", \"isa\": \"" << scan::isa_name(set)
+             << "\", \"bytes\": " << corpus.size()
+             << ", \"tokens\": " << best.tokens << ", \"seconds\": "
+             << setprecision(6) << best.seconds << setprecision(1)
+             << ", \"mb_per_s\": " << mb_per_s
+             << ", \"mtokens_per_s\": " << mtokens_per_s << '}';
+      } else {
+        cout << setw(11) << kind.name << ' ' << setw(6)
+             << scan::isa_name(set) << ": bytes: " << corpus.size()
+             << ", tokens: " << best.tokens << ", MB/s: " << mb_per_s
+             << ", Mtokens/s: " << mtokens_per_s << '\n';
+      }
+      first_result = false;
+    }
+  }
+  if (json) {
+    cout << "\n]}\n";
+  }
+  if (!found_corpus) {
+    cerr << "Unknown corpus: " << only_corpus << '\n';
+    return 1;
+  }
+  return 0;
+}
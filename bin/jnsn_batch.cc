@@ -0,0 +1,217 @@
+#include "jnsn/ir/module.h"
+#include "jnsn/js/ir_construction.h"
+#include "jnsn/js/parser.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace jnsn;
+namespace fs = std::filesystem;
+
+struct options {
+  unsigned jobs = std::max(1u, thread::hardware_concurrency());
+  bool build_ir = false;
+  bool buffered = false;
+  bool quiet = false;
+  vector<string> inputs;
+};
+
+struct file_result {
+  size_t bytes = 0;
+  /// Memory taken by the file's AST, 0 if it could not be parsed
+  size_t ast_bytes = 0;
+  /// Empty if the file was processed successfully
+  string error;
+};
+
+static void usage(const char *argv0) {
+  cerr << "Usage: " << argv0
+       << " [-j N] [--ir] [--buffered] [--quiet] <file|dir|@list>...\n"
+          "Parses JavaScript files on N worker threads (default: one per "
+          "core).\n"
+          "Directories are searched recursively for .js, .mjs and .cjs "
+          "files.\n"
+          "@list reads one input per line from the file list.\n"
+          "  --ir        also build the IR of every file\n"
+          "  --buffered  tokenize each file completely before parsing it\n"
+          "  --quiet     only print the summary\n";
+}
+
+static bool is_js_file(const fs::path &path) {
+  auto ext = path.extension();
+  return ext == ".js" || ext == ".mjs" || ext == ".cjs";
+}
+
+/// Expands an input into the files it names. Returns false on errors
+static bool collect(const string &input, vector<string> &files) {
+  if (!input.empty() && input[0] == '@') {
+    ifstream list(input.substr(1));
+    if (!list) {
+      cerr << "Could not read file list " << input.substr(1) << '\n';
+      return false;
+    }
+    for (string line; getline(list, line);) {
+      // Lists written on Windows end their lines in "\r\n"
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+      if (!line.empty() && !collect(line, files)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  error_code ec;
+  if (!fs::is_directory(input, ec)) {
+    // Explicitly named files are taken regardless of their extension.
+    // Missing ones are reported like any other unreadable file.
+    files.emplace_back(input);
+    return true;
+  }
+  fs::recursive_directory_iterator it(input, ec), end;
+  for (; !ec && it != end; it.increment(ec)) {
+    if (it->is_regular_file(ec) && is_js_file(it->path())) {
+      files.emplace_back(it->path().string());
+    }
+  }
+  if (ec) {
+    cerr << "Could not list " << input << ": " << ec.message() << '\n';
+    return false;
+  }
+  return true;
+}
+
+template <class error>
+static string describe(const string &path, const char *stage,
+                       const error &err, parser_base &parser) {
+  stringstream ss;
+  ss << path << ": " << stage << " error (" << parser.decode(err.loc)
+     << "): " << err.msg;
+  return ss.str();
+}
+
+/// Owns everything a worker needs, so nothing is shared between threads.
+/// Opening a file drops the lexer state of the previous one.
+struct worker {
+  const options &opts;
+  mapped_file_parser parser;
+
+  worker(const options &opts) : opts(opts) {
+    parser.set_lexing_mode(opts.buffered
+                               ? parser_base::lexing_mode::buffered
+                               : parser_base::lexing_mode::streaming);
+  }
+
+  void process(const string &path, file_result &res) {
+    if (auto err = parser.open(path.c_str())) {
+      res.error = *err;
+      return;
+    }
+    res.bytes = parser.source_text().size();
+    auto parsed = parser.parse();
+    if (auto *err = get_if<parser_error>(&parsed)) {
+      res.error = describe(path, "parser", *err, parser);
+      return;
+    }
+    res.ast_bytes = parser.ast_bytes();
+    if (!opts.build_ir) {
+      return;
+    }
+    // A context only grows, so every file gets its own
+    ir_context ctx;
+    auto ir = build_ir_from_ast(*get<module_node *>(parsed), ctx);
+    if (auto *err = get_if<semantic_error>(&ir)) {
+      res.error = describe(path, "semantic", *err, parser);
+    }
+  }
+};
+
+int main(int argc, char **argv) {
+  options opts;
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    if (!strcmp(arg, "-j") && i + 1 < argc) {
+      opts.jobs = std::atoi(argv[++i]);
+    } else if (!strncmp(arg, "-j", 2) && arg[2]) {
+      opts.jobs = std::atoi(arg + 2);
+    } else if (!strcmp(arg, "--ir")) {
+      opts.build_ir = true;
+    } else if (!strcmp(arg, "--buffered")) {
+      opts.buffered = true;
+    } else if (!strcmp(arg, "--quiet")) {
+      opts.quiet = true;
+    } else if (arg[0] == '-' && arg[1]) {
+      usage(argv[0]);
+      return 1;
+    } else {
+      opts.inputs.emplace_back(arg);
+    }
+  }
+  if (opts.jobs == 0 || opts.inputs.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+  vector<string> files;
+  for (auto &input : opts.inputs) {
+    if (!collect(input, files)) {
+      return 1;
+    }
+  }
+
+  // Workers take the next unprocessed file until none are left. Results
+  // go to a slot per file, so they can be reported in input order.
+  vector<file_result> results(files.size());
+  atomic<size_t> next_file{0};
+  auto start = chrono::steady_clock::now();
+  vector<thread> pool;
+  auto jobs = std::min<size_t>(opts.jobs, std::max<size_t>(files.size(), 1));
+  for (size_t i = 0; i < jobs; ++i) {
+    pool.emplace_back([&] {
+      worker w(opts);
+      for (size_t f; (f = next_file++) < files.size();) {
+        w.process(files[f], results[f]);
+      }
+    });
+  }
+  for (auto &t : pool) {
+    t.join();
+  }
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+  size_t bytes = 0;
+  size_t failed = 0;
+  size_t ast_bytes = 0;
+  size_t parsed_bytes = 0;
+  for (size_t f = 0; f < files.size(); ++f) {
+    bytes += results[f].bytes;
+    if (results[f].ast_bytes) {
+      ast_bytes += results[f].ast_bytes;
+      parsed_bytes += results[f].bytes;
+    }
+    if (!results[f].error.empty()) {
+      ++failed;
+      if (!opts.quiet) {
+        cout << results[f].error << '\n';
+      }
+    }
+  }
+  auto seconds = std::max(elapsed.count(), 1e-9);
+  cout << fixed << setprecision(1) << "files: " << files.size()
+       << ", failed: " << failed << ", bytes: " << bytes
+       << ", jobs: " << jobs << ", seconds: " << setprecision(3) << seconds
+       << setprecision(1) << ", files/s: " << files.size() / seconds
+       << ", MB/s: " << bytes / seconds / 1e6
+       << ", AST bytes/source byte: "
+       << ast_bytes / std::max<double>(parsed_bytes, 1) << '\n';
+  return failed ? 2 : 0;
+}
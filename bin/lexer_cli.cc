@@ -1,29 +1,50 @@
 #include "jnsn/js/lexer.h"
+#include <unistd.h>
 
 using namespace std;
 using namespace jnsn;
 
 static void lexer_cli() {
   struct lex_visitor {
+    lexer_base &lexer;
     void operator()(lexer_error err) {
-      cout << err.msg << ' ' << '(' << err.loc << ')' << '\n';
+      cout << err.message() << ' ' << '(' << lexer.decode(err.loc) << ')'
+           << '\n';
     }
     void operator()(std::monostate eof) { cout << "EOF\n"; }
-    void operator()(token T) { cout << T << '\n'; }
-  } visitor;
-  bool error = false;
-  do {
-    cout << "Enter text:\n";
-    cin_line_lexer lexer;
+    void operator()(token T) {
+      cout << T.type;
+      if (T.has_text) {
+        cout << " (\"" << lexer.text_of(T) << "\" at "
+             << lexer.decode(lexer.location_of(T)) << ")";
+      }
+      cout << '\n';
+    }
+  };
+  // Returns false on errors
+  auto lex_all = [](lexer_base &lexer) {
+    lex_visitor visitor{lexer};
     lexer_base::result res;
     do {
       res = lexer.next();
       std::visit(visitor, res);
       if (std::holds_alternative<lexer_error>(res)) {
-        error = true;
-        break;
+        return false;
       }
     } while (!std::holds_alternative<lexer_base::eof_t>(res));
+    return true;
+  };
+  // Piped input is lexed as a whole, terminals line by line
+  if (!isatty(STDIN_FILENO)) {
+    fd_lexer lexer(STDIN_FILENO);
+    lex_all(lexer);
+    return;
+  }
+  bool error = false;
+  do {
+    cout << "Enter text:\n";
+    cin_line_lexer lexer;
+    error = !lex_all(lexer);
   } while (!error);
 }
 
@@ -1,6 +1,7 @@
 # Check and update source code formatting
 function(gen_fmt_targets PROJECT_NAME)
   file(GLOB_RECURSE CHECK_FORMAT_SOURCES
+    ${PROJECT_SOURCE_DIR}/bench/*.h ${PROJECT_SOURCE_DIR}/bench/*.cc
     ${PROJECT_SOURCE_DIR}/bin/*.h ${PROJECT_SOURCE_DIR}/bin/*.cc
     ${PROJECT_SOURCE_DIR}/include/*.h
     ${PROJECT_SOURCE_DIR}/lib/*.h ${PROJECT_SOURCE_DIR}/lib/*.cc
@@ -0,0 +1,101 @@
+#ifndef JNSN_ARENA_H
+#define JNSN_ARENA_H
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace jnsn {
+
+/// Bump allocator handing out memory from a list of chunks.
+/// Nothing is freed individually: clear() releases all allocations at once
+/// but keeps the chunks around for reuse.
+class arena {
+  struct chunk {
+    std::unique_ptr<char[]> mem;
+    size_t size;
+  };
+  static constexpr size_t default_chunk_size = 64 * 1024;
+  std::vector<chunk> chunks;
+  /// Index of the chunk we are currently bumping in
+  size_t current = 0;
+  char *ptr = nullptr;
+  char *end = nullptr;
+  size_t used = 0;
+
+  static char *align_up(char *p, size_t align) {
+    auto addr = reinterpret_cast<uintptr_t>(p);
+    return reinterpret_cast<char *>((addr + align - 1) & ~(align - 1));
+  }
+  /// Moves on to the next chunk that can fit size bytes, creating one if
+  /// necessary
+  void next_chunk(size_t size, size_t align) {
+    size_t needed = size + align - 1;
+    size_t i = chunks.empty() ? 0 : current + 1;
+    for (; i < chunks.size(); ++i) {
+      if (chunks[i].size >= needed) {
+        break;
+      }
+    }
+    if (i == chunks.size()) {
+      auto chunk_size = std::max(needed, default_chunk_size);
+      chunks.push_back({std::make_unique<char[]>(chunk_size), chunk_size});
+    } else if (i != current + 1) {
+      // keep the chunks we skipped available after the one we use now
+      std::swap(chunks[i], chunks[current + 1]);
+      i = current + 1;
+    }
+    current = i;
+    ptr = chunks[i].mem.get();
+    end = ptr + chunks[i].size;
+  }
+
+public:
+  arena() = default;
+  arena(const arena &) = delete;
+  arena(arena &&) = default;
+  arena &operator=(const arena &) = delete;
+  arena &operator=(arena &&) = default;
+
+  void *allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+    assert(align && !(align & (align - 1)) && "Alignment must be power of 2");
+    char *p = ptr ? align_up(ptr, align) : nullptr;
+    if (!p || p + size > end) {
+      next_chunk(size, align);
+      p = align_up(ptr, align);
+    }
+    ptr = p + size;
+    used += size;
+    return p;
+  }
+  /// Copies text into the arena
+  std::string_view copy(std::string_view text) {
+    auto *mem = static_cast<char *>(allocate(text.size(), 1));
+    std::memcpy(mem, text.data(), text.size());
+    return {mem, text.size()};
+  }
+  /// Releases all allocations but keeps the memory for reuse
+  void clear() {
+    current = 0;
+    used = 0;
+    ptr = chunks.empty() ? nullptr : chunks[0].mem.get();
+    end = chunks.empty() ? nullptr : ptr + chunks[0].size;
+  }
+  /// Number of bytes handed out since the last clear()
+  size_t bytes_used() const { return used; }
+  /// Number of bytes held by the arena, including unused ones
+  size_t bytes_reserved() const {
+    size_t total = 0;
+    for (auto &c : chunks) {
+      total += c.size;
+    }
+    return total;
+  }
+};
+
+} // namespace jnsn
+#endif // JNSN_ARENA_H
@@ -11,7 +11,7 @@ struct ir_builder {
   module &mod;
   ir_context &ctx;
   ir_builder(module &mod);
-  str_val *get_str_val(std::string str);
+  str_val *get_str_val(std::string_view str);
   basic_block *make_block(function &F);
   function *make_function();
   call_inst *cast_to_number(basic_block &IP, value &val);
@@ -44,8 +44,8 @@ class ir_context {
   std::map<double, c_num_val> nums;
   string_table str_table;
 
-  string_table_entry internalize_string(std::string s);
-  str_val *make_str_val(std::string val);
+  string_table_entry internalize_string(std::string_view s);
+  str_val *make_str_val(string_table_entry val);
   function *make_function();
   basic_block *make_block();
   template <class ty> ty *make_inst() {
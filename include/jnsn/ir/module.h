@@ -2,6 +2,7 @@
 #define JNSN_IR_MODULE_H
 #include "jnsn/ir/ir_context.h"
 #include <set>
+#include <vector>
 
 namespace jnsn {
 
@@ -19,6 +20,8 @@ class module {
   };
   using str_set = std::set<str_val *, str_val_less>;
   str_set strs;
+  /// The same str_vals, indexed by the id of their string in ctx
+  std::vector<str_val *> strs_by_id;
 
 public:
   module(ir_context &ctx) : ctx(ctx), entry(ctx.make_function()) {
@@ -30,7 +33,7 @@ public:
   function *get_entry() { return entry; }
   function *get_function_by_name(std::string name);
   ir_context &get_context() { return ctx; }
-  str_val *get_str_val(std::string val);
+  str_val *get_str_val(std::string_view val);
   const str_set &get_strs() const { return strs; }
   const func_set &get_functions() const { return functions; }
 };
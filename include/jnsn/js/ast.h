@@ -1,59 +1,166 @@
 #ifndef JNSN_JS_AST_H
 #define JNSN_JS_AST_H
 
+#include "jnsn/arena.h"
 #include "jnsn/js/ast_visitor.h"
 #include "jnsn/js/lexer.h"
+#include <algorithm>
+#include <array>
 #include <cassert>
-#include <deque>
+#include <initializer_list>
 #include <memory>
 #include <vector>
 
 namespace jnsn {
 class ast_node_store;
 
+/// Child list of a node. The items live contiguously in the node's
+/// ast_node_store and are never resized.
+template <class T> class node_list {
+  T *items = nullptr;
+  size_t count = 0;
+
+public:
+  node_list() = default;
+  node_list(T *items, size_t count) : items(items), count(count) {}
+
+  T *begin() const { return items; }
+  T *end() const { return items + count; }
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  T &operator[](size_t i) const {
+    assert(i < count);
+    return items[i];
+  }
+  T &front() const { return (*this)[0]; }
+  T &back() const { return (*this)[count - 1]; }
+};
+
 /// Setting up node structs
 #define NODE(NAME, CHILD_NODES)                                                \
   struct NAME##_node : public ast_node {                                       \
-    NAME##_node(source_location loc) : ast_node(loc) {}                        \
+    static constexpr node_kind static_kind = node_kind::NAME##_node;           \
+    NAME##_node(source_location loc) : ast_node(loc, static_kind) {}           \
     void accept(const_ast_node_visitor_base &v) const override {               \
       v.gen_result(*this);                                                     \
     }                                                                          \
     CHILD_NODES                                                                \
+                                                                               \
+  protected:                                                                   \
+    NAME##_node(source_location loc, node_kind kind) : ast_node(loc, kind) {}  \
   };
 #define CHILDREN(...) __VA_ARGS__
 
 #define EXTENDS(BASE) BASE##_node
 #define DERIVED(NAME, ANCESTOR, CHILD_NODES)                                   \
   struct NAME##_node : public ANCESTOR {                                       \
-    NAME##_node(source_location loc) : ANCESTOR(loc) {}                        \
+    static constexpr node_kind static_kind = node_kind::NAME##_node;           \
+    NAME##_node(source_location loc) : ANCESTOR(loc, static_kind) {}           \
     void accept(const_ast_node_visitor_base &v) const override {               \
       v.gen_result(*this);                                                     \
     }                                                                          \
     CHILD_NODES                                                                \
+                                                                               \
+  protected:                                                                   \
+    NAME##_node(source_location loc, node_kind kind) : ANCESTOR(loc, kind) {}  \
   };
-#define MANY(OF, NAME) std::vector<OF##_node *> NAME;
+#define MANY(OF, NAME) node_list<OF##_node *> NAME;
 #define ONE(OF, NAME) OF##_node *NAME = nullptr;
 #define STRING(NAME) string_table::entry NAME;
-#define STRINGS(NAME) std::vector<string_table::entry> NAME;
+#define STRINGS(NAME) node_list<string_table::entry> NAME;
 #define MAYBE_STR(NAME) std::optional<string_table::entry> NAME;
+#define NUMBER(NAME) double NAME = 0;
+#define COOKED(NAME) string_table::entry NAME;
+#define COOKED_STRS(NAME) node_list<string_table::entry> NAME;
 #define MAYBE(OF, NAME) std::optional<OF##_node *> NAME;
 #include "jnsn/js/ast.def"
 
-/// The place where different nodes live
+/// The place where different nodes live. Nodes are bump allocated at their
+/// own size from buckets of equally sized slots, so clear() can walk the
+/// buckets to destroy them without keeping a list of nodes.
 class ast_node_store {
-  using ast_node_storage = std::variant<
-#define NODE(NAME, CHILD_NODES) NAME##_node,
+  static constexpr size_t max_node_size = std::max({
+#define NODE(NAME, CHILD_NODES) sizeof(NAME##_node),
+#define DERIVED(NAME, BASE, CHILD_NODES) NODE(NAME, CHILD_NODES)
+#include "jnsn/js/ast.def"
+      sizeof(ast_node)});
+  static constexpr size_t max_node_align = std::max({
+#define NODE(NAME, CHILD_NODES) alignof(NAME##_node),
 #define DERIVED(NAME, BASE, CHILD_NODES) NODE(NAME, CHILD_NODES)
 #include "jnsn/js/ast.def"
-      std::monostate>;
-  std::deque<ast_node_storage> nodes;
+      alignof(ast_node)});
+  /// Slot sizes are multiples of this
+  static constexpr size_t granule = max_node_align;
+  static constexpr size_t chunk_size = 16 * 1024;
+  static_assert(max_node_align <= __STDCPP_DEFAULT_NEW_ALIGNMENT__,
+                "Chunks are only aligned for new");
+  static_assert(max_node_size <= chunk_size, "Chunks hold at least one node");
+
+  struct bucket {
+    std::vector<std::unique_ptr<char[]>> chunks;
+    /// Number of chunks allocated from since the last clear(). Only the
+    /// last of them can have free slots.
+    size_t in_use = 0;
+    char *ptr = nullptr;
+    char *end = nullptr;
+  };
+  std::array<bucket, max_node_size / granule + 1> buckets;
+  size_t used = 0;
+  /// Items of the nodes' child lists
+  arena lists;
+
+  static constexpr size_t slot_size(size_t bucket_index) {
+    return bucket_index * granule;
+  }
+  void next_chunk(size_t bucket_index);
+  template <class node_ty> void *allocate() {
+    constexpr size_t index = (sizeof(node_ty) + granule - 1) / granule;
+    auto &b = buckets[index];
+    if (static_cast<size_t>(b.end - b.ptr) < slot_size(index)) {
+      next_chunk(index);
+    }
+    auto *mem = b.ptr;
+    b.ptr += slot_size(index);
+    used += slot_size(index);
+    return mem;
+  }
 
 public:
+  ast_node_store() = default;
+  ast_node_store(const ast_node_store &) = delete;
+  ast_node_store &operator=(const ast_node_store &) = delete;
+  ~ast_node_store() { clear(); }
+
 #define NODE(NAME, CHILD_NODES) NAME##_node *make_##NAME(source_location loc);
 #define DERIVED(NAME, ANCESTOR, CHILD_NODES) NODE(NAME, CHILD_NODES)
 #include "jnsn/js/ast.def"
 
-  void clear() { nodes.clear(); }
+  /// Makes a child list of \p count value-initialized items
+  template <class T> node_list<T> make_list(size_t count) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "List items are never destroyed");
+    if (!count) {
+      return {};
+    }
+    auto *items =
+        static_cast<T *>(lists.allocate(count * sizeof(T), alignof(T)));
+    for (size_t i = 0; i < count; ++i) {
+      new (items + i) T();
+    }
+    return {items, count};
+  }
+  template <class T> node_list<T> make_list(std::initializer_list<T> init) {
+    auto list = make_list<T>(init.size());
+    std::copy(init.begin(), init.end(), list.begin());
+    return list;
+  }
+
+  /// Destroys all nodes but keeps the memory for the next ones
+  void clear();
+  /// Number of bytes taken by the nodes made since the last clear()
+  size_t bytes_used() const { return used + lists.bytes_used(); }
+  /// Number of bytes held by the store, including unused ones
+  size_t bytes_reserved() const;
 };
 
 std::ostream &operator<<(std::ostream &, const ast_node *);
@@ -0,0 +1,67 @@
+#ifndef JNSN_JS_AST_FILE_H
+#define JNSN_JS_AST_FILE_H
+#include "jnsn/js/ast.h"
+#include "jnsn/mapped_file.h"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <variant>
+
+namespace jnsn {
+
+/// Binary encoding of a module_node tree, so unchanged files need not be
+/// parsed again. The encoding is generated from ast.def:
+///
+/// - A header with a magic number, ast_file_version, a hash of ast.def and
+///   the sizes of the sections. Files written with another version or
+///   another ast.def are rejected.
+/// - The string section: string_count + 1 offsets into the string bytes,
+///   then the bytes of all distinct strings of the tree.
+/// - The node section: one record per node in breadth-first order,
+///   starting with the root. A record is the node kind as a byte, the
+///   node's location and then its fields in ast.def order, ancestor fields
+///   first. Children are referenced by how many records after the current
+///   one they are, strings by their index in the string section.
+///   Locations are relative to the start of the module's buffer and delta
+///   encoded against the previous record. All integers are LEB128.
+///
+/// Integers in the header and the string offsets are in host byte order.
+struct ast_file_header {
+  char magic[4];
+  uint32_t version;
+  uint32_t schema;
+  uint32_t node_count;
+  uint32_t string_count;
+  uint32_t string_bytes;
+  uint32_t node_bytes;
+};
+constexpr uint32_t ast_file_version = 1;
+
+/// Encodes the tree under \p root. \p start is the location of the first
+/// unit of the buffer the tree was parsed from.
+std::string write_ast(const module_node &root, source_location start);
+/// Rebuilds a tree that write_ast() encoded in \p data in \p store. Its
+/// locations are relative to \p start. Strings are views into \p data, so
+/// \p data has to outlive the tree. Returns an error message if \p data is
+/// not a valid encoding, nodes made up to then stay in \p store.
+std::variant<module_node *, std::string>
+read_ast(std::string_view data, ast_node_store &store, source_location start);
+
+/// Maps a file written by write_ast() and rebuilds its tree without
+/// copying strings. The tree is valid until the file is re-opened.
+class mapped_ast_file {
+  mapped_file file;
+  ast_node_store nodes;
+  module_node *root = nullptr;
+
+public:
+  /// Returns an error message if the file could not be mapped or read
+  std::optional<std::string> open(const char *path, source_location start);
+  module_node *get_root() const { return root; }
+  /// Memory taken by the tree
+  size_t ast_bytes() const { return nodes.bytes_used(); }
+};
+
+} // namespace jnsn
+#endif // JNSN_JS_AST_FILE_H
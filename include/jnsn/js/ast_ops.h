@@ -15,11 +15,15 @@ public:
 
 const char *get_ast_node_typename(const ast_node &node);
 
-template <class nodety> bool isa(const ast_node *);
-#define NODE(NAME, CHILDREN)                                                   \
-  template <> bool isa<NAME##_node>(const ast_node *);
-#define DERIVED(NAME, EXTENDS, CHILDREN) NODE(NAME, CHILDREN)
-#include "jnsn/js/ast.def"
+/// The kinds of a type and the types derived from it are the range
+/// [static_kind, node_kind_end(static_kind))
+template <class nodety> bool isa(const ast_node *node) {
+  assert(node);
+  constexpr auto first = static_cast<unsigned>(nodety::static_kind);
+  constexpr auto end =
+      static_cast<unsigned>(node_kind_end(nodety::static_kind));
+  return static_cast<unsigned>(node->kind) - first < end - first;
+}
 
 template <class nodety> bool isa(const ast_node &node) {
   return isa<nodety>(&node);
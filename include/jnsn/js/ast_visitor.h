@@ -1,14 +1,81 @@
 #ifndef JNSN_JS_AST_VISITOR_H
 #define JNSN_JS_AST_VISITOR_H
 #include "jnsn/source_location.h"
+#include <cstddef>
+#include <cstdint>
 
 namespace jnsn {
 
+/// Node types in the order of ast.def
+enum class ast_def_index : uint8_t {
+#define NODE(NAME, CHILD_NODES) NAME##_node,
+#define DERIVED(NAME, ANCESTOR, CHILD_NODES) NODE(NAME, CHILD_NODES)
+#include "jnsn/js/ast.def"
+};
+constexpr size_t ast_node_type_count = 0
+#define NODE(NAME, CHILD_NODES) +1
+#define DERIVED(NAME, ANCESTOR, CHILD_NODES) NODE(NAME, CHILD_NODES)
+#include "jnsn/js/ast.def"
+    ;
+static_assert(ast_node_type_count < 256, "Node kinds are stored in a byte");
+
+/// Numbers the node types in pre-order of the type hierarchy, so a type and
+/// all types derived from it form a range of consecutive kinds
+struct ast_kind_layout {
+  /// Parent type of each type by ast_def_index, or -1
+  int parent[ast_node_type_count] = {
+#define NODE(NAME, CHILD_NODES) -1,
+#define EXTENDS(BASE) static_cast<int>(ast_def_index::BASE##_node),
+#define DERIVED(NAME, ANCESTOR, CHILD_NODES) ANCESTOR
+#include "jnsn/js/ast.def"
+  };
+  /// Kind of each type by ast_def_index
+  uint8_t kind[ast_node_type_count] = {};
+  /// One past the last kind derived from each kind
+  uint8_t end[ast_node_type_count] = {};
+
+  constexpr ast_kind_layout() {
+    uint8_t next = 0;
+    for (size_t i = 0; i < ast_node_type_count; ++i) {
+      if (parent[i] == -1) {
+        next = number(i, next);
+      }
+    }
+  }
+
+private:
+  constexpr uint8_t number(size_t type, uint8_t next) {
+    auto first = next++;
+    kind[type] = first;
+    for (size_t i = 0; i < ast_node_type_count; ++i) {
+      if (parent[i] == static_cast<int>(type)) {
+        next = number(i, next);
+      }
+    }
+    end[first] = next;
+    return next;
+  }
+};
+inline constexpr ast_kind_layout ast_kinds;
+
+/// The dynamic type of an ast node
+enum class node_kind : uint8_t {
+#define NODE(NAME, CHILD_NODES)                                                \
+  NAME##_node = ast_kinds.kind[static_cast<size_t>(ast_def_index::NAME##_node)],
+#define DERIVED(NAME, ANCESTOR, CHILD_NODES) NODE(NAME, CHILD_NODES)
+#include "jnsn/js/ast.def"
+};
+/// One past the last kind of the types derived from the type of \p k
+constexpr node_kind node_kind_end(node_kind k) {
+  return static_cast<node_kind>(ast_kinds.end[static_cast<size_t>(k)]);
+}
+
 class const_ast_node_visitor_base;
 /// Base class of all ast nodes (for visitor)
 struct ast_node {
   source_location loc;
-  ast_node(source_location loc) : loc(loc) {}
+  node_kind kind;
+  ast_node(source_location loc, node_kind kind) : loc(loc), kind(kind) {}
   ast_node(const ast_node &) = default;
   ast_node(ast_node &&) = default;
   ast_node &operator=(const ast_node &) = default;
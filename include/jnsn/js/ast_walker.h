@@ -1,21 +1,101 @@
 #ifndef JNSN_JS_AST_WALKER_H
 #define JNSN_JS_AST_WALKER_H
 #include "jnsn/js/ast.h"
+#include <type_traits>
 namespace jnsn {
 
-template <class impl> struct ast_walker : public const_ast_node_visitor<void> {
-  ast_walker() { static_assert(std::is_base_of_v<ast_walker, impl>); }
-// FIXME needs `virtual` because otherwise it won't be instantiated
-// see https://stackoverflow.com/a/23679903/1468532
+/// Whether T is one of the node types of ast.def
+template <class T> struct is_ast_node_type : std::false_type {};
 #define NODE(NAME, CHILD_NODES)                                                \
-  virtual bool on_enter(const NAME##_node &) { return true; }
+  template <> struct is_ast_node_type<NAME##_node> : std::true_type {};
 #define DERIVED(NAME, ANCESTOR, CHILD_NODES) NODE(NAME, CHILD_NODES)
 #include "jnsn/js/ast.def"
 
-#define NODE(NAME, CHILD_NODES)                                                \
-  virtual void on_leave(const NAME##_node &) {}
-#define DERIVED(NAME, ANCESTOR, CHILD_NODES) NODE(NAME, CHILD_NODES)
-#include "jnsn/js/ast.def"
+/// Converts only to nodety, so a call with it selects the handler for
+/// exactly nodety, as opposed to one for an ancestor of it
+template <class nodety> struct exact_node_arg {
+  template <class T, std::enable_if_t<std::is_same_v<std::remove_cv_t<T>,
+                                                     nodety>,
+                                      int> = 0>
+  operator T &() const;
+};
+/// Converts to everything but node types, so a call with it selects a
+/// handler that can never be called for a node
+template <class excluded> struct non_node_arg {
+  template <class T,
+            std::enable_if_t<!is_ast_node_type<std::remove_cv_t<T>>::value &&
+                                 !std::is_same_v<std::remove_cv_t<T>, excluded>,
+                             int> = 0>
+  operator T &() const;
+};
+
+/// Whether impl has a handler `on_enter(const nodety &)` for exactly nodety
+template <class impl, class nodety, class = void>
+struct has_enter_handler : std::false_type {};
+template <class impl, class nodety>
+struct has_enter_handler<
+    impl, nodety,
+    std::void_t<decltype(std::declval<impl &>().on_enter(
+        std::declval<exact_node_arg<nodety>>()))>> : std::true_type {};
+/// Whether impl has a handler `on_leave(const nodety &)` for exactly nodety
+template <class impl, class nodety, class = void>
+struct has_leave_handler : std::false_type {};
+template <class impl, class nodety>
+struct has_leave_handler<
+    impl, nodety,
+    std::void_t<decltype(std::declval<impl &>().on_leave(
+        std::declval<exact_node_arg<nodety>>()))>> : std::true_type {};
+
+/// Walks an AST in pre-order. impl may declare `bool on_enter(const X_node &)`
+/// and `void on_leave(const X_node &)` for any node types X it is interested
+/// in. on_enter is called for a node's type and then for each of its
+/// ancestor types, returning false skips the rest of them and the children.
+/// on_leave is called in reverse order. Handlers are found at compile time
+/// and there is no virtual call per node, so the hooks impl doesn't declare
+/// cost nothing. A handler whose parameter is no node type, e.g. ast_node,
+/// would never be called and is rejected at compile time.
+template <class impl> class ast_walker {
+  impl &self() { return static_cast<impl &>(*this); }
+
+  /// Lets handler_probe name the handlers of impl even if it declares none
+  struct no_handler {};
+  template <class probe> struct handler_probe : probe {
+    using probe::on_enter;
+    using probe::on_leave;
+    static no_handler on_enter(...);
+    static no_handler on_leave(...);
+  };
+  /// Whether impl has no handlers that no node type can select. Two such
+  /// handlers make the call ambiguous, which counts as having them, too.
+  template <class probe, class = void>
+  struct enter_handlers_match_nodes : std::false_type {};
+  template <class probe>
+  struct enter_handlers_match_nodes<
+      probe, std::enable_if_t<std::is_same_v<
+                 decltype(std::declval<handler_probe<probe> &>().on_enter(
+                     std::declval<non_node_arg<no_handler>>())),
+                 no_handler>>> : std::true_type {};
+  template <class probe, class = void>
+  struct leave_handlers_match_nodes : std::false_type {};
+  template <class probe>
+  struct leave_handlers_match_nodes<
+      probe, std::enable_if_t<std::is_same_v<
+                 decltype(std::declval<handler_probe<probe> &>().on_leave(
+                     std::declval<non_node_arg<no_handler>>())),
+                 no_handler>>> : std::true_type {};
+
+  template <class nodety> bool enter(const nodety &node) {
+    if constexpr (has_enter_handler<impl, nodety>::value) {
+      return self().on_enter(node);
+    } else {
+      return true;
+    }
+  }
+  template <class nodety> void leave(const nodety &node) {
+    if constexpr (has_leave_handler<impl, nodety>::value) {
+      self().on_leave(node);
+    }
+  }
 
 #define CHILDREN(...) __VA_ARGS__
 #define ONE(OF, NAME) visit(*node.NAME);
@@ -26,23 +106,47 @@ template <class impl> struct ast_walker : public const_ast_node_visitor<void> {
   if (node.NAME)                                                               \
     visit(**node.NAME);
 #define NODE(NAME, CHILD_NODES)                                                \
-  void accept(const NAME##_node &node) override {                              \
-    if (this->on_enter(node)) {                                                \
+  void walk(const NAME##_node &node) {                                         \
+    if (enter(node)) {                                                         \
       CHILD_NODES                                                              \
     }                                                                          \
-    this->on_leave(node);                                                      \
+    leave(node);                                                               \
   }
 #define EXTENDS(BASE) BASE##_node
 #define DERIVED(NAME, ANCESTOR, CHILD_NODES)                                   \
-  void accept(const NAME##_node &node) override {                              \
-    if (this->on_enter(node)) {                                                \
-      accept(static_cast<const ANCESTOR &>(node));                             \
+  void walk(const NAME##_node &node) {                                         \
+    if (enter(node)) {                                                         \
+      walk(static_cast<const ANCESTOR &>(node));                               \
       CHILD_NODES                                                              \
     }                                                                          \
-    this->on_leave(node);                                                      \
+    leave(node);                                                               \
+  }
+#include "jnsn/js/ast.def"
+
+protected:
+  /// Hidden by the handlers of impl, see handler_probe
+  static no_handler on_enter(no_handler);
+  static no_handler on_leave(no_handler);
+
+public:
+  ast_walker() {
+    static_assert(std::is_base_of_v<ast_walker, impl>);
+    static_assert(enter_handlers_match_nodes<impl>::value,
+                  "An on_enter handler takes no node type");
+    static_assert(leave_handlers_match_nodes<impl>::value,
+                  "An on_leave handler takes no node type");
   }
+  void visit(const ast_node &node) {
+    switch (node.kind) {
+#define NODE(NAME, CHILD_NODES)                                                \
+  case node_kind::NAME##_node:                                                 \
+    walk(static_cast<const NAME##_node &>(node));                              \
+    break;
+#define DERIVED(NAME, ANCESTOR, CHILD_NODES) NODE(NAME, CHILD_NODES)
 #include "jnsn/js/ast.def"
-}; // namespace jnsn
+    }
+  }
+};
 
 } // namespace jnsn
 #endif // JNSN_JS_AST_WALKER_H
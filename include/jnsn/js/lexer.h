@@ -1,81 +1,345 @@
 #ifndef JNSN_JS_LEXER_H
 #define JNSN_JS_LEXER_H
 
-#include "jnsn/source_location.h"
+#include "jnsn/mapped_file.h"
+#include "jnsn/source_manager.h"
 #include "jnsn/string_table.h"
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <optional>
-#include <sstream>
 #include <string>
+#include <type_traits>
+#include <unistd.h>
 #include <variant>
+#include <vector>
 
 namespace jnsn {
 
-enum class token_type {
+enum class token_type : uint8_t {
 #define TOKEN_TYPE(NAME, STR) NAME,
 #include "jnsn/js/tokens.def"
 };
 std::ostream &operator<<(std::ostream &stream, const token_type ty);
 
-enum class keyword_type {
+enum class keyword_type : uint8_t {
 #define KEYWORD(NAME) kw_##NAME,
 #include "jnsn/js/keywords.def"
+  none ///< Used for tokens that are not keywords
 };
 
-///
-///
+/// What the lexer expects after a token, as far as lexing depends on it.
+/// Decides whether a slash starts a regex literal or is a division, and
+/// what an opening parenthesis or brace starts.
+enum class after_token : uint8_t {
+  /// An operand, so a slash starts a regex literal
+  operand,
+  /// An infix or postfix operator, because the token ends an operand
+  infix,
+  /// The parameters of a function expression, or its name before them
+  function_params,
+  /// The body of a function expression
+  function_body
+};
+
+/// Tokens are kept at 16 bytes so they are cheap to copy. They don't store
+/// their text or location: Both are looked up through the lexer that
+/// produced the token, see lexer_base::text_of() and
+/// lexer_base::location_of().
 struct token {
   token_type type;
-  string_table::entry text;
-  source_location loc;
+  /// Which keyword a KEYWORD token is, so it never has to be looked up again
+  keyword_type kw = keyword_type::none;
+  /// Punctuators have an empty text, all other tokens have one
+  bool has_text = false;
+  /// What the lexer expects after the token, set once it is lexed
+  after_token after = after_token::operand;
+  /// Extent of the token's raw text in the lexed source
+  uint32_t offset = 0;
+  uint32_t length = 0;
+  /// Id of the token's text in the lexer's string_table. no_id means that
+  /// the text is the raw source text. Number and string literals have the
+  /// id of their value instead, see lexer_base::value_of() and
+  /// lexer_base::cooked_text_of().
+  string_table::id_type sym = string_table::entry::no_id;
 
   friend std::ostream &operator<<(std::ostream &stream, const token &tok);
-  bool is_number_literal() {
+  bool is_number_literal() const {
     return this->type == token_type::INT_LITERAL ||
            this->type == token_type::HEX_LITERAL ||
            this->type == token_type::OCT_LITERAL ||
            this->type == token_type::BIN_LITERAL ||
            this->type == token_type::FLOAT_LITERAL;
   }
+  /// String literals and the string parts of template literals
+  bool has_string_value() const {
+    return this->type == token_type::STRING_LITERAL ||
+           this->type == token_type::TEMPLATE_STRING ||
+           this->type == token_type::TEMPLATE_HEAD ||
+           this->type == token_type::TEMPLATE_MIDDLE ||
+           this->type == token_type::TEMPLATE_END;
+  }
+  bool is_comment() const {
+    return this->type == token_type::LINE_COMMENT ||
+           this->type == token_type::BLOCK_COMMENT;
+  }
 };
+static_assert(sizeof(token) == 16, "Tokens should stay small");
 
-///
-///
+/// Lexer errors only point to static messages, so they are trivially
+/// copyable and lexer_base::result never owns memory. The full message is
+/// only formatted by message().
 struct lexer_error {
-  std::string msg;
+  const char *msg;
   source_location loc;
+  /// errno of a failed read, or 0
+  int sys_errno = 0;
+  std::string message() const;
   friend std::ostream &operator<<(std::ostream &stream, const lexer_error &e);
 };
 
-///
-///
+/// The tokens of a whole buffer as parallel arrays, filled by
+/// lexer_base::tokenize_all(). Walking it by index makes lookahead and
+/// backtracking free.
+struct token_buffer {
+  /// The fields of a token that its consumers branch on
+  struct kind {
+    token_type type;
+    keyword_type kw;
+    bool has_text;
+    after_token after;
+  };
+  std::vector<kind> kinds;
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> lengths;
+  std::vector<string_table::id_type> syms;
+  /// The lexer's template nesting depth at the start of each token,
+  /// saturated at saturated_depth. Needed to restart lexing mid-buffer.
+  std::vector<uint8_t> template_depths;
+  /// Set if lexing stopped early. The error comes after all tokens.
+  std::optional<lexer_error> error;
+  static constexpr uint8_t saturated_depth = UINT8_MAX;
+
+  size_t size() const { return kinds.size(); }
+  token operator[](size_t i) const {
+    token t{kinds[i].type, kinds[i].kw, kinds[i].has_text, kinds[i].after};
+    t.offset = offsets[i];
+    t.length = lengths[i];
+    t.sym = syms[i];
+    return t;
+  }
+  void push_back(const token &t, size_t template_depth) {
+    kinds.push_back({t.type, t.kw, t.has_text, t.after});
+    offsets.push_back(t.offset);
+    lengths.push_back(t.length);
+    syms.push_back(t.sym);
+    template_depths.push_back(
+        uint8_t(std::min<size_t>(template_depth, saturated_depth)));
+  }
+  void reserve(size_t n) {
+    kinds.reserve(n);
+    offsets.reserve(n);
+    lengths.reserve(n);
+    syms.reserve(n);
+    template_depths.reserve(n);
+  }
+  void resize(size_t n) {
+    kinds.resize(n);
+    offsets.resize(n);
+    lengths.resize(n);
+    syms.resize(n);
+    template_depths.resize(n);
+  }
+  void clear() {
+    kinds.clear();
+    offsets.clear();
+    lengths.clear();
+    syms.clear();
+    template_depths.clear();
+    error.reset();
+  }
+  /// Replaces the tokens in [first, last) with all tokens of \p with and
+  /// moves the tokens after them by \p delta units
+  void splice(size_t first, size_t last, const token_buffer &with,
+              int64_t delta);
+};
+
+/// Describes a change of a lexed buffer: \p removed units at \p offset were
+/// replaced by \p inserted units
+struct text_edit {
+  size_t offset;
+  size_t removed;
+  size_t inserted;
+};
+
+/// The lexer core. It runs a cursor over one contiguous buffer of units,
+/// so there is no per-unit call into the source. Sources install their
+/// buffer through source_lexer below.
 class lexer_base {
 public:
   using unit = char;
   using eof_t = std::monostate;
-  using read_t = std::optional<unit>;
   using result = std::variant<eof_t, lexer_error, token>;
-  using window_t = std::array<read_t, 2>;
+  static_assert(std::is_trivially_copyable_v<result>,
+                "Results are returned for every token");
 
 private:
-  source_location loc;
-  std::stringstream text;
+  /// Holds names and all texts that cannot be views into the source buffer
   string_table str_table;
-  window_t window;
+  /// Values of number literals, indexed by the sym of their tokens
+  struct number_value {
+    double value;
+    /// Id of the literal's text, see token::sym
+    string_table::id_type text;
+  };
+  std::vector<number_value> numbers;
+  /// Cooked texts of string literals, indexed by the sym of their tokens
+  struct string_value {
+    /// Id of the literal's text, see token::sym
+    string_table::id_type text;
+    /// no_id if the literal has no escape sequences, so that its cooked
+    /// text is its text without delimiters
+    string_table::id_type cooked;
+  };
+  std::vector<string_value> strings;
+  /// Set if the current token's text differs from its raw source text
+  bool needs_cooking = false;
+  /// Set if the current token contains escape sequences
+  bool has_escapes = false;
+  /// Scratch space for cooking texts
+  std::string cooked;
   std::optional<token> prev;
   size_t template_depth = 0;
+  /// What an opening parenthesis or brace was opened for. Decides what the
+  /// lexer expects after the closing one.
+  enum class bracket : uint8_t {
+    /// The head of if, while, for or with, after which comes a statement
+    head,
+    /// The parameters of a function expression
+    function_params,
+    /// All other parentheses, which end an operand
+    parens,
+    /// A block, or the body of a function statement or method
+    block,
+    /// An object literal or the body of a function expression
+    operand_braces
+  };
+  /// The open parentheses and braces, innermost last
+  std::vector<bracket> brackets;
+  /// Number of closing parentheses and braces that had no opening one since
+  /// lexing started
+  size_t brackets_below = 0;
+  /// Set while relex() lexes from token bracket_scan of these tokens on.
+  /// The brackets opened before that token are looked up in them once they
+  /// get closed, see pop_bracket().
+  const token_buffer *bracket_base = nullptr;
+  size_t bracket_scan = 0;
+  const unit *buf_begin = nullptr;
+  const unit *buf_end = nullptr;
+  /// Points one past current(), i.e. at the unit peek() returns
+  const unit *cur = nullptr;
+  /// First unit of the token currently being lexed
+  const unit *token_begin = nullptr;
+  /// If set, buf_begin..buf_end outlives all tokens and token texts may be
+  /// views into it instead of copies
+  bool borrow_texts = false;
+  /// Knows the current buffer, earlier ones are forgotten because their
+  /// text may be gone. Locations are only decoded into rows and columns
+  /// when a diagnostic needs them.
+  source_manager sources;
+  /// The current buffer in sources, and the location of its first unit
+  source_manager::file_id file = 0;
+  uint32_t loc_base = 0;
+  /// Where buf_begin is in the whole input. Only streaming sources drop
+  /// input they are done with, for all others this stays at the start.
+  size_t buf_offset = 0;
+  /// Buffer of a streaming source, refilled by read_more()
+  std::vector<unit> stream_buf;
+  bool streaming = false;
+  /// Set once read_more() has reported the end of the input
+  bool stream_done = false;
 
-  unit current() { return *window[0]; }
-  read_t peek() { return window[1]; }
-
-  virtual read_t read_unit() = 0;
+  unit current() { return cur[-1]; }
+  bool has_peek() { return cur != buf_end; }
+  unit peek() {
+    assert(has_peek() && "Peek after eof");
+    return *cur;
+  }
+  bool peek_is(unit u) { return has_peek() && *cur == u; }
+  void advance() {
+    assert(has_peek() && "Read after eof");
+    ++cur;
+  }
+  source_location location_at(size_t offset) const {
+    return source_location(loc_base + offset);
+  }
+  source_location location_of(const unit *pos) const {
+    assert(pos >= buf_begin && pos <= buf_end);
+    return location_at(buf_offset + (pos - buf_begin));
+  }
+  source_location current_loc() const {
+    return location_of(cur == buf_begin ? cur : cur - 1);
+  }
+  /// Offset of a location in the current buffer
+  size_t offset_of(source_location loc) const {
+    assert(loc.get_raw() >= loc_base);
+    return loc.get_raw() - loc_base;
+  }
 
-  bool eof();
-  void advance();
+  /// Makes \p buffer the current buffer and starts over on it
+  void use_buffer(std::string_view buffer, bool stable, std::string name);
+  /// Lexes the next token of the current buffer
+  result lex();
+  /// The lexer state before a token, enough to lex it again. A token opens
+  /// or closes at most one bracket, so only the innermost one is kept.
+  struct checkpoint {
+    size_t template_depth;
+    std::optional<token> prev;
+    size_t brackets;
+    bracket innermost;
+    size_t brackets_below;
+  };
+  checkpoint save() const {
+    return {template_depth, prev, brackets.size(),
+            brackets.empty() ? bracket::block : brackets.back(),
+            brackets_below};
+  }
+  void restore(const checkpoint &c) {
+    template_depth = c.template_depth;
+    prev = c.prev;
+    if (brackets.size() > c.brackets) {
+      brackets.pop_back();
+    } else if (brackets.size() < c.brackets) {
+      brackets.push_back(c.innermost);
+    }
+    brackets_below = c.brackets_below;
+  }
+  /// Returns what the lexer expects after \p t, which was just lexed, and
+  /// opens or closes the bracket it is
+  after_token follow(const token &t);
+  /// What an opening bracket of type \p opener after \p prev opens
+  static bracket opened_after(const std::optional<token> &prev,
+                              token_type opener);
+  /// Closes the innermost open bracket and returns what it was opened for
+  bracket pop_bracket(token_type closer);
+  /// Drops the buffered input before \p keep and appends more input
+  std::optional<lexer_error> refill(const unit *keep);
+  /// Tokens lexed from a guessed lexer state, see tokenize_parallel()
+  struct speculation;
+  /// Lexes the tokens that start in [begin, end) of the current buffer,
+  /// guessing the lexer state at begin from \p start_prev. Lexing restarts
+  /// with a new guess after every error.
+  void speculate(size_t begin, size_t end,
+                 std::optional<token_type> start_prev,
+                 std::vector<speculation> &out);
 
-  result lex_alnum();
-  result lex_punct();
+  /// Maps the first unit of a token to the sub-lexer for it
+  struct dispatch_table;
+  result lex_single_punct();
+  result lex_unknown();
   result lex_number();
   result lex_id_keyword();
   result lex_dot();
@@ -102,41 +366,207 @@ private:
   result lex_closing_brace();
 
   std::optional<lexer_error> consume_escape_seq();
+  /// Makes a token of the given type whose text is the current token's
+  token text_token(token_type ty);
+  /// Like text_token(), but also decodes the value of the number literal
+  token number_token(token_type ty);
+  /// Like text_token(), but also cooks the string literal
+  token string_token(token_type ty);
+  /// Returns the id of the cooked text of a string literal whose text
+  /// without delimiters is \p raw, or no_id if it is the same
+  string_table::id_type cook(std::string_view raw);
+  /// Returns the id of the text of a token
+  string_table::id_type text_id(const token &t) const {
+    if (t.is_number_literal()) {
+      return numbers[t.sym].text;
+    }
+    return t.has_string_value() ? strings[t.sym].text : t.sym;
+  }
+
+protected:
+  /// Makes the lexer start over on the given buffer. The texts and values
+  /// of all tokens lexed so far are dropped. If \p stable is true, the
+  /// buffer has to outlive all tokens, which allows token texts to be views
+  /// into it instead of copies. It also has to outlive all locations that
+  /// get decoded. Locations in earlier buffers cannot be decoded anymore.
+  /// \p name is the buffer's name in the source_manager.
+  void set_buffer(std::string_view buffer, bool stable,
+                  std::string name = {});
+  /// Like set_buffer(), but for an edited version of the current buffer
+  /// with the same name and stability. Texts and values of the tokens lexed
+  /// so far stay valid, so relex() can reuse them.
+  void edit_buffer(std::string_view buffer);
+  /// Makes the lexer start over on input that is read piece by piece
+  /// through read_more(). Only as much of it is buffered as the token
+  /// being lexed needs. Rows and columns are only known for locations in
+  /// the buffered input, e.g. those of the latest token or error, earlier
+  /// ones only decode to their offset. Likewise, the text and value of a
+  /// token are only kept until the next call of next().
+  void start_stream();
+  /// Reads up to \p n more units of a stream into \p dest, see
+  /// start_stream(). Follows the conventions of read(2): Returns the
+  /// number of units read, 0 at the end of the input or -1 on errors.
+  virtual ssize_t read_more(unit *dest, size_t n) { return 0; }
 
 public:
-  lexer_base() : window({' ', '\n'}) {}
+  virtual ~lexer_base() = default;
   const result next();
-  void reset() {
-    window = {' ', '\n'};
-    loc = {};
-    template_depth = 0;
-  }
+  /// Lexes the rest of the current buffer into \p out in one go. Comments
+  /// are dropped. Stops at the first error, which is stored in out.error.
+  /// Streams don't keep the values of their tokens, so they can only be
+  /// lexed by next().
+  void tokenize_all(token_buffer &out);
+  /// Lexes the whole current buffer into \p out like reset() followed by
+  /// tokenize_all() would, but on up to \p jobs threads (0 means one per
+  /// core). Every thread lexes a chunk of at least \p min_chunk units,
+  /// guessing that it starts outside of any literal or comment, and that
+  /// the brackets it closes are plain parentheses and blocks. Chunks are
+  /// then checked in order and lexed again from where the guess was wrong,
+  /// and finally copied into \p out in parallel. Equal texts get equal ids,
+  /// but not necessarily the ids tokenize_all() would give them. Sources
+  /// whose text is not stable are lexed sequentially, and so is everything
+  /// on a single core.
+  void tokenize_parallel(token_buffer &out, unsigned jobs = 0,
+                         size_t min_chunk = 256 * 1024);
+  /// Updates \p toks, which tokenize_all() made from the buffer before
+  /// \p edit, to the current buffer. Lexing restarts shortly before the
+  /// edit and stops as soon as it is back in step with the old tokens,
+  /// which are then reused. \p toks must come from this lexer, and the new
+  /// buffer must have been installed by edit_buffer(), so that their texts
+  /// and values stay valid. Afterwards, the lexer is at an unspecified
+  /// position; call reset() before lexing on.
+  void relex(token_buffer &toks, const text_edit &edit);
+  /// Start lexing the current buffer from its beginning again. Streams
+  /// cannot be reset.
+  void reset();
+  /// Makes a token as if it had been lexed from \p text. Its text and value
+  /// stay valid until the lexer gets a new buffer.
   token make_token(token_type, const char *text);
-  static keyword_type get_keyword_type(const token &);
+  /// Returns the text of a token that was lexed from the current buffer or
+  /// made by make_token()
+  string_table::entry text_of(const token &t) const {
+    auto sym = text_id(t);
+    if (sym != string_table::entry::no_id) {
+      return str_table[sym];
+    }
+    if (!t.has_text) {
+      return {};
+    }
+    assert(t.offset + t.length <= size_t(buf_end - buf_begin));
+    return string_table::get_borrowed_handle(
+        {buf_begin + t.offset, t.length});
+  }
+  /// Returns the value of a number literal token that was lexed by this
+  /// lexer or made by make_token(). Values are decoded once, while lexing.
+  double value_of(const token &t) const {
+    assert(t.is_number_literal());
+    return numbers[t.sym].value;
+  }
+  /// Returns the value of a string literal or template part, i.e. its text
+  /// without quotes, backticks or braces and with all escape sequences
+  /// decoded (as UTF-8). Values are cooked once, while lexing, and are views
+  /// into the text unless the literal has escape sequences.
+  string_table::entry cooked_text_of(const token &t) const;
+  /// Returns the location of a token that was lexed from the current buffer
+  source_location location_of(const token &t) const {
+    return location_at(t.offset);
+  }
+  /// Returns the location of the first unit of the current buffer
+  source_location start_location() const { return location_at(0); }
+  /// Computes row and column of a location of a token or error of this
+  /// lexer, see source_manager::decode()
+  decoded_location decode(source_location loc) {
+    return sources.decode(loc);
+  }
+  const source_manager &get_sources() const { return sources; }
+  /// Number of bytes held for token texts and values and buffered input
+  size_t bytes_reserved() const {
+    return str_table.bytes_reserved() +
+           numbers.capacity() * sizeof(number_value) +
+           strings.capacity() * sizeof(string_value) + cooked.capacity() +
+           stream_buf.capacity();
+  }
+  static keyword_type get_keyword_type(const token &t) {
+    assert(t.type == token_type::KEYWORD);
+    return t.kw;
+  }
+  /// Returns keyword_type::none if word is not a keyword
+  static keyword_type lookup_keyword(std::string_view word);
 };
 
 std::ostream &operator<<(std::ostream &stream, const lexer_base::result &res);
 
+/// CRTP glue between the lexer core and a source. `impl` has to provide
+/// `std::string_view source_text()` and a `static constexpr bool
+/// stable_text` saying whether that text outlives the tokens lexed from
+/// it. Both are resolved at compile time, so the core never calls back
+/// into the source while lexing.
+template <class impl> class source_lexer : public lexer_base {
+protected:
+  /// Must be called whenever impl's source_text() has changed
+  void load(std::string name = {}) {
+    auto &self = static_cast<impl &>(*this);
+    set_buffer(self.source_text(), impl::stable_text, std::move(name));
+  }
+  /// Can be called instead of load() if impl's source_text() is an edited
+  /// version of what it was, see relex()
+  void load_edited() {
+    edit_buffer(static_cast<impl &>(*this).source_text());
+  }
+};
+
 ///
 ///
-class cin_line_lexer : public lexer_base {
+class cin_line_lexer : public source_lexer<cin_line_lexer> {
   std::string line;
-  std::string::iterator it;
-  read_t read_unit() override {
-    read_t res;
-    if (it != line.end()) {
-      res = {*it};
-      ++it;
-    }
-    return res;
-  }
 
 public:
+  static constexpr bool stable_text = true;
+  std::string_view source_text() const { return line; }
   cin_line_lexer() {
     std::getline(std::cin, line);
-    it = line.begin();
+    load();
+  }
+};
+
+/// Lexes a whole file through a read-only memory mapping. Token texts are
+/// views into the mapping wherever possible, so they, and decoding
+/// locations, are only valid as long as the lexer is alive and hasn't been
+/// re-opened.
+class mapped_file_lexer : public source_lexer<mapped_file_lexer> {
+  mapped_file file;
+
+public:
+  static constexpr bool stable_text = true;
+  std::string_view source_text() const { return file.text(); }
+  /// Returns an error message if the file could not be mapped
+  std::optional<std::string> open(const char *path) {
+    auto error = file.map(path);
+    load(path);
+    return error;
   }
 };
+
+/// Lexes everything that can be read from a file descriptor, e.g. a pipe.
+/// The input is read in chunks and only kept until the tokens in it are
+/// lexed, so memory use depends on the largest token, not the input size.
+/// All token texts are copies that are dropped along with the input. The
+/// file descriptor is not closed.
+class fd_lexer : public lexer_base {
+  int fd;
+
+protected:
+  ssize_t read_more(unit *dest, size_t n) override {
+    ssize_t res;
+    do {
+      res = ::read(fd, dest, n);
+    } while (res == -1 && errno == EINTR);
+    return res;
+  }
+
+public:
+  explicit fd_lexer(int fd) : fd(fd) { start_stream(); }
+};
 } // namespace jnsn
 
 #endif // JNSN_JS_LEXER_H
@@ -3,7 +3,7 @@
 
 #include "jnsn/js/ast.h"
 #include "jnsn/js/lexer.h"
-#include <stack>
+#include <array>
 
 namespace jnsn {
 
@@ -16,21 +16,130 @@ struct parser_error {
 class parser_base {
 public:
   using ast_root = module_node;
-  template <class nodety> using res = std::variant<nodety *, parser_error>;
-  using result = res<ast_root>;
+  using result = std::variant<ast_root *, parser_error>;
+  /// What parse functions return: the parsed node, or null if parsing
+  /// failed. Why it failed is recorded in the parser by fail(), so results
+  /// stay pointer-sized.
+  template <class nodety> class res {
+    nodety *node;
+
+  public:
+    res(nodety *node) : node(node) {}
+    template <class other> res(res<other> r) : node(r.get()) {}
+    nodety *get() const { return node; }
+    bool failed() const { return !node; }
+  };
+  /// How the parser gets its tokens from the lexer
+  enum class lexing_mode {
+    /// One at a time, interleaved with parsing
+    streaming,
+    /// All at once through lexer_base::tokenize_all() before parsing starts
+    buffered
+  };
+  /// Work done by the latest parse, which has to grow linearly with the
+  /// input
+  struct work_counts {
+    /// Calls of advance(), including those that step over rewound tokens
+    size_t advances = 0;
+    /// Operator nodes built from pending_ops
+    size_t reductions = 0;
+    /// Largest sizes of pending_ops and operands
+    size_t max_pending_ops = 0;
+    size_t max_operands = 0;
+  };
 
 private:
   virtual lexer_base &get_lexer() = 0;
 
+  /// The first error of a parse. Only what is needed to describe it later
+  /// is recorded, the message is formatted by describe_failure().
+  struct failure {
+    enum kind_t : uint8_t {
+      /// msg is the whole message
+      message,
+      /// The message is msg, the type of token at, then suffix
+      unexpected_token,
+      /// The lexer failed with lexer_error
+      lexing
+    } kind = message;
+    const char *msg = nullptr;
+    const char *suffix = "";
+    /// Where parsing failed
+    token at{token_type::SEMICOLON};
+    lexer_error lex_error{nullptr};
+  } last_failure;
+
   ast_node_store nodes;
   module_node *module;
   token current_token;
-  std::stack<token> rewind_stack;
+  /// How many tokens the parser can step back over with rewind()
+  static constexpr size_t max_lookahead = 7;
+  /// The latest tokens from the lexer in streaming mode. Rewinding and
+  /// advancing over them just moves the position in this ring.
+  static constexpr size_t history_size = max_lookahead + 1;
+  static_assert((history_size & (history_size - 1)) == 0,
+                "The ring is indexed by masking");
+  std::array<token, history_size> history;
+  /// Number of tokens taken from the lexer so far
+  size_t lexed = 0;
+  /// Number of those that come after current_token because of rewind()
+  size_t lookahead = 0;
+  lexing_mode mode = lexing_mode::streaming;
+  /// A binary operator whose right hand side is still being parsed
+  struct pending_op {
+    token op;
+    source_location loc;
+    /// Middle operand of the ternary operator
+    expression_node *mid;
+  };
+  /// Operator and operand stacks of parse_expression(). Nested expressions
+  /// push on top of the enclosing ones and pop back to where they started.
+  std::vector<pending_op> pending_ops;
+  std::vector<expression_node *> operands;
+  work_counts work;
+  /// Children of the lists that are being parsed. Lists of nested nodes are
+  /// pushed on top of the enclosing ones and frozen into the node store with
+  /// freeze_children() and freeze_strs() once complete.
+  std::vector<ast_node *> child_stack;
+  std::vector<string_table::entry> str_stack;
+  /// Tokens in buffered mode, tokens[token_pos - 1] is current_token
+  token_buffer tokens;
+  size_t token_pos = 0;
 
   lexer_base::result next_token();
-  std::variant<bool, parser_error> advance();
+  /// Tokens only know their text and location through the lexer
+  string_table::entry text_of(const token &t) { return get_lexer().text_of(t); }
+  source_location loc_of(const token &t) { return get_lexer().location_of(t); }
+  double value_of(const token &t) { return get_lexer().value_of(t); }
+  string_table::entry cooked_text_of(const token &t) {
+    return get_lexer().cooked_text_of(t);
+  }
+  enum class advanced : uint8_t { token, eof, failed };
+  /// Makes the next token the current one. Lexer errors are recorded like
+  /// parse errors.
+  advanced advance();
   void rewind(token t);
   void reset();
+  /// Records an error at \p at. Returns null, so parse functions can fail
+  /// with `return fail(...)`. \p msg must be a static string.
+  std::nullptr_t fail(const char *msg, token at) {
+    last_failure.kind = failure::message;
+    last_failure.msg = msg;
+    last_failure.at = at;
+    return nullptr;
+  }
+  std::nullptr_t fail(const char *msg) { return fail(msg, current_token); }
+  /// Records an error about the type of the current token
+  std::nullptr_t fail_unexpected(const char *msg, const char *suffix = "") {
+    fail(msg);
+    last_failure.kind = failure::unexpected_token;
+    last_failure.suffix = suffix;
+    return nullptr;
+  }
+  parser_error describe_failure();
+  /// Moves the children pushed since child_stack had size \p mark into a list
+  template <class nodety> node_list<nodety *> freeze_children(size_t mark);
+  node_list<string_table::entry> freeze_strs(size_t mark);
 
   res<statement_node> parse_statement();
   res<statement_node> parse_keyword_stmt();
@@ -50,6 +159,7 @@ private:
   res<class_stmt_node> parse_class_stmt();
 
   res<expression_node> parse_expression(bool comma_is_operator);
+  void reduce_bin_op();
   res<expression_node> parse_unary_or_atomic_expr();
   res<expression_node> parse_atomic_expr();
   res<expression_node> parse_atomic_keyword_expr();
@@ -63,8 +173,6 @@ private:
   res<param_list_node> parse_param_list();
   res<block_node> parse_block();
   res<var_decl_node> parse_var_decl();
-  res<bin_op_expr_node> parse_bin_op(expression_node *lhs,
-                                     bool comma_is_operator);
   res<array_literal_node> parse_array_literal();
   res<object_literal_node> parse_object_literal();
   res<computed_member_access_node> parse_computed_access(expression_node *base);
@@ -72,6 +180,17 @@ private:
   res<call_expr_node> parse_call(expression_node *callee);
 
 public:
+  void set_lexing_mode(lexing_mode m) { mode = m; }
+  /// Memory taken by the AST of the latest parse
+  size_t ast_bytes() const { return nodes.bytes_used(); }
+  const work_counts &get_work() const { return work; }
+  /// Computes row and column of the location of a node or error of the
+  /// latest parse
+  decoded_location decode(source_location loc) {
+    return get_lexer().decode(loc);
+  }
+  /// Location of the start of the input of the latest parse
+  source_location start_location() { return get_lexer().start_location(); }
   result parse(bool verify = true);
 };
 
@@ -80,5 +199,19 @@ class cin_line_parser : public parser_base {
   lexer_base &get_lexer() { return lexer; }
 };
 
+/// Parses whole files. The AST of a file is valid until the next one is
+/// opened, because literal texts may be views into the mapped file.
+class mapped_file_parser : public parser_base {
+  mapped_file_lexer lexer;
+  lexer_base &get_lexer() { return lexer; }
+
+public:
+  /// Returns an error message if the file could not be mapped
+  std::optional<std::string> open(const char *path) {
+    return lexer.open(path);
+  }
+  std::string_view source_text() const { return lexer.source_text(); }
+};
+
 } // namespace jnsn
 #endif // JNSN_JS_PARSER_H
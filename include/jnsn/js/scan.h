@@ -0,0 +1,43 @@
+#ifndef JNSN_JS_SCAN_H
+#define JNSN_JS_SCAN_H
+
+namespace jnsn {
+namespace scan {
+
+/// Instruction sets the scanning kernels can be built for
+enum class isa { scalar, sse2, avx2 };
+const char *isa_name(isa);
+
+/// The best instruction set the current CPU supports
+isa best_isa();
+/// Switches all kernels to the given instruction set, which has to be
+/// supported by the CPU. Not thread-safe; mostly useful for benchmarks and
+/// tests. By default, best_isa() is used.
+void use_isa(isa);
+isa active_isa();
+
+/// Returns the first position in [begin, end) that holds one of the four
+/// needles (which may repeat), or end
+const char *find_any(const char *begin, const char *end, char a, char b,
+                     char c, char d);
+inline const char *find_any(const char *begin, const char *end, char a,
+                            char b, char c) {
+  return find_any(begin, end, a, b, c, c);
+}
+inline const char *find_any(const char *begin, const char *end, char a,
+                            char b) {
+  return find_any(begin, end, a, b, b, b);
+}
+inline const char *find(const char *begin, const char *end, char c) {
+  return find_any(begin, end, c, c, c, c);
+}
+/// Returns the end of the run of whitespace (' ', '\t', '\n', '\v', '\f' and
+/// '\r') that starts at begin
+const char *skip_space(const char *begin, const char *end);
+/// Returns the end of the run of identifier units (ASCII alphanumerics, '_',
+/// '$' and '\\') that starts at begin
+const char *skip_ident(const char *begin, const char *end);
+
+} // namespace scan
+} // namespace jnsn
+#endif // JNSN_JS_SCAN_H
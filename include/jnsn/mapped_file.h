@@ -0,0 +1,87 @@
+#ifndef JNSN_MAPPED_FILE_H
+#define JNSN_MAPPED_FILE_H
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace jnsn {
+
+/// Read-only memory mapping of a whole file.
+/// The mapped bytes stay valid (and at the same address) until the
+/// mapped_file is destroyed or mapped to another file, which allows
+/// handing out views into the file contents instead of copies.
+class mapped_file {
+  const char *data = nullptr;
+  size_t size = 0;
+
+  void unmap() {
+    if (data) {
+      ::munmap(const_cast<char *>(data), size);
+    }
+    data = nullptr;
+    size = 0;
+  }
+
+public:
+  mapped_file() = default;
+  mapped_file(const mapped_file &) = delete;
+  mapped_file(mapped_file &&o) : data(o.data), size(o.size) {
+    o.data = nullptr;
+    o.size = 0;
+  }
+  mapped_file &operator=(const mapped_file &) = delete;
+  mapped_file &operator=(mapped_file &&o) {
+    if (this != &o) {
+      unmap();
+      data = o.data;
+      size = o.size;
+      o.data = nullptr;
+      o.size = 0;
+    }
+    return *this;
+  }
+  ~mapped_file() { unmap(); }
+
+  /// Returns an error message if the file could not be mapped
+  std::optional<std::string> map(const char *path) {
+    unmap();
+    int fd = ::open(path, O_RDONLY);
+    if (fd == -1) {
+      return std::string("Could not open ") + path + ": " +
+             std::strerror(errno);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) == -1) {
+      auto err = errno;
+      ::close(fd);
+      return std::string("Could not stat ") + path + ": " +
+             std::strerror(err);
+    }
+    // mmap refuses to map zero bytes, but empty files are perfectly fine
+    if (st.st_size == 0) {
+      ::close(fd);
+      return std::nullopt;
+    }
+    void *addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    auto err = errno;
+    ::close(fd); // the mapping keeps its own reference to the file
+    if (addr == MAP_FAILED) {
+      return std::string("Could not map ") + path + ": " + std::strerror(err);
+    }
+    ::madvise(addr, st.st_size, MADV_SEQUENTIAL);
+    data = static_cast<const char *>(addr);
+    size = st.st_size;
+    return std::nullopt;
+  }
+
+  std::string_view text() const { return {data, size}; }
+};
+
+} // namespace jnsn
+#endif // JNSN_MAPPED_FILE_H
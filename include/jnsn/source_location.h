@@ -1,48 +1,48 @@
 #ifndef JNSN_SOURCE_LOCATION_H
 #define JNSN_SOURCE_LOCATION_H
-#include <cctype>
-#include <sstream>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
 
 namespace jnsn {
 
 /// FIXME duplicate type alias
 using unit_t = char;
 
+/// A position in one of the buffers of a source_manager, encoded in 32
+/// bits. Every buffer has a range of locations of its own, so a location is
+/// the first location of its buffer plus the offset into the buffer. Rows
+/// and columns are only computed by source_manager::decode().
 class source_location {
-  size_t row, col;
+  uint32_t raw = 0;
 
 public:
-  /// Why does row begin at 0? To allow filling the lexer's sliding window
-  /// with some initial content plus a newline so it isn't regarded as EOF
-  /// and the source_location is still at the correct position after the
-  /// sliding window's initial content has been consumed
-  source_location() : row(0), col(1) {}
-  source_location(size_t row, size_t col) : row(row), col(col) {}
-  source_location(const source_location &) = default;
-  source_location(source_location &&) = default;
-  source_location &operator=(const source_location &) = default;
-  source_location &operator=(source_location &&) = default;
-
-  size_t get_row() { return row; }
-  size_t get_col() { return col; }
-
-  void advance(unit_t u) {
-    if (u == '\n') {
-      ++row;
-      col = 1;
-    } else if (u == '\r') {
-      // do nothing
-    } else {
-      ++col;
-    }
+  /// No location at all
+  source_location() = default;
+  explicit source_location(uint32_t raw) : raw(raw) {}
+
+  uint32_t get_raw() const { return raw; }
+  bool is_valid() const { return raw != 0; }
+  friend bool operator==(source_location a, source_location b) {
+    return a.raw == b.raw;
   }
+  friend bool operator!=(source_location a, source_location b) {
+    return a.raw != b.raw;
+  }
+};
+
+/// Where a source_location is in human terms. Rows and columns start at 1
+/// and columns count units, except for '\r'. Invalid locations decode to
+/// row and column 0.
+struct decoded_location {
+  uint32_t file = 0;
+  size_t offset = 0;
+  size_t row = 0;
+  size_t col = 0;
 
   friend std::ostream &operator<<(std::ostream &stream,
-                                  const source_location &loc) {
-    std::stringstream ss;
-    ss << "line: " << loc.row << ", column: " << loc.col;
-    stream << ss.str();
-    return stream;
+                                  const decoded_location &loc) {
+    return stream << "line: " << loc.row << ", column: " << loc.col;
   }
 };
 
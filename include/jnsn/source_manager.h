@@ -0,0 +1,106 @@
+#ifndef JNSN_SOURCE_MANAGER_H
+#define JNSN_SOURCE_MANAGER_H
+#include "jnsn/source_location.h"
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace jnsn {
+
+/// Knows the buffers that were loaded for lexing and hands out the
+/// source_locations in them. Each buffer gets one location per unit plus
+/// one for its end. Lines and columns are only computed by decode(), from
+/// an index of the buffer's line breaks that is built on first use.
+///
+/// Streams are only known through a window of their text, the part their
+/// reader still buffers. Of the units before the window, only the number
+/// of lines is kept, so memory use does not grow with the input.
+///
+/// The manager does not own the text of its buffers. Each lexer has a
+/// manager of its own that only knows the lexer's current buffer, so file
+/// ids and locations are only meaningful to the lexer that made them.
+class source_manager {
+public:
+  using file_id = uint32_t;
+
+private:
+  struct buffer {
+    std::string name;
+    /// Location of offset 0
+    uint32_t base;
+    /// Number of units, so far for a stream that is still open
+    size_t size;
+    /// The text from window_offset on, or all of it for buffers that are
+    /// not streams
+    std::string_view text;
+    size_t window_offset = 0;
+    /// Number of '\n' before window_offset, where the last line before it
+    /// starts and how many '\r' that line has before window_offset
+    size_t rows_before = 0;
+    size_t line_begin = 0;
+    size_t line_returns = 0;
+    /// Whether text has been indexed since it was last changed
+    bool indexed = false;
+    /// Offsets of all '\n' and of all '\r' in text, in order
+    std::vector<uint32_t> newlines;
+    std::vector<uint32_t> returns;
+  };
+  /// Sorted by base
+  std::vector<buffer> buffers;
+  /// Set while the last buffer is a stream that may still grow
+  bool stream_open = false;
+
+  uint64_t next_base() const {
+    if (buffers.empty()) {
+      return 1;
+    }
+    return uint64_t{buffers.back().base} + buffers.back().size + 1;
+  }
+  static void index(buffer &b);
+
+public:
+  /// Whether a buffer of \p size units, or that many more units of the open
+  /// stream, still get locations
+  bool has_room(size_t size) const {
+    return next_base() + size <= UINT32_MAX;
+  }
+  /// Adds a buffer, which must have room. \p text has to stay valid until
+  /// the manager is cleared, since it is only indexed once decode() needs
+  /// it.
+  file_id add_buffer(std::string_view text, std::string name = {});
+  /// Adds a buffer that grows by extend_stream(), until another buffer is
+  /// added
+  file_id add_stream(std::string name = {});
+  /// Sets the window of the stream \p file, which must be the last buffer,
+  /// to \p text. It starts where the window did so far and must not be
+  /// shorter than it, the stream grows by the rest, for which it must have
+  /// room. \p text has to stay valid until the next change of the window.
+  void extend_stream(file_id file, std::string_view text);
+  /// Moves the start of the window of the stream \p file to \p offset.
+  /// Its units before \p offset are about to be dropped by the reader, so
+  /// this has to be called while the current window is still valid. Until
+  /// extend_stream() is called again, the window is empty.
+  void drop_stream_prefix(file_id file, size_t offset);
+  /// Forgets all buffers. Their locations must not be decoded anymore.
+  void clear() {
+    buffers.clear();
+    stream_open = false;
+  }
+
+  source_location location(file_id file, size_t offset) const {
+    assert(file < buffers.size() && offset <= buffers[file].size);
+    return source_location(buffers[file].base + offset);
+  }
+  /// Computes row and column of \p loc, which has to be from this manager.
+  /// Locations before the window of a stream only decode to their file and
+  /// offset. Builds the line index of the buffer on first use, so this is
+  /// not const and must not run concurrently with other calls.
+  decoded_location decode(source_location loc);
+  const std::string &name(file_id file) const { return buffers[file].name; }
+  size_t size() const { return buffers.size(); }
+};
+
+} // namespace jnsn
+#endif // JNSN_SOURCE_MANAGER_H
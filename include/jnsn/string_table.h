@@ -1,15 +1,29 @@
 #ifndef JNSN_STRING_TABLE_H
 #define JNSN_STRING_TABLE_H
-#include <set> // don't use unordered_set because elements might relocate
+#include "jnsn/arena.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
 #include <string>
 #include <string_view>
+#include <vector>
 
 namespace jnsn {
 
 class string_table;
 class string_table_entry {
   friend class string_table;
+
+public:
+  using id_type = uint32_t;
+  /// Id of entries that were not interned, see
+  /// string_table::get_borrowed_handle
+  static constexpr id_type no_id = ~id_type{0};
+
+private:
   std::string_view text;
+  id_type sym = no_id;
   // Having this constructor private is the whole point why we don't
   // just use an alias declaration for string_table_entry:
   // You can't just go and create one from a string literal, which helps
@@ -17,7 +31,8 @@ class string_table_entry {
   // but the method relies on the pointer identity of the string, for
   // example.
   // FIXME find and document a real example where this matters
-  string_table_entry(std::string_view text) : text(std::move(text)) {}
+  string_table_entry(std::string_view text, id_type sym = no_id)
+      : text(text), sym(sym) {}
 
 public:
   string_table_entry() = default;
@@ -32,7 +47,20 @@ public:
   std::string_view::size_type size() const noexcept { return text.size(); }
   std::string_view::iterator begin() const { return text.begin(); }
   std::string_view::iterator end() const { return text.end(); }
-  bool operator==(const string_table_entry &o) const { return text == o.text; }
+  /// Dense index of this entry in its string_table, or no_id for borrowed
+  /// handles. Can be used to index per-symbol side tables.
+  id_type id() const { return sym; }
+  bool is_interned() const { return sym != no_id; }
+  /// Interned entries are unique within their table, so two of them are
+  /// compared by id. This is only meaningful if both come from the same
+  /// table. Borrowed handles fall back to comparing the text.
+  bool operator==(const string_table_entry &o) const {
+    if (is_interned() && o.is_interned()) {
+      return sym == o.sym;
+    }
+    return text == o.text;
+  }
+  bool operator!=(const string_table_entry &o) const { return !(*this == o); }
   bool operator<(const string_table_entry &o) const { return text < o.text; }
   const std::string_view *operator->() const { return &text; }
   friend std::ostream &operator<<(std::ostream &stream,
@@ -49,24 +77,122 @@ public:
   }
 };
 
+/// Interns strings. Every distinct string is copied once into an arena, so
+/// its address never changes, and is numbered densely in insertion order.
+/// Lookup goes through an open-addressing hash table with linear probing.
 class string_table {
+public:
+  using entry = string_table_entry;
+  using id_type = entry::id_type;
+
 private:
-  using container = std::set<std::string>;
-  container table;
+  using container = std::vector<entry>;
+  struct slot {
+    uint32_t hash;
+    id_type id;
+  };
+  static constexpr size_t min_slots = 64;
+  /// Indexed by id
+  container entries;
+  /// Power-of-two sized, empty slots have id == entry::no_id
+  std::vector<slot> slots;
+  arena texts;
+
+  template <class ty> static uint64_t load(const char *p) {
+    ty w;
+    std::memcpy(&w, p, sizeof(ty));
+    return w;
+  }
+  static uint32_t hash(std::string_view s) {
+    // Mixes eight bytes at a time, identifiers are usually done after one
+    // or two rounds. Shorter tails are read with fixed-size loads that may
+    // overlap, which is fine because the length is hashed, too.
+    constexpr uint64_t mul = 0x9e3779b97f4a7c15ull;
+    uint64_t h = s.size() * mul;
+    const char *p = s.data();
+    size_t n = s.size();
+    for (; n >= 8; p += 8, n -= 8) {
+      h = (h ^ load<uint64_t>(p)) * mul;
+      h ^= h >> 32;
+    }
+    if (n >= 4) {
+      h = (h ^ load<uint32_t>(p) ^ load<uint32_t>(p + n - 4) << 32) * mul;
+    } else if (n) {
+      auto w = uint64_t(uint8_t(p[0])) | uint64_t(uint8_t(p[n / 2])) << 8 |
+               uint64_t(uint8_t(p[n - 1])) << 16;
+      h = (h ^ w) * mul;
+    }
+    h ^= h >> 29;
+    h *= 0xbf58476d1ce4e5b9ull;
+    return static_cast<uint32_t>(h ^ (h >> 32));
+  }
+  void grow() {
+    std::vector<slot> old(std::max(min_slots, slots.size() * 2),
+                          {0, entry::no_id});
+    old.swap(slots);
+    size_t mask = slots.size() - 1;
+    for (auto &s : old) {
+      if (s.id == entry::no_id) {
+        continue;
+      }
+      size_t i = s.hash & mask;
+      while (slots[i].id != entry::no_id) {
+        i = (i + 1) & mask;
+      }
+      slots[i] = s;
+    }
+  }
 
 public:
-  using entry = string_table_entry;
-  using iterator = container::iterator;
+  using iterator = container::const_iterator;
   using const_iterator = container::const_iterator;
-  entry get_handle(std::string s) {
-    auto it_ins = table.insert(std::move(s));
-    auto it = it_ins.first;
-    return std::string_view{it->data(), it->size()};
+  string_table() = default;
+  string_table(const string_table &) = delete;
+  string_table(string_table &&) = default;
+  string_table &operator=(const string_table &) = delete;
+  string_table &operator=(string_table &&) = default;
+
+  entry get_handle(std::string_view s) {
+    // keep the load factor at or below 1/2
+    if (2 * (entries.size() + 1) > slots.size()) {
+      grow();
+    }
+    auto h = hash(s);
+    size_t mask = slots.size() - 1;
+    size_t i = h & mask;
+    for (; slots[i].id != entry::no_id; i = (i + 1) & mask) {
+      if (slots[i].hash == h && entries[slots[i].id].text == s) {
+        return entries[slots[i].id];
+      }
+    }
+    auto id = static_cast<id_type>(entries.size());
+    slots[i] = {h, id};
+    entries.push_back({texts.copy(s), id});
+    return entries.back();
+  }
+  /// Creates a handle for text that lives outside of any string_table,
+  /// e.g. inside a memory-mapped source file. No copy is made, so the
+  /// caller has to guarantee that the text outlives all uses of the handle.
+  /// Borrowed handles have no id.
+  static entry get_borrowed_handle(std::string_view text) { return text; }
+  /// Returns the entry that was assigned \p id
+  entry operator[](id_type id) const { return entries[id]; }
+  /// Number of distinct entries, i.e. one past the largest id
+  size_t size() const { return entries.size(); }
+  /// Forgets all entries, whose texts must not be used anymore. Ids start
+  /// over at zero, the memory is kept for reuse.
+  void clear() {
+    entries.clear();
+    std::fill(slots.begin(), slots.end(), slot{0, entry::no_id});
+    texts.clear();
+  }
+  /// Number of bytes held by the table, including unused ones
+  size_t bytes_reserved() const {
+    return entries.capacity() * sizeof(entry) +
+           slots.capacity() * sizeof(slot) + texts.bytes_reserved();
   }
-  iterator begin() { return table.begin(); }
-  const_iterator begin() const { return table.begin(); }
-  iterator end() { return table.end(); }
-  const_iterator end() const { return table.end(); }
+  const_iterator begin() const { return entries.begin(); }
+  const_iterator end() const { return entries.end(); }
 };
 
 } // namespace jnsn
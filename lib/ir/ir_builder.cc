@@ -7,8 +7,8 @@ ir_builder::ir_builder(module &mod) : mod(mod), ctx(mod.get_context()) {}
 function *ir_builder::get_intrinsic(intrinsic i) {
   return ctx.get_intrinsic(i);
 }
-str_val *ir_builder::get_str_val(std::string str) {
-  return mod.get_str_val(std::move(str));
+str_val *ir_builder::get_str_val(std::string_view str) {
+  return mod.get_str_val(str);
 }
 basic_block *ir_builder::make_block(function &F) {
   auto *bb = ctx.make_block();
@@ -24,12 +24,12 @@ c_num_val *ir_context::get_c_num_val(double d) {
   }
   return &I->second;
 }
-string_table_entry ir_context::internalize_string(std::string s) {
-  return str_table.get_handle(std::move(s));
+string_table_entry ir_context::internalize_string(std::string_view s) {
+  return str_table.get_handle(s);
 }
-str_val *ir_context::make_str_val(std::string val) {
-  auto h = str_table.get_handle(std::move(val));
-  strs.emplace_back(str_val(h, *this));
+str_val *ir_context::make_str_val(string_table_entry val) {
+  assert(val.is_interned() && "Strings must be internalized first");
+  strs.emplace_back(str_val(val, *this));
   return &strs.back();
 }
 
@@ -16,15 +16,17 @@ function *module::get_function_by_name(std::string name) {
   return nullptr;
 }
 
-str_val *module::get_str_val(std::string val) {
+str_val *module::get_str_val(std::string_view val) {
   auto handle = ctx.internalize_string(val);
-  str_val tester(handle, ctx);
-  if (strs.count(&tester)) {
-    return *strs.find(&tester);
+  if (handle.id() >= strs_by_id.size()) {
+    strs_by_id.resize(handle.id() + 1, nullptr);
+  }
+  auto *&str = strs_by_id[handle.id()];
+  if (!str) {
+    str = ctx.make_str_val(handle);
+    str->parent = this;
+    strs.emplace(str);
   }
-  auto *str = ctx.make_str_val(std::move(val));
-  str->parent = this;
-  strs.emplace(str);
   return str;
 }
 
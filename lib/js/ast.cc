@@ -2,16 +2,56 @@
 #include "jnsn/js/ast_ops.h"
 #include <cassert>
 #include <iostream>
+#include <new>
 
 using namespace jnsn;
 /// ast_node_store impl
 #define NODE(NAME, CHILD_NODES)                                                \
   NAME##_node *ast_node_store::make_##NAME(source_location loc) {              \
-    return &std::get<NAME##_node>(nodes.emplace_back(NAME##_node{loc}));       \
+    auto *node = new (allocate<NAME##_node>()) NAME##_node(loc);               \
+    assert(static_cast<void *>(static_cast<ast_node *>(node)) == node &&       \
+           "clear() destroys slots through ast_node pointers");                \
+    return node;                                                               \
   }
 #define DERIVED(NAME, ANCESTORS, CHILD_NODES) NODE(NAME, CHILD_NODES)
 #include "jnsn/js/ast.def"
 
+void ast_node_store::next_chunk(size_t bucket_index) {
+  auto &b = buckets[bucket_index];
+  auto slot = slot_size(bucket_index);
+  if (b.in_use == b.chunks.size()) {
+    b.chunks.emplace_back(new char[chunk_size]);
+  }
+  b.ptr = b.chunks[b.in_use++].get();
+  b.end = b.ptr + chunk_size / slot * slot;
+}
+
+void ast_node_store::clear() {
+  for (size_t i = 1; i < buckets.size(); ++i) {
+    auto &b = buckets[i];
+    auto slot = slot_size(i);
+    for (size_t c = 0; c < b.in_use; ++c) {
+      auto *begin = b.chunks[c].get();
+      auto *end = c + 1 == b.in_use ? b.ptr : begin + chunk_size / slot * slot;
+      for (auto *mem = begin; mem != end; mem += slot) {
+        reinterpret_cast<ast_node *>(mem)->~ast_node();
+      }
+    }
+    b.in_use = 0;
+    b.ptr = b.end = nullptr;
+  }
+  used = 0;
+  lists.clear();
+}
+
+size_t ast_node_store::bytes_reserved() const {
+  size_t total = 0;
+  for (auto &b : buckets) {
+    total += b.chunks.size() * chunk_size;
+  }
+  return total + lists.bytes_reserved();
+}
+
 namespace jnsn {
 std::ostream &operator<<(std::ostream &stream, const ast_node *ref) {
   stream << ast_to_json(ref) << "\n";
@@ -0,0 +1,475 @@
+#include "jnsn/js/ast_file.h"
+#include "jnsn/js/ast_ops.h"
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+using namespace jnsn;
+
+static constexpr char ast_file_magic[4] = {'J', 'A', 'S', 'T'};
+static_assert(sizeof(ast_file_header) == 7 * sizeof(uint32_t),
+              "The header has no padding");
+
+/// ast.def as text, so every change to it changes the schema hash
+static constexpr char ast_def_text[] = ""
+#define NODE(NAME, CHILD_NODES) #NAME " " #CHILD_NODES "\n"
+#define DERIVED(NAME, ANCESTOR, CHILD_NODES)                                   \
+  #NAME " " #ANCESTOR " " #CHILD_NODES "\n"
+#include "jnsn/js/ast.def"
+    ;
+/// FNV-1a of ast_def_text
+static constexpr uint32_t ast_schema = [] {
+  uint32_t hash = 2166136261u;
+  for (auto c : ast_def_text) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+  }
+  return hash;
+}();
+
+static uint64_t zigzag(int64_t v) {
+  return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+static int64_t unzigzag(uint64_t v) {
+  return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+/// Locations are stored as 1 + their offset from the start of the buffer,
+/// or 0 for invalid ones
+static uint64_t location_value(source_location loc, source_location start) {
+  if (!loc.is_valid()) {
+    return 0;
+  }
+  assert(loc.get_raw() >= start.get_raw() && "Node from another buffer");
+  return uint64_t{loc.get_raw() - start.get_raw()} + 1;
+}
+
+namespace {
+/// Writes the records of all nodes in breadth-first order, so the children
+/// of a node get their record numbers as soon as it is written
+class ast_writer {
+  std::string out;
+  std::vector<const ast_node *> order;
+  std::unordered_map<std::string_view, uint32_t> string_ids;
+  std::vector<std::string_view> strings;
+  source_location start;
+  size_t current = 0;
+  uint64_t prev_loc = 0;
+
+  void put_varint(uint64_t v) {
+    for (; v >= 0x80; v >>= 7) {
+      out += static_cast<char>(v | 0x80);
+    }
+    out += static_cast<char>(v);
+  }
+  /// Children are referenced by the distance of their record, 0 means none
+  void put_child(const ast_node *child) {
+    assert(child && "Only MAYBE children can be missing");
+    put_varint(order.size() - current);
+    order.emplace_back(child);
+  }
+  template <class nodety> void put_child(std::optional<nodety *> child) {
+    if (child && *child) {
+      put_child(*child);
+    } else {
+      put_varint(0);
+    }
+  }
+  template <class nodety> void put_children(node_list<nodety *> children) {
+    put_varint(children.size());
+    for (auto *child : children) {
+      put_child(child);
+    }
+  }
+  uint32_t string_id(std::string_view str) {
+    auto [it, inserted] = string_ids.try_emplace(str, strings.size());
+    if (inserted) {
+      strings.emplace_back(str);
+    }
+    return it->second;
+  }
+  void put_str(string_table::entry str) { put_varint(string_id(str)); }
+  void put_str(const std::optional<string_table::entry> &str) {
+    put_varint(str ? 1 + string_id(*str) : 0);
+  }
+  void put_strs(node_list<string_table::entry> strs) {
+    put_varint(strs.size());
+    for (auto str : strs) {
+      put_str(str);
+    }
+  }
+  void put_number(double value) {
+    char bytes[sizeof(value)];
+    std::memcpy(bytes, &value, sizeof(value));
+    out.append(bytes, sizeof(bytes));
+  }
+  void put_loc(source_location loc) {
+    auto value = location_value(loc, start);
+    put_varint(zigzag(static_cast<int64_t>(value - prev_loc)));
+    prev_loc = value;
+  }
+
+#define CHILDREN(...) __VA_ARGS__
+#define ONE(OF, NAME) put_child(node.NAME);
+#define MANY(OF, NAME) put_children(node.NAME);
+#define MAYBE(OF, NAME) put_child(node.NAME);
+#define STRING(NAME) put_str(node.NAME);
+#define STRINGS(NAME) put_strs(node.NAME);
+#define MAYBE_STR(NAME) put_str(node.NAME);
+#define NUMBER(NAME) put_number(node.NAME);
+#define COOKED(NAME) put_str(node.NAME);
+#define COOKED_STRS(NAME) put_strs(node.NAME);
+#define NODE(NAME, CHILD_NODES)                                                \
+  void put_fields(const NAME##_node &node) { CHILD_NODES }
+#define EXTENDS(BASE) BASE##_node
+#define DERIVED(NAME, ANCESTOR, CHILD_NODES)                                   \
+  void put_fields(const NAME##_node &node) {                                   \
+    put_fields(static_cast<const ANCESTOR &>(node));                           \
+    CHILD_NODES                                                                \
+  }
+#include "jnsn/js/ast.def"
+
+  void put_record(const ast_node &node) {
+    out += static_cast<char>(node.kind);
+    put_loc(node.loc);
+    switch (node.kind) {
+#define NODE(NAME, CHILD_NODES)                                                \
+  case node_kind::NAME##_node:                                                 \
+    put_fields(static_cast<const NAME##_node &>(node));                        \
+    break;
+#define DERIVED(NAME, ANCESTOR, CHILD_NODES) NODE(NAME, CHILD_NODES)
+#include "jnsn/js/ast.def"
+    }
+  }
+
+public:
+  ast_writer(source_location start) : start(start) {}
+
+  std::string write(const module_node &root) {
+    order.emplace_back(&root);
+    for (current = 0; current < order.size(); ++current) {
+      put_record(*order[current]);
+    }
+    size_t string_bytes = 0;
+    for (auto str : strings) {
+      string_bytes += str.size();
+    }
+    assert(order.size() <= UINT32_MAX && string_bytes <= UINT32_MAX &&
+           out.size() <= UINT32_MAX && "Sections are too large");
+    ast_file_header header;
+    std::memcpy(header.magic, ast_file_magic, sizeof(header.magic));
+    header.version = ast_file_version;
+    header.schema = ast_schema;
+    header.node_count = order.size();
+    header.string_count = strings.size();
+    header.string_bytes = string_bytes;
+    header.node_bytes = out.size();
+
+    std::string file;
+    file.reserve(sizeof(header) + (strings.size() + 1) * sizeof(uint32_t) +
+                 string_bytes + out.size());
+    file.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    uint32_t offset = 0;
+    auto put_offset = [&] {
+      file.append(reinterpret_cast<const char *>(&offset), sizeof(offset));
+    };
+    for (auto str : strings) {
+      put_offset();
+      offset += str.size();
+    }
+    put_offset();
+    for (auto str : strings) {
+      file += str;
+    }
+    file += out;
+    return file;
+  }
+};
+
+/// Makes all nodes from their records first and only then replaces child
+/// record numbers, which are kept in the child pointers until all nodes
+/// exist, by pointers to the nodes
+class ast_reader {
+  ast_node_store &store;
+  source_location start;
+  const char *pos = nullptr;
+  const char *end = nullptr;
+  /// First error, reading stops there
+  const char *error = nullptr;
+  const char *string_offsets = nullptr;
+  const char *string_bytes = nullptr;
+  uint32_t string_count = 0;
+  uint32_t string_size = 0;
+  std::vector<ast_node *> nodes;
+  size_t current = 0;
+  uint64_t prev_loc = 0;
+
+  void fail(const char *msg) {
+    if (!error) {
+      error = msg;
+    }
+    pos = end;
+  }
+  uint64_t get_varint() {
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+      if (pos == end) {
+        fail("Truncated node record");
+        return 0;
+      }
+      auto byte = static_cast<uint8_t>(*pos++);
+      value |= uint64_t{byte & 0x7fu} << shift;
+      if (!(byte & 0x80)) {
+        return value;
+      }
+    }
+    fail("Malformed integer");
+    return 0;
+  }
+  /// Returns the record number of a child reference, or 0 for none
+  uintptr_t get_ref() {
+    auto distance = get_varint();
+    if (distance >= nodes.size() - current) {
+      fail("Child record out of range");
+      return 0;
+    }
+    return distance ? current + distance : 0;
+  }
+  /// Reads a child reference into \p child. The reference is kept as the
+  /// child's record number until fix_up().
+  template <class nodety> void get_child(nodety *&child) {
+    auto ref = get_ref();
+    if (!ref) {
+      fail("Missing child");
+    }
+    child = reinterpret_cast<nodety *>(ref);
+  }
+  template <class nodety> void get_child(std::optional<nodety *> &child) {
+    if (auto ref = get_ref()) {
+      child = reinterpret_cast<nodety *>(ref);
+    }
+  }
+  template <class nodety> void get_children(node_list<nodety *> &children) {
+    auto count = get_varint();
+    // Every reference takes a byte at least
+    if (count > static_cast<size_t>(end - pos)) {
+      fail("Truncated node record");
+      return;
+    }
+    children = store.make_list<nodety *>(count);
+    for (auto &child : children) {
+      get_child(child);
+    }
+  }
+  string_table::entry string_at(uint64_t id) {
+    if (id >= string_count) {
+      fail("String out of range");
+      return {};
+    }
+    uint32_t range[2];
+    std::memcpy(range, string_offsets + id * sizeof(uint32_t), sizeof(range));
+    if (range[0] > range[1] || range[1] > string_size) {
+      fail("Malformed string section");
+      return {};
+    }
+    return string_table::get_borrowed_handle(
+        {string_bytes + range[0], range[1] - range[0]});
+  }
+  void get_str(string_table::entry &str) { str = string_at(get_varint()); }
+  void get_str(std::optional<string_table::entry> &str) {
+    if (auto id = get_varint()) {
+      str = string_at(id - 1);
+    }
+  }
+  void get_strs(node_list<string_table::entry> &strs) {
+    auto count = get_varint();
+    if (count > static_cast<size_t>(end - pos)) {
+      fail("Truncated node record");
+      return;
+    }
+    strs = store.make_list<string_table::entry>(count);
+    for (auto &str : strs) {
+      get_str(str);
+    }
+  }
+  void get_number(double &value) {
+    if (static_cast<size_t>(end - pos) < sizeof(value)) {
+      fail("Truncated node record");
+      return;
+    }
+    std::memcpy(&value, pos, sizeof(value));
+    pos += sizeof(value);
+  }
+  source_location get_loc() {
+    auto value = prev_loc + unzigzag(get_varint());
+    prev_loc = value;
+    if (!value) {
+      return {};
+    }
+    if (value - 1 > UINT32_MAX - start.get_raw()) {
+      fail("Location out of range");
+      return {};
+    }
+    return source_location(start.get_raw() + value - 1);
+  }
+
+  /// Replaces the record number in \p child by the node
+  template <class nodety> void fix(nodety *&child) {
+    if (!child) {
+      return;
+    }
+    auto *node = nodes[reinterpret_cast<uintptr_t>(child)];
+    if (!isa<nodety>(node)) {
+      fail("Child of the wrong type");
+      child = nullptr;
+      return;
+    }
+    child = static_cast<nodety *>(node);
+  }
+
+#define CHILDREN(...) __VA_ARGS__
+#define ONE(OF, NAME) get_child(node.NAME);
+#define MANY(OF, NAME) get_children(node.NAME);
+#define MAYBE(OF, NAME) get_child(node.NAME);
+#define STRING(NAME) get_str(node.NAME);
+#define STRINGS(NAME) get_strs(node.NAME);
+#define MAYBE_STR(NAME) get_str(node.NAME);
+#define NUMBER(NAME) get_number(node.NAME);
+#define COOKED(NAME) get_str(node.NAME);
+#define COOKED_STRS(NAME) get_strs(node.NAME);
+#define NODE(NAME, CHILD_NODES)                                                \
+  void get_fields(NAME##_node &node) { CHILD_NODES }
+#define EXTENDS(BASE) BASE##_node
+#define DERIVED(NAME, ANCESTOR, CHILD_NODES)                                   \
+  void get_fields(NAME##_node &node) {                                         \
+    get_fields(static_cast<ANCESTOR &>(node));                                 \
+    CHILD_NODES                                                                \
+  }
+#include "jnsn/js/ast.def"
+
+#define CHILDREN(...) __VA_ARGS__
+#define ONE(OF, NAME) fix(node.NAME);
+#define MANY(OF, NAME)                                                         \
+  for (auto &child : node.NAME)                                                \
+    fix(child);
+#define MAYBE(OF, NAME)                                                        \
+  if (node.NAME)                                                               \
+    fix(*node.NAME);
+#define NODE(NAME, CHILD_NODES)                                                \
+  void fix_up(NAME##_node &node) { CHILD_NODES }
+#define EXTENDS(BASE) BASE##_node
+#define DERIVED(NAME, ANCESTOR, CHILD_NODES)                                   \
+  void fix_up(NAME##_node &node) {                                             \
+    fix_up(static_cast<ANCESTOR &>(node));                                     \
+    CHILD_NODES                                                                \
+  }
+#include "jnsn/js/ast.def"
+
+  void get_record() {
+    auto kind = static_cast<node_kind>(*pos++);
+    auto loc = get_loc();
+    switch (kind) {
+#define NODE(NAME, CHILD_NODES)                                                \
+  case node_kind::NAME##_node: {                                               \
+    auto *node = store.make_##NAME(loc);                                       \
+    nodes[current] = node;                                                     \
+    get_fields(*node);                                                         \
+    return;                                                                    \
+  }
+#define DERIVED(NAME, ANCESTOR, CHILD_NODES) NODE(NAME, CHILD_NODES)
+#include "jnsn/js/ast.def"
+    }
+    fail("Unknown node kind");
+  }
+  void fix_up(ast_node &node) {
+    switch (node.kind) {
+#define NODE(NAME, CHILD_NODES)                                                \
+  case node_kind::NAME##_node:                                                 \
+    fix_up(static_cast<NAME##_node &>(node));                                  \
+    break;
+#define DERIVED(NAME, ANCESTOR, CHILD_NODES) NODE(NAME, CHILD_NODES)
+#include "jnsn/js/ast.def"
+    }
+  }
+
+public:
+  ast_reader(ast_node_store &store, source_location start)
+      : store(store), start(start) {}
+
+  std::variant<module_node *, std::string> read(std::string_view data) {
+    ast_file_header header;
+    if (data.size() < sizeof(header)) {
+      return "Not an AST file";
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, ast_file_magic, sizeof(header.magic))) {
+      return "Not an AST file";
+    }
+    if (header.version != ast_file_version) {
+      return "Unsupported AST file version " + std::to_string(header.version);
+    }
+    if (header.schema != ast_schema) {
+      return "AST file was written for other node types";
+    }
+    uint64_t size = sizeof(header) +
+                    (uint64_t{header.string_count} + 1) * sizeof(uint32_t) +
+                    header.string_bytes + header.node_bytes;
+    if (size != data.size()) {
+      return "Section sizes do not match the file size";
+    }
+    if (header.node_count == 0 || header.node_count > header.node_bytes) {
+      return "Malformed node section";
+    }
+    string_offsets = data.data() + sizeof(header);
+    string_count = header.string_count;
+    string_size = header.string_bytes;
+    string_bytes =
+        string_offsets + (size_t{string_count} + 1) * sizeof(uint32_t);
+    pos = string_bytes + string_size;
+    end = pos + header.node_bytes;
+
+    nodes.assign(header.node_count, nullptr);
+    for (current = 0; current < nodes.size() && pos != end; ++current) {
+      get_record();
+    }
+    if (!error && (current != nodes.size() || pos != end)) {
+      fail("Node count does not match the node section");
+    }
+    for (size_t i = 0; i < nodes.size() && !error; ++i) {
+      fix_up(*nodes[i]);
+    }
+    if (error) {
+      return error;
+    }
+    if (!isa<module_node>(nodes[0])) {
+      return "The root is not a module";
+    }
+    return static_cast<module_node *>(nodes[0]);
+  }
+};
+} // namespace
+
+namespace jnsn {
+std::string write_ast(const module_node &root, source_location start) {
+  return ast_writer(start).write(root);
+}
+
+std::variant<module_node *, std::string>
+read_ast(std::string_view data, ast_node_store &store, source_location start) {
+  return ast_reader(store, start).read(data);
+}
+
+std::optional<std::string> mapped_ast_file::open(const char *path,
+                                                 source_location start) {
+  root = nullptr;
+  nodes.clear();
+  if (auto error = file.map(path)) {
+    return error;
+  }
+  auto res = read_ast(file.text(), nodes, start);
+  if (auto *error = std::get_if<std::string>(&res)) {
+    nodes.clear();
+    return std::string(path) + ": " + *error;
+  }
+  root = std::get<module_node *>(res);
+  return std::nullopt;
+}
+} // namespace jnsn
@@ -171,41 +171,20 @@ std::ostream &operator<<(std::ostream &stream, const ast_to_json &wrapper) {
 }
 } // namespace jnsn
 
-/// isa<> impl
-template <class nodety>
-struct isa_checker : public const_ast_node_visitor<bool> {
-#define NODE(NAME, CHILDREN)                                                   \
-  bool accept(const NAME##_node &) override {                                  \
-    return std::is_same_v<NAME##_node, nodety>;                                \
-  }
-#define EXTENDS(BASE) BASE##_node
-#define DERIVED(NAME, BASE, CHILDREN)                                          \
-  bool accept(const NAME##_node &node) {                                       \
-    return std::is_same_v<NAME##_node, nodety> ||                              \
-           accept(static_cast<const BASE &>(node));                            \
-  }
-#include "jnsn/js/ast.def"
-};
-
 namespace jnsn {
-#define NODE(NAME, CHILDREN)                                                   \
-  template <> bool isa<NAME##_node>(const ast_node *node) {                    \
-    assert(node);                                                              \
-    return isa_checker<NAME##_node>().visit(*node);                            \
-  }
-#define DERIVED(NAME, EXTENDS, CHILDREN) NODE(NAME, CHILDREN)
-#include "jnsn/js/ast.def"
-
 #define NODE(NAME, CHILD_NODES) static const char *NAME##_name = #NAME;
 #define DERIVED(NAME, ANCESTOR, CHILD_NODES) NODE(NAME, CHILD_NODES)
 #include "jnsn/js/ast.def"
-const char *get_ast_node_typename(const ast_node &node) {
-  struct ast_node_name_generator : public const_ast_node_visitor<const char *>{
+/// Type names by node_kind
+static const auto ast_node_typenames = [] {
+  std::array<const char *, ast_node_type_count> names{};
 #define NODE(NAME, CHILD_NODES)                                                \
-  const char *accept(const NAME##_node &node) override { return NAME##_name; }
+  names[static_cast<size_t>(node_kind::NAME##_node)] = NAME##_name;
 #define DERIVED(NAME, ANCESTOR, CHILD_NODES) NODE(NAME, CHILD_NODES)
 #include "jnsn/js/ast.def"
-                                   } name_gen;
-  return name_gen.visit(node);
+  return names;
+}();
+const char *get_ast_node_typename(const ast_node &node) {
+  return ast_node_typenames[static_cast<size_t>(node.kind)];
 }
 } // namespace jnsn
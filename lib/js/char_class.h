@@ -0,0 +1,81 @@
+#ifndef JNSN_JS_CHAR_CLASS_H
+#define JNSN_JS_CHAR_CLASS_H
+#include <cstdint>
+
+namespace jnsn {
+
+/// Classes of source units as the lexer sees them. Unlike <cctype>, these
+/// never depend on the current locale. Units outside of ASCII have no class.
+namespace char_class {
+enum : uint8_t {
+  space = 1 << 0,
+  line_terminator = 1 << 1,
+  junk = 1 << 2, ///< control characters that are not whitespace
+  digit = 1 << 3,
+  hex_digit = 1 << 4,
+  ident_start = 1 << 5,
+  ident_part = 1 << 6,
+  punct = 1 << 7,
+};
+} // namespace char_class
+
+struct char_class_table {
+  uint8_t classes[256] = {};
+  constexpr char_class_table() {
+    using namespace char_class;
+    for (unsigned u = 0; u < 0x20; ++u) {
+      classes[u] = junk;
+    }
+    classes[0x7f] = junk;
+    for (unsigned u = '\t'; u <= '\r'; ++u) {
+      classes[u] = space;
+    }
+    classes[' '] = space;
+    classes['\n'] |= line_terminator; // FIXME the spec has two more...
+    classes['\r'] |= line_terminator;
+    for (unsigned u = '!'; u <= '~'; ++u) {
+      classes[u] = punct;
+    }
+    for (unsigned u = '0'; u <= '9'; ++u) {
+      classes[u] = digit | hex_digit | ident_part;
+    }
+    for (unsigned u = 'a'; u <= 'z'; ++u) {
+      classes[u] = ident_start | ident_part;
+      classes[u - 'a' + 'A'] = ident_start | ident_part;
+    }
+    for (unsigned u = 'a'; u <= 'f'; ++u) {
+      classes[u] |= hex_digit;
+      classes[u - 'a' + 'A'] |= hex_digit;
+    }
+    classes['_'] = ident_start | ident_part;
+    classes['$'] = ident_start | ident_part;
+    // TODO backslash may be used to start unicode id sequence
+    classes['\\'] |= ident_part;
+  }
+  constexpr uint8_t operator[](char u) const {
+    return classes[static_cast<unsigned char>(u)];
+  }
+};
+inline constexpr char_class_table char_classes;
+
+constexpr bool is_space(char u) { return char_classes[u] & char_class::space; }
+constexpr bool is_line_terminator(char u) {
+  return char_classes[u] & char_class::line_terminator;
+}
+constexpr bool is_digit(char u) { return char_classes[u] & char_class::digit; }
+constexpr bool is_hex_digit(char u) {
+  return char_classes[u] & char_class::hex_digit;
+}
+/// Returns the value of a (hex) digit
+constexpr unsigned digit_value(char u) {
+  return is_digit(u) ? u - '0' : (u | 0x20) - 'a' + 10;
+}
+constexpr bool is_ident_start(char u) {
+  return char_classes[u] & char_class::ident_start;
+}
+constexpr bool is_ident_part(char u) {
+  return char_classes[u] & char_class::ident_part;
+}
+
+} // namespace jnsn
+#endif // JNSN_JS_CHAR_CLASS_H
@@ -1,7 +1,6 @@
 #include "ir_construction_internal.h"
 #include "jnsn/js/ast_ops.h" // isa<> on ast nodes
 #include "jnsn/util.h"       // unreachable
-#include <cstdlib>           // number parsing
 
 namespace jnsn {
 ast_to_ir::result build_ir_from_ast(const module_node &ast, ir_context &ctx) {
@@ -93,7 +92,7 @@ ast_to_ir::build_function_params(const ast_node &func, basic_block &BB) {
   for (const auto &name : params->names) {
     auto *def = builder.insert_inst<define_inst>(BB);
     builder.set_inst_arg(*def, define_inst::arguments::name,
-                         *builder.get_str_val(name.str()));
+                         *builder.get_str_val(name));
     auto *val = builder.load_or_undefined(
         BB, *args, *builder.get_str_val(std::to_string(argnum++)));
     auto *store = builder.insert_inst<store_inst>(BB);
@@ -115,7 +114,7 @@ ast_to_ir::build_function_body(const ast_node &body, basic_block &BB) {
   for (const auto *var : hoists.vars) {
     for (auto *part : var->parts) {
       auto *define = builder.insert_inst<define_inst>(BB);
-      auto *name = builder.get_str_val(part->name.str());
+      auto *name = builder.get_str_val(part->name);
       builder.set_inst_arg(*define, define_inst::arguments::name, *name);
     }
   }
@@ -125,7 +124,7 @@ ast_to_ir::build_function_body(const ast_node &body, basic_block &BB) {
     auto *bind = builder.insert_inst<bind_scope_inst>(BB);
     builder.set_inst_arg(*bind, bind_scope_inst::arguments::func, *F);
     auto *def = builder.insert_inst<define_inst>(BB);
-    auto *name = builder.get_str_val(fun->name.str());
+    auto *name = builder.get_str_val(fun->name);
     builder.set_inst_arg(*def, define_inst::arguments::name, *name);
     auto *store = builder.insert_inst<store_inst>(BB);
     builder.set_inst_arg(*store, store_inst::arguments::address, *def);
@@ -228,7 +227,7 @@ inst_creator::result inst_creator::accept(const arrow_function_node &node) {
 inst_creator::result inst_creator::accept(const identifier_expr_node &node) {
   auto *lookup = builder.insert_inst<lookup_inst>(*IP);
   builder.set_inst_arg(*lookup, lookup_inst::arguments::name,
-                       *builder.get_str_val(node.str.str()));
+                       *builder.get_str_val(node.str));
   return lookup;
 }
 
@@ -242,37 +241,28 @@ inst_creator::result inst_creator::accept(const false_literal_node &node) {
   return builder.ctx.get_false();
 }
 inst_creator::result inst_creator::accept(const int_literal_node &node) {
-  return builder.ctx.get_c_num_val(
-      static_cast<double>(std::strtol(node.val.data(), nullptr, 10)));
+  return builder.ctx.get_c_num_val(node.value);
 }
 inst_creator::result inst_creator::accept(const float_literal_node &node) {
-  size_t processed = 0;
-  auto *val = builder.ctx.get_c_num_val(std::stod(node.val.str(), &processed));
-  assert(processed == node.val.size());
-  return val;
+  return builder.ctx.get_c_num_val(node.value);
 }
 inst_creator::result inst_creator::accept(const hex_literal_node &node) {
-  return builder.ctx.get_c_num_val(
-      static_cast<double>(std::strtol(node.val.data() + 2, nullptr, 16)));
+  return builder.ctx.get_c_num_val(node.value);
 }
 inst_creator::result inst_creator::accept(const oct_literal_node &node) {
-  return builder.ctx.get_c_num_val(
-      static_cast<double>(std::strtol(node.val.data() + 2, nullptr, 8)));
+  return builder.ctx.get_c_num_val(node.value);
 }
 inst_creator::result inst_creator::accept(const bin_literal_node &node) {
-  return builder.ctx.get_c_num_val(
-      static_cast<double>(std::strtol(node.val.data() + 2, nullptr, 2)));
+  return builder.ctx.get_c_num_val(node.value);
 }
 inst_creator::result inst_creator::accept(const string_literal_node &node) {
-  return builder.get_str_val(
-      std::string{node.val.data() + 1, node.val.size() - 2});
+  return builder.get_str_val(node.value);
 }
 inst_creator::result inst_creator::accept(const regex_literal_node &node) {
   return not_implemented_error(node);
 }
 inst_creator::result inst_creator::accept(const template_string_node &node) {
-  return builder.get_str_val(
-      std::string{node.val.data() + 1, node.val.size() - 2});
+  return builder.get_str_val(node.value);
 }
 inst_creator::result inst_creator::accept(const template_literal_node &node) {
   return not_implemented_error(node);
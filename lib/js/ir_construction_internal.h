@@ -25,7 +25,7 @@ struct ast_ir_mappings {
 struct ast_to_ir {
   using result = ast_to_ir_result;
   std::unique_ptr<module> mod;
-  ir_context ctx;
+  ir_context &ctx;
   ir_builder builder;
   ast_ir_mappings mappings;
   ast_to_ir(ir_context &ctx) : mod(new module(ctx)), ctx(ctx), builder(*mod) {}
@@ -40,16 +40,16 @@ struct hoist_collector : public ast_walker<hoist_collector> {
   std::vector<const var_decl_node *> vars;
   std::vector<const function_stmt_node *> funcs;
 
-  bool on_enter(const class_expr_node &node) override { return false; }
-  bool on_enter(const class_stmt_node &node) override { return false; }
-  bool on_enter(const function_expr_node &node) override { return false; }
-  bool on_enter(const function_stmt_node &node) override {
+  bool on_enter(const class_expr_node &node) { return false; }
+  bool on_enter(const class_stmt_node &node) { return false; }
+  bool on_enter(const function_expr_node &node) { return false; }
+  bool on_enter(const function_stmt_node &node) {
     funcs.emplace_back(&node);
     return false;
   }
-  bool on_enter(const arrow_function_node &node) override { return false; }
-  bool on_enter(const class_func_node &node) override { return false; }
-  bool on_enter(const var_decl_node &node) override {
+  bool on_enter(const arrow_function_node &node) { return false; }
+  bool on_enter(const class_func_node &node) { return false; }
+  bool on_enter(const var_decl_node &node) {
     if (node.keyword == "var") {
       vars.emplace_back(&node);
     }
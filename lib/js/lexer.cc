@@ -1,7 +1,15 @@
 #include "jnsn/js/lexer.h"
+#include "char_class.h"
+#include "jnsn/js/scan.h"
 #include "jnsn/util.h"
 #include <algorithm>
-#include <cctype>
+#include <cerrno>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <thread>
 
 namespace jnsn {
 
@@ -17,13 +25,20 @@ std::ostream &operator<<(std::ostream &stream, const token_type ty) {
 }
 std::ostream &operator<<(std::ostream &stream, const token &tok) {
   stream << tok.type;
-  if (!tok.text.empty()) {
-    stream << " (\"" << tok.text << "\" at " << tok.loc << ")";
+  if (tok.has_text) {
+    stream << " (at offset " << tok.offset << ", length " << tok.length
+           << ")";
   }
   return stream;
 }
+std::string lexer_error::message() const {
+  if (sys_errno == 0) {
+    return msg;
+  }
+  return std::string{msg} + ": " + std::strerror(sys_errno);
+}
 std::ostream &operator<<(std::ostream &stream, const lexer_error &e) {
-  stream << "ERROR: " << e.msg << " (at " << e.loc << ")";
+  stream << "ERROR: " << e.message();
   return stream;
 }
 template <class... Ts> struct overloaded : Ts... { using Ts::operator()...; };
@@ -37,435 +52,1338 @@ std::ostream &operator<<(std::ostream &stream, const lexer_base::result &res) {
 }
 
 /// keywords impl
-static bool is_keyword(string_table::entry word) {
-#define KEYWORD(NAME)                                                          \
-  if (word == #NAME)                                                           \
-    return true;
+/// Keywords are recognized with a perfect hash over keywords.def. The hash
+/// only looks at a word's length and three of its units, and its seed is
+/// searched at compile time so that no two keywords share a slot. Every
+/// lookup therefore costs one hash and at most one string comparison.
+namespace {
+struct keyword_entry {
+  std::string_view text;
+  keyword_type type;
+};
+constexpr keyword_entry keywords[] = {
+#define KEYWORD(NAME) {#NAME, keyword_type::kw_##NAME},
 #include "jnsn/js/keywords.def"
-  return false;
+};
+constexpr size_t num_keywords = sizeof(keywords) / sizeof(*keywords);
+constexpr size_t num_keyword_slots = 256;
+constexpr uint8_t empty_keyword_slot = 0xff;
+static_assert(num_keywords < empty_keyword_slot, "Too many keywords");
+
+constexpr size_t min_keyword_length() {
+  size_t len = keywords[0].text.size();
+  for (auto &kw : keywords) {
+    len = std::min(len, kw.text.size());
+  }
+  return len;
 }
+constexpr size_t max_keyword_length() {
+  size_t len = 0;
+  for (auto &kw : keywords) {
+    len = std::max(len, kw.text.size());
+  }
+  return len;
+}
+static_assert(min_keyword_length() >= 2, "Hash reads two leading units");
 
-static constexpr bool one_of(unit u, const unit *alternatives) {
-  if (*alternatives == '\0') {
-    return false;
-  } else if (*alternatives == u) {
+/// Only valid for words of at least min_keyword_length()
+constexpr uint32_t keyword_hash(std::string_view word, uint32_t seed) {
+  uint32_t h = seed;
+  h = (h ^ word.size()) * 0x01000193;
+  h = (h ^ static_cast<uint8_t>(word[0])) * 0x01000193;
+  h = (h ^ static_cast<uint8_t>(word[1])) * 0x01000193;
+  h = (h ^ static_cast<uint8_t>(word[word.size() - 1])) * 0x01000193;
+  h ^= h >> 15;
+  return h % num_keyword_slots;
+}
+
+constexpr bool keyword_seed_is_perfect(uint32_t seed) {
+  bool used[num_keyword_slots] = {};
+  for (auto &kw : keywords) {
+    auto slot = keyword_hash(kw.text, seed);
+    if (used[slot]) {
+      return false;
+    }
+    used[slot] = true;
+  }
+  return true;
+}
+constexpr uint32_t find_keyword_seed() {
+  for (uint32_t seed = 0; seed < 10000; ++seed) {
+    if (keyword_seed_is_perfect(seed)) {
+      return seed;
+    }
+  }
+  return ~0u;
+}
+constexpr uint32_t keyword_seed = find_keyword_seed();
+static_assert(keyword_seed != ~0u, "No perfect keyword hash found");
+
+struct keyword_slots {
+  uint8_t index[num_keyword_slots] = {};
+  constexpr keyword_slots() {
+    for (auto &i : index) {
+      i = empty_keyword_slot;
+    }
+    for (size_t i = 0; i < num_keywords; ++i) {
+      index[keyword_hash(keywords[i].text, keyword_seed)] = i;
+    }
+  }
+};
+constexpr keyword_slots keyword_table;
+} // namespace
+
+keyword_type lexer_base::lookup_keyword(std::string_view word) {
+  if (word.size() < min_keyword_length() ||
+      word.size() > max_keyword_length()) {
+    return keyword_type::none;
+  }
+  auto i = keyword_table.index[keyword_hash(word, keyword_seed)];
+  if (i == empty_keyword_slot || keywords[i].text != word) {
+    return keyword_type::none;
+  }
+  return keywords[i].type;
+}
+
+/// Punctuators from tokens.def that consist of a single unit which no
+/// other punctuator starts with. These can be lexed by table lookup alone.
+namespace {
+struct single_punct_table {
+  /// Number of punctuators that start with a given unit
+  unsigned starts[256] = {};
+  token_type types[256] = {};
+  bool is_single[256] = {};
+  constexpr single_punct_table() {
+#define TOKEN_TYPE(NAME, STR)                                                  \
+  if (sizeof(STR) > 1) {                                                       \
+    ++starts[static_cast<unsigned char>(STR[0])];                              \
+  }
+#include "jnsn/js/tokens.def"
+#define TOKEN_TYPE(NAME, STR)                                                  \
+  if (sizeof(STR) == 2 && starts[static_cast<unsigned char>(STR[0])] == 1) {   \
+    types[static_cast<unsigned char>(STR[0])] = token_type::NAME;              \
+    is_single[static_cast<unsigned char>(STR[0])] = true;                      \
+  }
+#include "jnsn/js/tokens.def"
+  }
+};
+constexpr single_punct_table single_puncts;
+} // namespace
+
+/// Every sub-lexer the first unit of a token can dispatch to
+#define DISPATCH_SUB_LEXERS(X)                                                 \
+  X(unknown)                                                                   \
+  X(single_punct)                                                              \
+  X(id_keyword)                                                                \
+  X(number)                                                                    \
+  X(dot)                                                                       \
+  X(eq)                                                                        \
+  X(plus)                                                                      \
+  X(minus)                                                                     \
+  X(asterisk)                                                                  \
+  X(slash)                                                                     \
+  X(percent)                                                                   \
+  X(exclamation)                                                               \
+  X(caret)                                                                     \
+  X(lt)                                                                        \
+  X(gt)                                                                        \
+  X(ampersand)                                                                 \
+  X(vert_bar)                                                                  \
+  X(closing_brace)                                                             \
+  X(str)                                                                       \
+  X(backtick)
+
+/// Units are first mapped to the index of their sub-lexer, which is what
+/// covers_punctuators() checks. Member function pointers cannot be compared
+/// in constant expressions by all compilers, e.g. not by GCC with UBSan.
+struct lexer_base::dispatch_table {
+  using sub_lexer = result (lexer_base::*)();
+  enum sub_lexer_id : uint8_t {
+#define X(NAME) NAME,
+    DISPATCH_SUB_LEXERS(X)
+#undef X
+  };
+  sub_lexer_id ids[256] = {};
+  sub_lexer entries[256] = {};
+
+  constexpr dispatch_table() {
+    for (unsigned u = 0; u < 256; ++u) {
+      auto cls = char_classes.classes[u];
+      if (cls & char_class::ident_start) {
+        ids[u] = id_keyword;
+      } else if (cls & char_class::digit) {
+        ids[u] = number;
+      } else if (single_puncts.is_single[u]) {
+        ids[u] = single_punct;
+      } else {
+        ids[u] = unknown;
+      }
+    }
+    // Punctuators that need to look further than their first unit, plus
+    // literals starting with punctuation
+    ids['.'] = dot;
+    ids['='] = eq;
+    ids['+'] = plus;
+    ids['-'] = minus;
+    ids['*'] = asterisk;
+    ids['/'] = slash;
+    ids['%'] = percent;
+    ids['!'] = exclamation;
+    ids['^'] = caret;
+    ids['<'] = lt;
+    ids['>'] = gt;
+    ids['&'] = ampersand;
+    ids['|'] = vert_bar;
+    ids['}'] = closing_brace;
+    ids['\''] = str;
+    ids['"'] = str;
+    ids['`'] = backtick;
+    const sub_lexer sub_lexers[] = {
+#define X(NAME) &lexer_base::lex_##NAME,
+        DISPATCH_SUB_LEXERS(X)
+#undef X
+    };
+    for (unsigned u = 0; u < 256; ++u) {
+      entries[u] = sub_lexers[ids[u]];
+    }
+  }
+  /// Checks that every punctuator in tokens.def can be reached
+  constexpr bool covers_punctuators() const {
+    for (unsigned u = 0; u < 256; ++u) {
+      if (single_puncts.starts[u] == 0) {
+        continue;
+      }
+      if (ids[u] == unknown ||
+          (ids[u] == single_punct && !single_puncts.is_single[u])) {
+        return false;
+      }
+    }
     return true;
   }
-  return one_of(u, alternatives + 1);
+  constexpr sub_lexer operator[](unit u) const {
+    return entries[static_cast<unsigned char>(u)];
+  }
+};
+#undef DISPATCH_SUB_LEXERS
+
+void lexer_base::set_buffer(std::string_view buffer, bool stable,
+                            std::string name) {
+  str_table.clear();
+  numbers.clear();
+  strings.clear();
+  use_buffer(buffer, stable, std::move(name));
 }
-static constexpr bool islineterminator(unit u) {
-  return one_of(u, "\r\n"); // FIXME the spec has two more...
+
+void lexer_base::edit_buffer(std::string_view buffer) {
+  assert(!streaming && "Streams cannot be edited");
+  use_buffer(buffer, borrow_texts, sources.name(file));
 }
 
-bool lexer_base::eof() { return !window[0]; }
+void lexer_base::use_buffer(std::string_view buffer, bool stable,
+                            std::string name) {
+  assert(buffer.size() < UINT32_MAX && "Token offsets are 32 bits wide");
+  buf_begin = buffer.data();
+  buf_end = buffer.data() + buffer.size();
+  borrow_texts = stable;
+  buf_offset = 0;
+  streaming = false;
+  // The text of earlier buffers may be gone, so their locations cannot be
+  // decoded anymore
+  sources.clear();
+  file = sources.add_buffer(buffer, std::move(name));
+  loc_base = sources.location(file, 0).get_raw();
+  reset();
+}
 
-void lexer_base::advance() {
-  assert(!eof() && "Read after eof");
-  loc.advance(current()); // works because not eof
-  std::rotate(window.begin(), window.begin() + 1, window.end());
-  window.back() = read_unit();
+void lexer_base::start_stream() {
+  stream_buf.clear();
+  buf_begin = buf_end = nullptr;
+  borrow_texts = false;
+  buf_offset = 0;
+  streaming = false;
+  str_table.clear();
+  numbers.clear();
+  strings.clear();
+  sources.clear();
+  file = sources.add_stream();
+  loc_base = sources.location(file, 0).get_raw();
+  reset();
+  streaming = true;
+  stream_done = false;
 }
 
+void lexer_base::reset() {
+  assert(!streaming && "Streams cannot be reset");
+  cur = buf_begin;
+  template_depth = 0;
+  prev.reset();
+  brackets.clear();
+  brackets_below = 0;
+  bracket_base = nullptr;
+}
+
+/// Chunk size of streaming sources
+static constexpr size_t stream_chunk = 64 * 1024;
+/// Sub-lexers look at most this many units past the end of their token
+static constexpr ptrdiff_t max_lookahead = 16;
+
 const result lexer_base::next() {
-  if (!peek()) {
+  if (!streaming) {
+    return lex();
+  }
+  for (;;) {
+    cur = scan::skip_space(cur, buf_end);
+    auto *start = cur;
+    auto before = save();
+    auto res = lex();
+    if (stream_done || buf_end - cur > max_lookahead) {
+      return res;
+    }
+    // The token may go on in input that hasn't been read yet. Lex it again
+    // once there is more.
+    cur = start;
+    restore(before);
+    if (auto err = refill(start)) {
+      return *err;
+    }
+  }
+}
+
+std::optional<lexer_error> lexer_base::refill(const unit *keep) {
+  buf_offset += keep - buf_begin;
+  size_t kept = buf_end - keep;
+  sources.drop_stream_prefix(file, buf_offset);
+  // All tokens but the one being lexed have been consumed, and that one is
+  // lexed again
+  str_table.clear();
+  numbers.clear();
+  strings.clear();
+  if (kept) {
+    std::memmove(stream_buf.data(), keep, kept);
+  }
+  // A token that is still incomplete is lexed again from its start after
+  // this. Reading at least as much as is kept makes that linear in the
+  // token size, and keeps the buffer within twice the largest token.
+  auto wanted = std::max(kept, stream_chunk);
+  if (stream_buf.size() < kept + wanted) {
+    stream_buf.resize(kept + wanted);
+  }
+  size_t got = 0;
+  while (got < std::max<size_t>(kept, 1)) {
+    auto n = read_more(stream_buf.data() + kept + got,
+                       stream_buf.size() - kept - got);
+    if (n < 0) {
+      return lexer_error{"Could not read input", location_at(buf_offset),
+                         errno};
+    }
+    if (n == 0) {
+      stream_done = true;
+      break;
+    }
+    got += n;
+  }
+  if (buf_offset + kept + got > UINT32_MAX || !sources.has_room(got)) {
+    return lexer_error{"Input is too large", location_at(buf_offset)};
+  }
+  sources.extend_stream(file, {stream_buf.data(), kept + got});
+  buf_begin = stream_buf.data();
+  buf_end = buf_begin + kept + got;
+  cur = buf_begin;
+  return std::nullopt;
+}
+
+/// Whether a slash after \p prev is a division rather than the start of a
+/// regex
+static bool ends_operand(after_token after) {
+  return after == after_token::infix;
+}
+static bool ends_operand(const std::optional<token> &prev) {
+  return prev && ends_operand(prev->after);
+}
+
+/// Whether an expression rather than a statement starts after \p prev.
+/// Decides whether a function keyword or a brace after it starts a function
+/// expression or an object literal.
+static bool starts_expression(const std::optional<token> &prev) {
+  if (!prev || prev->after != after_token::operand) {
+    return false;
+  }
+  switch (prev->type) {
+  case token_type::SEMICOLON:
+  case token_type::BRACE_OPEN:
+  case token_type::BRACE_CLOSE:
+  case token_type::PAREN_CLOSE:
+    return false;
+  case token_type::KEYWORD:
+    switch (prev->kw) {
+    case keyword_type::kw_return:
+    case keyword_type::kw_throw:
+    case keyword_type::kw_case:
+    case keyword_type::kw_typeof:
+    case keyword_type::kw_instanceof:
+    case keyword_type::kw_in:
+    case keyword_type::kw_new:
+    case keyword_type::kw_delete:
+    case keyword_type::kw_void:
+    case keyword_type::kw_await:
+    case keyword_type::kw_yield:
+      return true;
+    default:
+      return false;
+    }
+  default:
+    return true;
+  }
+}
+
+lexer_base::bracket lexer_base::opened_after(const std::optional<token> &prev,
+                                             token_type opener) {
+  if (opener == token_type::PAREN_OPEN) {
+    if (prev && prev->type == token_type::KEYWORD &&
+        (prev->kw == keyword_type::kw_if ||
+         prev->kw == keyword_type::kw_while ||
+         prev->kw == keyword_type::kw_for ||
+         prev->kw == keyword_type::kw_with)) {
+      return bracket::head;
+    }
+    if (prev && prev->after == after_token::function_params) {
+      return bracket::function_params;
+    }
+    return bracket::parens;
+  }
+  assert(opener == token_type::BRACE_OPEN);
+  // The body of an arrow function is a block, if it starts with a brace
+  if ((prev && prev->after == after_token::function_body) ||
+      (starts_expression(prev) && prev->type != token_type::ARROW)) {
+    return bracket::operand_braces;
+  }
+  return bracket::block;
+}
+
+lexer_base::bracket lexer_base::pop_bracket(token_type closer) {
+  if (!brackets.empty()) {
+    auto opened = brackets.back();
+    brackets.pop_back();
+    return opened;
+  }
+  ++brackets_below;
+  if (bracket_base) {
+    // The innermost bracket before bracket_scan that is still open. Later
+    // ones were already looked up, so the scan goes on where it stopped.
+    auto &kinds = bracket_base->kinds;
+    for (size_t nested = 0; bracket_scan != 0;) {
+      auto type = kinds[--bracket_scan].type;
+      if (type == token_type::PAREN_CLOSE || type == token_type::BRACE_CLOSE) {
+        ++nested;
+      } else if (type == token_type::PAREN_OPEN ||
+                 type == token_type::BRACE_OPEN) {
+        if (nested == 0) {
+          std::optional<token> before;
+          if (bracket_scan != 0) {
+            before = (*bracket_base)[bracket_scan - 1];
+          }
+          return opened_after(before, type);
+        }
+        --nested;
+      }
+    }
+  }
+  // Unbalanced, or opened before a guessed lexer state. Either way, what
+  // most brackets are opened for is the best guess.
+  return closer == token_type::PAREN_CLOSE ? bracket::parens : bracket::block;
+}
+
+after_token lexer_base::follow(const token &t) {
+  switch (t.type) {
+  case token_type::PAREN_OPEN:
+  case token_type::BRACE_OPEN:
+    brackets.push_back(opened_after(prev, t.type));
+    return after_token::operand;
+  case token_type::PAREN_CLOSE:
+    switch (pop_bracket(t.type)) {
+    case bracket::head:
+      return after_token::operand;
+    case bracket::function_params:
+      return after_token::function_body;
+    default:
+      return after_token::infix;
+    }
+  case token_type::BRACE_CLOSE:
+    return pop_bracket(t.type) == bracket::operand_braces
+               ? after_token::infix
+               : after_token::operand;
+  case token_type::IDENTIFIER:
+    // The name of a function expression
+    if (prev && prev->after == after_token::function_params) {
+      return after_token::function_params;
+    }
+    return after_token::infix;
+  case token_type::ASTERISK:
+    // A generator function expression
+    if (prev && prev->after == after_token::function_params) {
+      return after_token::function_params;
+    }
+    return after_token::operand;
+  case token_type::INT_LITERAL:
+  case token_type::HEX_LITERAL:
+  case token_type::OCT_LITERAL:
+  case token_type::BIN_LITERAL:
+  case token_type::FLOAT_LITERAL:
+  case token_type::STRING_LITERAL:
+  case token_type::TEMPLATE_STRING:
+  case token_type::TEMPLATE_END:
+  case token_type::REGEX_LITERAL:
+  case token_type::BRACKET_CLOSE:
+  case token_type::INCR:
+  case token_type::DECR:
+    return after_token::infix;
+  case token_type::KEYWORD:
+    switch (t.kw) {
+    case keyword_type::kw_this:
+    case keyword_type::kw_super:
+    case keyword_type::kw_null:
+    case keyword_type::kw_true:
+    case keyword_type::kw_false:
+      return after_token::infix;
+    case keyword_type::kw_function:
+      return starts_expression(prev) ? after_token::function_params
+                                     : after_token::operand;
+    default:
+      return after_token::operand;
+    }
+  default:
+    return after_token::operand;
+  }
+}
+
+result lexer_base::lex() {
+  // Skip whitespace
+  cur = scan::skip_space(cur, buf_end);
+  if (!has_peek()) {
     if (template_depth != 0) {
-      return lexer_error{"Unexpected EOF in template literal", loc};
+      return lexer_error{"Unexpected EOF in template literal", current_loc()};
     }
     return eof_t{};
   }
-  // Skip whitespace
-  unit u;
-  do {
-    // we always have to advance because we expect that our predecessor
-    // has forgotten
-    advance();
-    if (eof()) {
-      return {};
-    }
-    u = current();
-    if (std::iscntrl(u) && !std::isspace(u)) {
-      auto loc = this->loc;
-      return lexer_error{"Found junk", loc};
-    }
-  } while (!std::isgraph(u));
-  auto start_loc = loc;
-  text.str("");
-  text.clear();
-  result res;
-  // Dispatch to more concrete lexing functions
-  if (std::isalnum(u) || u == '_' || u == '$') {
-    res = lex_alnum();
-  } else if (std::ispunct(u)) {
-    res = lex_punct();
-  } else {
-    // FIXME make this more sophisticated for non-ascii characters
-    return lexer_error{"Cannot handle character", start_loc};
+  // we always have to advance because we expect that our predecessor
+  // has forgotten
+  advance();
+  unit u = current();
+  if (char_classes[u] & char_class::junk) {
+    return lexer_error{"Found junk", current_loc()};
   }
+  token_begin = cur - 1;
+  needs_cooking = false;
+  has_escapes = false;
+  // Dispatch to more concrete lexing functions
+  static constexpr dispatch_table dispatch;
+  static_assert(dispatch.covers_punctuators(),
+                "A punctuator from tokens.def has no sub-lexer");
+  result res = (this->*dispatch[u])();
   if (auto *T = std::get_if<token>(&res)) {
-    T->loc = start_loc;
-    prev = *T;
+    T->offset = buf_offset + (token_begin - buf_begin);
+    T->length = cur - token_begin;
+    // Comments have no say in whether a slash starts a regex
+    if (!T->is_comment()) {
+      T->after = follow(*T);
+      prev = *T;
+    }
   }
   return res;
 }
 
-result lexer_base::lex_alnum() {
-  if (std::isdigit(current())) {
-    return lex_number();
+void lexer_base::tokenize_all(token_buffer &out) {
+  assert(!streaming && "Streams don't keep the values of their tokens");
+  out.clear();
+  for (;;) {
+    auto depth = template_depth;
+    auto res = next();
+    if (auto *T = std::get_if<token>(&res)) {
+      if (!T->is_comment()) {
+        out.push_back(*T, depth);
+      }
+    } else {
+      if (auto *err = std::get_if<lexer_error>(&res)) {
+        out.error = std::move(*err);
+      }
+      return;
+    }
+  }
+}
+
+void lexer_base::relex(token_buffer &toks, const text_edit &edit) {
+  assert(!streaming && "Streams cannot be relexed");
+  assert(edit.offset + edit.inserted <= size_t(buf_end - buf_begin));
+  constexpr auto saturated = token_buffer::saturated_depth;
+  auto &offsets = toks.offsets;
+  // Restart two tokens before the first one at or after the edit. The one
+  // in between may run into the edit, and sub-lexers may look past the end
+  // of the one we restart at. Its lexer state is what tokenize_all saw.
+  size_t first = std::lower_bound(offsets.begin(), offsets.end(),
+                                  edit.offset) -
+                 offsets.begin();
+  first = first < 2 ? 0 : first - 2;
+  while (first != 0 && toks.template_depths[first] == saturated) {
+    --first;
+  }
+  // At the start of the buffer, the state is left as reset() leaves it for
+  // tokenize_all. The edit may come before the first token there.
+  reset();
+  if (first != 0) {
+    cur = buf_begin + offsets[first];
+    template_depth = toks.template_depths[first];
+    prev = toks[first - 1];
+  }
+  // Brackets opened before the first token are looked up in the old tokens
+  // once they get closed
+  bracket_base = &toks;
+  bracket_scan = first;
+  // What the old tokens from first on did to the brackets, relative to the
+  // ones open before first like brackets and brackets_below
+  std::vector<bracket> old_brackets;
+  size_t old_below = 0;
+  size_t replayed = first;
+  auto replay_until = [&](size_t end) {
+    for (; replayed < end; ++replayed) {
+      auto type = toks.kinds[replayed].type;
+      if (type == token_type::PAREN_OPEN || type == token_type::BRACE_OPEN) {
+        std::optional<token> before;
+        if (replayed != 0) {
+          before = toks[replayed - 1];
+        }
+        old_brackets.push_back(opened_after(before, type));
+      } else if (type == token_type::PAREN_CLOSE ||
+                 type == token_type::BRACE_CLOSE) {
+        if (old_brackets.empty()) {
+          ++old_below;
+        } else {
+          old_brackets.pop_back();
+        }
+      }
+    }
+  };
+  // Old tokens after the removed text are unchanged, except for their
+  // offset. Once a new token starts where one of them now starts, in the
+  // same lexer state, all following tokens are the same as before. The
+  // state at an error is not known, so an old error forces a full relex.
+  auto delta = int64_t(edit.inserted) - int64_t(edit.removed);
+  size_t old = std::lower_bound(offsets.begin(), offsets.end(),
+                                edit.offset + edit.removed) -
+               offsets.begin();
+  bool can_sync = !toks.error;
+  token_buffer fresh;
+  for (;;) {
+    auto depth = template_depth;
+    bool had_prev = prev.has_value();
+    bool after_operand = ends_operand(prev);
+    auto res = next();
+    auto *T = std::get_if<token>(&res);
+    if (!T) {
+      if (auto *err = std::get_if<lexer_error>(&res)) {
+        fresh.error = std::move(*err);
+      }
+      toks.splice(first, toks.size(), fresh, delta);
+      toks.error = std::move(fresh.error);
+      bracket_base = nullptr;
+      return;
+    }
+    if (T->is_comment()) {
+      continue;
+    }
+    while (can_sync && old != toks.size() && offsets[old] + delta < T->offset) {
+      ++old;
+    }
+    // Both T and the old token are the same if they start in the same
+    // state. The tokens after them are, if the state after them is.
+    if (can_sync && old != toks.size() && offsets[old] + delta == T->offset &&
+        depth < saturated && toks.template_depths[old] == depth &&
+        (old == 0 ? fresh.size() == 0
+                  : had_prev && after_operand ==
+                                    ends_operand(toks.kinds[old - 1].after)) &&
+        T->after == toks.kinds[old].after) {
+      replay_until(old + 1);
+      if (brackets_below == old_below && brackets == old_brackets) {
+        toks.splice(first, old, fresh, delta);
+        bracket_base = nullptr;
+        return;
+      }
+    }
+    fresh.push_back(*T, depth);
+  }
+}
+
+struct lexer_base::speculation {
+  /// The lexer that lexed toks. Their syms are ids in its string_table.
+  const lexer_base *lexer;
+  /// Where lexing started, and the type of the token guessed to come
+  /// before that. The template depth was guessed to be zero.
+  size_t begin;
+  std::optional<token_type> start_prev;
+  /// Comments are dropped. If the guess was right, so is toks.error.
+  token_buffer toks;
+  /// Whether a bracket opened in toks is still open after each token. The
+  /// brackets that were open at begin are not known.
+  std::vector<bool> nested;
+  /// The tokens that closed a bracket opened before begin, which
+  /// pop_bracket() had to guess
+  std::vector<size_t> guessed;
+  /// Set if lexing stopped at a token at or after the chunk end. Lexing
+  /// resumes at that token, in the lexer state it was lexed in. Of the
+  /// brackets, only those opened in toks are known.
+  bool resumable = false;
+  size_t resume_offset = 0;
+  size_t resume_depth = 0;
+  std::optional<token> resume_prev;
+  std::vector<bracket> resume_brackets;
+};
+
+/// Guessing that a chunk starts right after a semicolon is usually right,
+/// both in minified and in handwritten code. Returns end if there is none.
+static size_t after_semicolon(const unit *buf, size_t pos, size_t end) {
+  auto *semicolon = scan::find(buf + pos, buf + end, ';');
+  return semicolon == buf + end ? end : semicolon - buf + 1;
+}
+
+void lexer_base::speculate(size_t begin, size_t end,
+                           std::optional<token_type> start_prev,
+                           std::vector<speculation> &out) {
+  while (begin < end) {
+    out.emplace_back();
+    auto &spec = out.back();
+    spec.lexer = this;
+    spec.begin = begin;
+    spec.start_prev = start_prev;
+    cur = buf_begin + begin;
+    template_depth = 0;
+    prev.reset();
+    if (start_prev) {
+      prev = token{*start_prev};
+    }
+    brackets.clear();
+    brackets_below = 0;
+    for (;;) {
+      auto before = save();
+      auto res = lex();
+      auto *T = std::get_if<token>(&res);
+      if (!T) {
+        if (auto *err = std::get_if<lexer_error>(&res)) {
+          spec.toks.error = std::move(*err);
+        }
+        break;
+      }
+      if (T->offset >= end) {
+        restore(before);
+        spec.resumable = true;
+        spec.resume_offset = T->offset;
+        spec.resume_depth = template_depth;
+        spec.resume_prev = prev;
+        spec.resume_brackets = brackets;
+        return;
+      }
+      if (!T->is_comment()) {
+        if (brackets_below != before.brackets_below) {
+          spec.guessed.push_back(spec.toks.size());
+        }
+        spec.toks.push_back(*T, before.template_depth);
+        spec.nested.push_back(!brackets.empty());
+      }
+    }
+    if (!spec.toks.error) {
+      return;
+    }
+    // The error may only be due to a wrong guess, so guess again after it.
+    // If the error is real, the tokens after it are never used.
+    size_t error_pos = std::max<size_t>(cur - buf_begin, begin + 1);
+    begin = after_semicolon(buf_begin, std::min(error_pos, end), end);
+    start_prev = token_type::SEMICOLON;
+  }
+}
+
+/// Calls \p fn with every index below \p n, on up to \p jobs threads
+template <class fn_type>
+static void parallel_for(size_t n, size_t jobs, const fn_type &fn) {
+  std::vector<std::thread> threads;
+  size_t count = std::min(n, jobs);
+  for (size_t t = 0; t < count; ++t) {
+    threads.emplace_back([&, t] {
+      for (size_t i = t; i < n; i += count) {
+        fn(i);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+void lexer_base::tokenize_parallel(token_buffer &out, unsigned jobs,
+                                   size_t min_chunk) {
+  reset();
+  size_t size = buf_end - buf_begin;
+  auto cores = std::thread::hardware_concurrency();
+  if (jobs == 0) {
+    jobs = std::max(1u, cores);
+  }
+  // Threads sharing a single core only add the cost of the merge
+  if (cores == 1) {
+    jobs = 1;
+  }
+  jobs = std::min<size_t>(jobs, size / std::max<size_t>(min_chunk, 1));
+  if (!borrow_texts || jobs <= 1) {
+    tokenize_all(out);
+    return;
+  }
+  // Chunk i starts after the first semicolon from i / jobs of the buffer on
+  std::vector<size_t> bounds{0};
+  for (size_t i = 1; i < jobs; ++i) {
+    auto bound = after_semicolon(
+        buf_begin, std::max(bounds.back() + 1, size * i / jobs), size);
+    if (bound < size) {
+      bounds.push_back(bound);
+    }
+  }
+  bounds.push_back(size);
+  size_t chunks = bounds.size() - 1;
+  // Workers lex the whole buffer, so offsets need no fixing
+  std::vector<lexer_base> workers(chunks);
+  std::vector<std::vector<speculation>> results(chunks);
+  parallel_for(chunks, chunks, [&](size_t i) {
+    workers[i].set_buffer({buf_begin, size}, true);
+    // The first chunk starts in the state reset() leaves, so it is no guess
+    std::optional<token_type> start_prev;
+    if (i != 0) {
+      start_prev = token_type::SEMICOLON;
+    }
+    workers[i].speculate(bounds[i], bounds[i + 1], start_prev, results[i]);
+  });
+  std::vector<speculation> specs;
+  for (auto &result : results) {
+    std::move(result.begin(), result.end(), std::back_inserter(specs));
+  }
+  // Lex sequentially until a token is in the same place and lexer state as
+  // a token of the speculation it falls into. All tokens after it are right,
+  // so lexing goes on where that speculation stopped. Only where the tokens
+  // come from is recorded here, they are copied in parallel afterwards.
+  struct piece {
+    /// Lexed by us, so their syms are ids in our tables already
+    token_buffer own;
+    /// The tokens of spec from first on follow the own ones
+    const speculation *spec = nullptr;
+    size_t first = 0;
+    /// Where the piece goes in out, numbers and strings
+    size_t out_begin = 0;
+    size_t numbers_begin = 0;
+    size_t strings_begin = 0;
+  };
+  std::vector<piece> pieces(1);
+  std::optional<lexer_error> error;
+  constexpr auto saturated = token_buffer::saturated_depth;
+  // The tokens of spec after token k were lexed with our brackets if it has
+  // none of its own open after k, and the ones it closes afterwards are
+  // open here and what it guessed. Returns how many of ours it closes.
+  auto brackets_fit = [&](const speculation &spec,
+                          size_t k) -> std::optional<size_t> {
+    if (spec.nested[k]) {
+      return std::nullopt;
+    }
+    auto it = std::upper_bound(spec.guessed.begin(), spec.guessed.end(), k);
+    size_t closed = spec.guessed.end() - it;
+    for (size_t open = brackets.size(); it != spec.guessed.end(); ++it) {
+      if (open == 0) {
+        break;
+      }
+      auto closer = spec.toks.kinds[*it].type;
+      auto guess = closer == token_type::PAREN_CLOSE ? bracket::parens
+                                                     : bracket::block;
+      if (brackets[--open] != guess) {
+        return std::nullopt;
+      }
+    }
+    return closed;
+  };
+  size_t s = 0, k = 0;
+  for (;;) {
+    auto depth = template_depth;
+    bool after_operand = ends_operand(prev);
+    auto res = next();
+    auto *T = std::get_if<token>(&res);
+    if (!T) {
+      if (auto *err = std::get_if<lexer_error>(&res)) {
+        error = std::move(*err);
+      }
+      break;
+    }
+    if (T->is_comment()) {
+      continue;
+    }
+    while (s + 1 < specs.size() && specs[s + 1].begin <= T->offset) {
+      ++s;
+      k = 0;
+    }
+    auto &spec = specs[s];
+    auto &offsets = spec.toks.offsets;
+    while (k != offsets.size() && offsets[k] < T->offset) {
+      ++k;
+    }
+    // T itself is already interned by us, so it is not taken over
+    pieces.back().own.push_back(*T, depth);
+    if (k == offsets.size() || offsets[k] != T->offset || depth >= saturated ||
+        spec.toks.template_depths[k] != depth ||
+        (k == 0 ? spec.start_prev && ends_operand(token{*spec.start_prev}.after)
+                : ends_operand(spec.toks.kinds[k - 1].after)) !=
+            after_operand ||
+        T->after != spec.toks.kinds[k].after) {
+      continue;
+    }
+    auto closed = brackets_fit(spec, k);
+    if (!closed) {
+      continue;
+    }
+    pieces.back().spec = &spec;
+    pieces.back().first = k + 1;
+    if (spec.toks.error) {
+      error = spec.toks.error;
+      // The worker has a source_manager of its own
+      error->loc = location_at(spec.lexer->offset_of(error->loc));
+      break;
+    }
+    if (!spec.resumable) {
+      break;
+    }
+    pieces.emplace_back();
+    k = offsets.size();
+    cur = buf_begin + spec.resume_offset;
+    template_depth = spec.resume_depth;
+    prev = spec.resume_prev;
+    auto kept = brackets.size() - std::min(*closed, brackets.size());
+    brackets_below += *closed - (brackets.size() - kept);
+    brackets.resize(kept);
+    brackets.insert(brackets.end(), spec.resume_brackets.begin(),
+                    spec.resume_brackets.end());
+  }
+  // Maps the text ids of each worker to ours. Interning is serial, but only
+  // once per distinct text of a worker.
+  constexpr auto no_id = string_table::entry::no_id;
+  std::vector<std::vector<string_table::id_type>> sym_maps(chunks);
+  for (auto &p : pieces) {
+    if (!p.spec) {
+      continue;
+    }
+    auto &table = p.spec->lexer->str_table;
+    auto &map = sym_maps[p.spec->lexer - workers.data()];
+    for (size_t id = map.size(); id != table.size(); ++id) {
+      map.push_back(str_table.get_handle(table[id]).id());
+    }
+  }
+  // Literal values of adopted tokens go after the ones we lexed ourselves
+  std::vector<std::pair<size_t, size_t>> value_counts(pieces.size());
+  parallel_for(pieces.size(), jobs, [&](size_t i) {
+    auto *spec = pieces[i].spec;
+    if (!spec) {
+      return;
+    }
+    auto &kinds = spec->toks.kinds;
+    for (size_t j = pieces[i].first; j != kinds.size(); ++j) {
+      token t{kinds[j].type};
+      value_counts[i].first += t.is_number_literal();
+      value_counts[i].second += t.has_string_value();
+    }
+  });
+  size_t out_size = 0;
+  size_t numbers_size = numbers.size();
+  size_t strings_size = strings.size();
+  for (size_t i = 0; i < pieces.size(); ++i) {
+    auto &p = pieces[i];
+    p.out_begin = out_size;
+    p.numbers_begin = numbers_size;
+    p.strings_begin = strings_size;
+    out_size += p.own.size();
+    if (p.spec) {
+      out_size += p.spec->toks.size() - p.first;
+    }
+    numbers_size += value_counts[i].first;
+    strings_size += value_counts[i].second;
+  }
+  out.clear();
+  out.resize(out_size);
+  numbers.resize(numbers_size);
+  strings.resize(strings_size);
+  parallel_for(pieces.size(), jobs, [&](size_t i) {
+    auto &p = pieces[i];
+    auto copy = [&out](const token_buffer &from, size_t first, size_t to) {
+      auto copy_range = [&](const auto &src, auto &dest) {
+        std::copy(src.begin() + first, src.end(), dest.begin() + to);
+      };
+      copy_range(from.kinds, out.kinds);
+      copy_range(from.offsets, out.offsets);
+      copy_range(from.lengths, out.lengths);
+      copy_range(from.syms, out.syms);
+      copy_range(from.template_depths, out.template_depths);
+    };
+    copy(p.own, 0, p.out_begin);
+    if (!p.spec) {
+      return;
+    }
+    size_t adopted = p.out_begin + p.own.size();
+    copy(p.spec->toks, p.first, adopted);
+    auto *worker = p.spec->lexer;
+    auto &map = sym_maps[worker - workers.data()];
+    auto map_id = [&](string_table::id_type sym) {
+      return sym == no_id ? sym : map[sym];
+    };
+    auto next_number = p.numbers_begin;
+    auto next_string = p.strings_begin;
+    for (auto j = adopted; j != adopted + p.spec->toks.size() - p.first;
+         ++j) {
+      auto &sym = out.syms[j];
+      if (sym == no_id) {
+        continue;
+      }
+      token t{out.kinds[j].type};
+      // Number texts are views into the buffer here, so only values are left
+      if (t.is_number_literal()) {
+        numbers[next_number] = {worker->numbers[sym].value, no_id};
+        sym = next_number++;
+      } else if (t.has_string_value()) {
+        auto value = worker->strings[sym];
+        strings[next_string] = {map_id(value.text), map_id(value.cooked)};
+        sym = next_string++;
+      } else {
+        sym = map_id(sym);
+      }
+    }
+  });
+  out.error = std::move(error);
+}
+
+template <class ty>
+static void replace_range(std::vector<ty> &v, size_t first, size_t last,
+                          const std::vector<ty> &with) {
+  size_t old_size = last - first;
+  if (with.size() > old_size) {
+    v.insert(v.begin() + last, with.size() - old_size, ty{});
   } else {
-    return lex_id_keyword();
+    v.erase(v.begin() + first + with.size(), v.begin() + last);
   }
+  std::copy(with.begin(), with.end(), v.begin() + first);
 }
-result lexer_base::lex_punct() {
-  if (current() == '.') {
-    return lex_dot();
-  } else if (current() == '/') {
-    return lex_slash();
-  } else if (current() == ',') {
-    return token{token_type::COMMA, {}, {}};
-  } else if (current() == ';') {
-    return token{token_type::SEMICOLON, {}, {}};
-  } else if (current() == '=') {
-    return lex_eq();
-  } else if (current() == '+') {
-    return lex_plus();
-  } else if (current() == '-') {
-    return lex_minus();
-  } else if (current() == '*') {
-    return lex_asterisk();
-  } else if (current() == '/') {
-    return lex_slash();
-  } else if (current() == '%') {
-    return lex_percent();
-  } else if (current() == '!') {
-    return lex_exclamation();
-  } else if (current() == '?') {
-    return token{token_type::QMARK, {}, {}};
-  } else if (current() == ':') {
-    return token{token_type::COLON, {}, {}};
-  } else if (current() == '~') {
-    return token{token_type::TILDE, {}, {}};
-  } else if (current() == '^') {
-    return lex_caret();
-  } else if (current() == '<') {
-    return lex_lt();
-  } else if (current() == '>') {
-    return lex_gt();
-  } else if (current() == '&') {
-    return lex_ampersand();
-  } else if (current() == '|') {
-    return lex_vert_bar();
-  } else if (current() == '(') {
-    return token{token_type::PAREN_OPEN, {}, {}};
-  } else if (current() == ')') {
-    return token{token_type::PAREN_CLOSE, {}, {}};
-  } else if (current() == '{') {
-    return token{token_type::BRACE_OPEN, {}, {}};
-  } else if (current() == '}') {
-    return lex_closing_brace();
-  } else if (current() == '[') {
-    return token{token_type::BRACKET_OPEN, {}, {}};
-  } else if (current() == ']') {
-    return token{token_type::BRACKET_CLOSE, {}, {}};
-  } else if (current() == '\'' || current() == '"') {
-    return lex_str();
-  } else if (current() == '`') {
-    return lex_backtick();
-  }
-  return lexer_error{"Unknown punctuation character", loc};
+
+void token_buffer::splice(size_t first, size_t last, const token_buffer &with,
+                          int64_t delta) {
+  assert(first <= last && last <= size());
+  replace_range(kinds, first, last, with.kinds);
+  replace_range(offsets, first, last, with.offsets);
+  replace_range(lengths, first, last, with.lengths);
+  replace_range(syms, first, last, with.syms);
+  replace_range(template_depths, first, last, with.template_depths);
+  // Unsigned wrap-around makes this a plain vectorizable add for both signs
+  auto shift = uint32_t(delta);
+  for (size_t i = first + with.size(); shift && i < size(); ++i) {
+    offsets[i] += shift;
+  }
+}
+
+result lexer_base::lex_single_punct() {
+  auto u = static_cast<unsigned char>(current());
+  assert(single_puncts.is_single[u]);
+  return token{single_puncts.types[u]};
+}
+result lexer_base::lex_unknown() {
+  if (char_classes[current()] & char_class::punct) {
+    return lexer_error{"Unknown punctuation character", current_loc()};
+  }
+  // FIXME make this more sophisticated for non-ascii characters
+  return lexer_error{"Cannot handle character", current_loc()};
 }
 
 result lexer_base::lex_dot() {
-  if (!peek()) {
-    return token{token_type::DOT, {}, {}};
+  if (!has_peek()) {
+    return token{token_type::DOT};
   }
-  if (*peek() == '.') {
+  if (peek() == '.') {
     advance();
-    if (!peek() || *peek() != '.') {
+    if (!has_peek() || peek() != '.') {
       // Not sure if it makes sense to catch this here. We might also just
       // lex two DOT tokens instead, causing a syntax error later
       return lexer_error{"Unexpected char after '..'. Expected third dot.",
-                         loc};
+                         current_loc()};
     }
     advance();
-    return token{token_type::DOTDOTDOT, {}, {}};
-  } else if (std::isdigit(*peek())) {
+    return token{token_type::DOTDOTDOT};
+  } else if (is_digit(peek())) {
     return lex_number();
   }
-  return token{token_type::DOT, {}, {}};
+  return token{token_type::DOT};
 }
 
 result lexer_base::lex_eq() {
   assert(current() == '=');
-  if (!peek()) {
-    return token{token_type::EQ, {}, {}};
+  if (!has_peek()) {
+    return token{token_type::EQ};
   }
   if (peek() == '>') {
     advance();
-    return token{token_type::ARROW, {}, {}};
+    return token{token_type::ARROW};
   } else if (peek() == '=') {
     advance();
-    if (!peek()) {
-      return token{token_type::EQEQ, {}, {}};
+    if (!has_peek()) {
+      return token{token_type::EQEQ};
     }
-    if (*peek() != '=') {
+    if (peek() != '=') {
       return token{token_type::EQEQ};
     }
     advance(); // move onto third '='
-    return token{token_type::EQEQEQ, {}, {}};
+    return token{token_type::EQEQEQ};
   }
-  return token{token_type::EQ, {}, {}};
+  return token{token_type::EQ};
 }
 
 result lexer_base::lex_plus() {
   assert(current() == '+');
-  if (!peek()) {
-    return token{token_type::PLUS, {}, {}};
+  if (!has_peek()) {
+    return token{token_type::PLUS};
   }
-  if (*peek() == '=') {
+  if (peek() == '=') {
     advance();
-    return token{token_type::PLUS_EQ, {}, {}};
-  } else if (*peek() == '+') {
+    return token{token_type::PLUS_EQ};
+  } else if (peek() == '+') {
     advance();
-    return token{token_type::INCR, {}, {}};
+    return token{token_type::INCR};
   }
-  return token{token_type::PLUS, {}, {}};
+  return token{token_type::PLUS};
 }
 result lexer_base::lex_minus() {
   assert(current() == '-');
-  if (!peek()) {
-    return token{token_type::MINUS, {}, {}};
+  if (!has_peek()) {
+    return token{token_type::MINUS};
   }
-  if (*peek() == '=') {
+  if (peek() == '=') {
     advance();
-    return token{token_type::MINUS_EQ, {}, {}};
-  } else if (*peek() == '-') {
+    return token{token_type::MINUS_EQ};
+  } else if (peek() == '-') {
     advance();
-    return token{token_type::DECR, {}, {}};
+    return token{token_type::DECR};
   }
-  return token{token_type::MINUS, {}, {}};
+  return token{token_type::MINUS};
 }
 result lexer_base::lex_asterisk() {
   assert(current() == '*');
-  if (!peek()) {
-    return token{token_type::ASTERISK, {}, {}};
+  if (!has_peek()) {
+    return token{token_type::ASTERISK};
   }
-  if (*peek() == '=') {
+  if (peek() == '=') {
     advance();
-    return token{token_type::MUL_EQ, {}, {}};
-  } else if (*peek() == '*') {
+    return token{token_type::MUL_EQ};
+  } else if (peek() == '*') {
     advance();
-    if (!peek()) {
-      return token{token_type::POW, {}, {}};
+    if (!has_peek()) {
+      return token{token_type::POW};
     }
-    if (*peek() == '=') {
+    if (peek() == '=') {
       advance();
-      return token{token_type::POW_EQ, {}, {}};
+      return token{token_type::POW_EQ};
     }
-    return token{token_type::POW, {}, {}};
+    return token{token_type::POW};
   }
-  return token{token_type::ASTERISK, {}, {}};
+  return token{token_type::ASTERISK};
 }
 result lexer_base::lex_slash() {
   assert(current() == '/');
-  if (!peek()) {
-    return token{token_type::SLASH, {}, {}};
+  if (!has_peek()) {
+    return token{token_type::SLASH};
   }
-  if (*peek() == '/') {
+  if (peek() == '/') {
     return lex_line_comment();
-  } else if (*peek() == '*') {
+  } else if (peek() == '*') {
     return lex_block_comment();
-  } else if (!prev || (prev->type == token_type::KEYWORD &&
-                       prev->type == token_type::IDENTIFIER &&
-                       prev->type == token_type::INT_LITERAL &&
-                       prev->type == token_type::FLOAT_LITERAL &&
-                       prev->type == token_type::HEX_LITERAL &&
-                       prev->type == token_type::OCT_LITERAL &&
-                       prev->type == token_type::BIN_LITERAL)) {
+  } else if (!ends_operand(prev)) {
     return lex_regex();
-  } else if (*peek() == '=') {
+  } else if (peek() == '=') {
     advance();
-    return token{token_type::DIV_EQ, {}, {}};
+    return token{token_type::DIV_EQ};
   }
-  return token{token_type::SLASH, {}, {}};
+  return token{token_type::SLASH};
 }
 
 result lexer_base::lex_regex() {
   assert(current() == '/');
-  auto start = loc;
-  bool ended = false;
-  while (peek()) {
-    if (islineterminator(current())) {
-      return lexer_error{"Unexpected line end in regex literal", loc};
+  auto start = current_loc();
+  // A slash in a character class does not end the literal
+  bool in_class = false;
+  for (;;) {
+    if (!has_peek()) {
+      return lexer_error{"Reached EOF while lexing regex literal", start};
+    }
+    advance();
+    if (is_line_terminator(current())) {
+      return lexer_error{"Unexpected line end in regex literal", current_loc()};
     }
-    text << current();
     if (current() == '\\') {
-      advance();
-      if (!peek()) {
-        return lexer_error{"Unexpected EOF in regex literal", loc};
+      if (!has_peek()) {
+        return lexer_error{"Unexpected EOF in regex literal", current_loc()};
       }
-      text << current();
-    }
-    if (peek() == '/') {
       advance();
-      text << current();
-      ended = true;
+      if (is_line_terminator(current())) {
+        return lexer_error{"Unexpected line end in regex literal",
+                           current_loc()};
+      }
+    } else if (current() == '[') {
+      in_class = true;
+    } else if (current() == ']') {
+      in_class = false;
+    } else if (current() == '/' && !in_class) {
       break;
     }
-    advance();
-  }
-  if (!ended) {
-    return lexer_error{"Reached EOF while lexing regex literal", start};
   }
-  return token{token_type::REGEX_LITERAL, str_table.get_handle(text.str()),
-               start};
+  // Flags
+  cur = scan::skip_ident(cur, buf_end);
+  return text_token(token_type::REGEX_LITERAL);
 }
 
 result lexer_base::lex_percent() {
   assert(current() == '%');
-  if (!peek()) {
-    return token{token_type::PERCENT, {}, {}};
+  if (!has_peek()) {
+    return token{token_type::PERCENT};
   }
-  if (*peek() == '=') {
+  if (peek() == '=') {
     advance();
-    return token{token_type::MOD_EQ, {}, {}};
+    return token{token_type::MOD_EQ};
   }
-  return token{token_type::PERCENT, {}, {}};
+  return token{token_type::PERCENT};
 }
 
 result lexer_base::lex_exclamation() {
   assert(current() == '!');
-  if (!peek()) {
-    return token{token_type::EXMARK, {}, {}};
+  if (!has_peek()) {
+    return token{token_type::EXMARK};
   }
-  if (*peek() == '=') {
+  if (peek() == '=') {
     advance();
-    if (!peek() || *peek() != '=') {
-      return token{token_type::NEQ, {}, {}};
+    if (!has_peek() || peek() != '=') {
+      return token{token_type::NEQ};
     }
     advance();
-    return token{token_type::NEQEQ, {}, {}};
+    return token{token_type::NEQEQ};
   }
-  return token{token_type::EXMARK, {}, {}};
+  return token{token_type::EXMARK};
 }
 
 result lexer_base::lex_caret() {
   assert(current() == '^');
-  if (!peek()) {
-    return token{token_type::CARET, {}, {}};
+  if (!has_peek()) {
+    return token{token_type::CARET};
   }
-  if (*peek() == '=') {
+  if (peek() == '=') {
     advance();
-    return token{token_type::CARET_EQ, {}, {}};
+    return token{token_type::CARET_EQ};
   }
-  return token{token_type::CARET, {}, {}};
+  return token{token_type::CARET};
 }
 
 result lexer_base::lex_lt() {
   assert(current() == '<');
-  if (!peek()) {
-    return token{token_type::LT, {}, {}};
+  if (!has_peek()) {
+    return token{token_type::LT};
   }
-  if (*peek() == '=') {
+  if (peek() == '=') {
     advance();
-    return token{token_type::LT_EQ, {}, {}};
-  } else if (*peek() == '<') {
+    return token{token_type::LT_EQ};
+  } else if (peek() == '<') {
     advance();
-    if (!peek()) {
-      return token{token_type::LSHIFT, {}, {}};
+    if (!has_peek()) {
+      return token{token_type::LSHIFT};
     }
-    if (*peek() == '=') {
+    if (peek() == '=') {
       advance();
-      return token{token_type::LSH_EQ, {}, {}};
+      return token{token_type::LSH_EQ};
     }
     return token{token_type::LSHIFT};
   }
-  return token{token_type::LT, {}, {}};
+  return token{token_type::LT};
 }
 
 result lexer_base::lex_gt() {
   assert(current() == '>');
-  if (!peek()) {
-    return token{token_type::GT, {}, {}};
+  if (!has_peek()) {
+    return token{token_type::GT};
   }
-  if (*peek() == '=') {
+  if (peek() == '=') {
     advance();
-    return token{token_type::GT_EQ, {}, {}};
-  } else if (*peek() == '>') {
+    return token{token_type::GT_EQ};
+  } else if (peek() == '>') {
     advance();
-    if (!peek()) {
-      return token{token_type::RSHIFT, {}, {}};
+    if (!has_peek()) {
+      return token{token_type::RSHIFT};
     }
-    if (*peek() == '=') {
+    if (peek() == '=') {
       advance();
-      return token{token_type::RSH_EQ, {}, {}};
-    } else if (*peek() == '>') {
+      return token{token_type::RSH_EQ};
+    } else if (peek() == '>') {
       advance();
-      if (!peek()) {
-        return token{token_type::LOG_RSHIFT, {}, {}};
+      if (!has_peek()) {
+        return token{token_type::LOG_RSHIFT};
       }
-      if (*peek() == '=') {
+      if (peek() == '=') {
         advance();
-        return token{token_type::LOG_RSH_EQ, {}, {}};
+        return token{token_type::LOG_RSH_EQ};
       }
-      return token{token_type::LOG_RSHIFT, {}, {}};
+      return token{token_type::LOG_RSHIFT};
     }
     return token{token_type::RSHIFT};
   }
-  return token{token_type::GT, {}, {}};
+  return token{token_type::GT};
 }
 
 result lexer_base::lex_ampersand() {
   assert(current() == '&');
-  if (!peek()) {
-    return token{token_type::AMPERSAND, {}, {}};
+  if (!has_peek()) {
+    return token{token_type::AMPERSAND};
   }
-  if (*peek() == '&') {
+  if (peek() == '&') {
     advance();
-    return token{token_type::LOG_AND, {}, {}};
-  } else if (*peek() == '=') {
+    return token{token_type::LOG_AND};
+  } else if (peek() == '=') {
     advance();
-    return token{token_type::AND_EQ, {}, {}};
+    return token{token_type::AND_EQ};
   }
-  return token{token_type::AMPERSAND, {}, {}};
+  return token{token_type::AMPERSAND};
 }
 
 result lexer_base::lex_vert_bar() {
   assert(current() == '|');
-  if (!peek()) {
-    return token{token_type::VERT_BAR, {}, {}};
+  if (!has_peek()) {
+    return token{token_type::VERT_BAR};
   }
-  if (*peek() == '|') {
+  if (peek() == '|') {
     advance();
-    return token{token_type::LOG_OR, {}, {}};
-  } else if (*peek() == '=') {
+    return token{token_type::LOG_OR};
+  } else if (peek() == '=') {
     advance();
-    return token{token_type::OR_EQ, {}, {}};
+    return token{token_type::OR_EQ};
   }
-  return token{token_type::VERT_BAR, {}, {}};
+  return token{token_type::VERT_BAR};
 }
 
 result lexer_base::lex_line_comment() {
-  assert(current() == '/' && *peek() == '/');
-  text << current();
-  do {
-    advance();
-    text << current();
-  } while (peek() && *peek() != '\n');
-  return token{token_type::LINE_COMMENT, str_table.get_handle(text.str()), {}};
+  assert(current() == '/' && peek() == '/');
+  advance();
+  cur = scan::find(cur, buf_end, '\n');
+  return text_token(token_type::LINE_COMMENT);
 }
 
 result lexer_base::lex_block_comment() {
-  assert(current() == '/' && *peek() == '*');
-  auto start = loc;
-  text << "/*";
+  assert(current() == '/' && peek() == '*');
+  auto start = current_loc();
   advance(); // now pointing on *
   bool closed = false;
-  while (peek()) {
+  while (has_peek()) {
+    cur = scan::find(cur, buf_end, '*');
+    if (!has_peek()) {
+      break;
+    }
     advance();
-    text << current();
-    if (current() == '*' && peek() && *peek() == '/') {
+    if (peek_is('/')) {
       advance();
-      text << current();
       closed = true;
       break;
     }
@@ -473,27 +1391,30 @@ result lexer_base::lex_block_comment() {
   if (!closed) {
     return lexer_error{"Reached end of file while lexing block comment", start};
   }
-  return token{token_type::BLOCK_COMMENT, str_table.get_handle(text.str()), {}};
+  return text_token(token_type::BLOCK_COMMENT);
 }
 
 result lexer_base::lex_str() {
   assert(current() == '"' || current() == '\'');
-  auto start = loc;
+  auto start = current_loc();
   auto first = current();
   bool ended = false;
-  while (peek()) {
+  while (has_peek()) {
     if (current() == '\\') {
       if (auto maybe_error = consume_escape_seq()) {
         return *maybe_error;
       }
-    } else if (islineterminator(current())) {
-      return lexer_error{"Unexpected end of line in string literal", loc};
-    } else {
-      text << current();
+    } else if (is_line_terminator(current())) {
+      return lexer_error{"Unexpected end of line in string literal",
+                         current_loc()};
+    }
+    // Skip everything that cannot end the literal or start an escape at once
+    cur = scan::find_any(cur, buf_end, first, '\\', '\n', '\r');
+    if (!has_peek()) {
+      break;
     }
     advance();
     if (current() == first) {
-      text << current();
       ended = true;
       break;
     }
@@ -502,83 +1423,77 @@ result lexer_base::lex_str() {
     return lexer_error{"Reached end of file while lexing string literal",
                        start};
   }
-  return token{
-      token_type::STRING_LITERAL, str_table.get_handle(text.str()), {}};
+  return string_token(token_type::STRING_LITERAL);
 }
 
 result lexer_base::lex_backtick() {
   assert(current() == '`');
-  text << '`';
   bool ended = false;
-  while (peek()) {
+  while (has_peek()) {
+    cur = scan::find_any(cur, buf_end, '`', '$', '\\');
+    if (!has_peek()) {
+      break;
+    }
     advance();
     if (current() == '`') {
       ended = true;
-      text << '`';
       break;
     }
-    if (!peek()) {
-      return lexer_error{"Unexpected EOF in template literal", loc};
+    if (!has_peek()) {
+      return lexer_error{"Unexpected EOF in template literal", current_loc()};
     }
-    if (current() == '$' && *peek() == '{') {
+    if (current() == '$' && peek() == '{') {
       advance();
-      text << "${";
       ++template_depth;
-      return token{
-          token_type::TEMPLATE_HEAD, str_table.get_handle(text.str()), {}};
+      return string_token(token_type::TEMPLATE_HEAD);
     } else if (current() == '\\') {
       if (auto err = consume_escape_seq()) {
         return *err;
       }
-    } else {
-      text << current();
     }
   }
   if (!ended) {
-    return lexer_error{"Unexpected EOF in template literal", loc};
+    return lexer_error{"Unexpected EOF in template literal", current_loc()};
   }
-  return token{
-      token_type::TEMPLATE_STRING, str_table.get_handle(text.str()), {}};
+  return string_token(token_type::TEMPLATE_STRING);
 }
 
 result lexer_base::lex_closing_brace() {
   assert(current() == '}');
   if (template_depth == 0) {
-    return token{token_type::BRACE_CLOSE, {}, {}};
+    return token{token_type::BRACE_CLOSE};
   }
-  if (!peek()) {
-    return lexer_error{"Unexpected EOF in template literal", loc};
+  if (!has_peek()) {
+    return lexer_error{"Unexpected EOF in template literal", current_loc()};
   }
-  text << '}';
   bool ended = false;
-  while (peek()) {
+  while (has_peek()) {
+    cur = scan::find_any(cur, buf_end, '`', '$', '\\');
+    if (!has_peek()) {
+      break;
+    }
     advance();
     if (current() == '`') {
       ended = true;
-      text << '`';
       break;
     }
-    if (!peek()) {
-      return lexer_error{"Unexpected EOF in template literal", loc};
+    if (!has_peek()) {
+      return lexer_error{"Unexpected EOF in template literal", current_loc()};
     }
-    if (current() == '$' && *peek() == '{') {
+    if (current() == '$' && peek() == '{') {
       advance();
-      text << "${";
-      return token{
-          token_type::TEMPLATE_MIDDLE, str_table.get_handle(text.str()), {}};
+      return string_token(token_type::TEMPLATE_MIDDLE);
     } else if (current() == '\\') {
       if (auto err = consume_escape_seq()) {
         return *err;
       }
-    } else {
-      text << current();
     }
   }
   if (!ended) {
-    return lexer_error{"Unexpected EOF in template literal", loc};
+    return lexer_error{"Unexpected EOF in template literal", current_loc()};
   }
   --template_depth;
-  return token{token_type::TEMPLATE_END, str_table.get_handle(text.str()), {}};
+  return string_token(token_type::TEMPLATE_END);
 }
 
 /// Post condition: Since escape sequences can only occur in string/template
@@ -586,98 +1501,98 @@ result lexer_base::lex_closing_brace() {
 /// an escape sequence
 std::optional<lexer_error> lexer_base::consume_escape_seq() {
   assert(current() == '\\');
-  if (!peek()) {
+  if (!has_peek()) {
     return lexer_error{"Unexpected EOF after begin of escape sequence ('\\')",
-                       loc};
+                       current_loc()};
   }
   advance(); // definitely consume, but line continuations may cause the
              // backslash to be dropped entirely
+  has_escapes = true;
   // see SingleEscapeCharacter in ECMA spec
   if (current() == 'u' || current() == 'x') {
-    text << '\\';
-    text << current();
     auto prefix = current();
-    if (!peek()) {
-      return lexer_error{"Unexpected EOF after begin of escape sequence", loc};
+    if (!has_peek()) {
+      return lexer_error{"Unexpected EOF after begin of escape sequence",
+                         current_loc()};
     }
     advance();
-    if (!peek()) {
-      return lexer_error{"Unexpected EOF within escape sequence", loc};
+    if (!has_peek()) {
+      return lexer_error{"Unexpected EOF within escape sequence",
+                         current_loc()};
     }
     if (prefix == 'x') {
       // hex escape sequence
-      if (!std::isxdigit(current())) {
+      if (!is_hex_digit(current())) {
         return lexer_error{
-            "Unexpected non-hex-digit after begin of hex escape sequence", loc};
+            "Unexpected non-hex-digit after begin of hex escape sequence",
+            current_loc()};
       }
-      text << current();
       advance();
-      if (!std::isxdigit(current())) {
+      if (!is_hex_digit(current())) {
         return lexer_error{
             "Unexpected non-hex-digit as second digit in hex escape sequence",
-            loc};
+            current_loc()};
       }
-      text << current();
     } else /* if (prefix == 'u') */ {
       // unicode escape sequence
       if (current() == '{') {
-        text << current();
         bool ended = false;
+        uint32_t code_point = 0;
         do {
           advance();
-          if (!std::isxdigit(current())) {
+          if (!is_hex_digit(current())) {
             return lexer_error{
-                "Unexpected non-hex-digit in unicode escape sequence", loc};
+                "Unexpected non-hex-digit in unicode escape sequence",
+                current_loc()};
           }
-          text << current();
-          if (peek() && *peek() == '}') {
+          code_point = code_point << 4 | digit_value(current());
+          if (code_point > 0x10FFFF) {
+            return lexer_error{"Code point in unicode escape sequence is "
+                               "out of range",
+                               current_loc()};
+          }
+          if (peek_is('}')) {
             advance();
-            text << '}';
             ended = true;
             break;
           }
-        } while (peek());
+        } while (has_peek());
         if (!ended) {
           return lexer_error{"Unexpected EOF inside unicode escape sequence",
-                             loc};
+                             current_loc()};
         }
       } else {
         for (int i = 0; i < 4; ++i) {
-          if (!std::isxdigit(current())) {
+          if (!is_hex_digit(current())) {
             return lexer_error{
-                "Unexpected non-hex-digit in unicode escape sequence", loc};
+                "Unexpected non-hex-digit in unicode escape sequence",
+                current_loc()};
           }
-          text << current();
-          if (i < 3 && peek()) {
+          if (i < 3 && has_peek()) {
             advance();
-          } else if (i < 3 && !peek()) {
+          } else if (i < 3 && !has_peek()) {
             return lexer_error{"Unexpected EOF in unicode escape sequence",
-                               loc};
+                               current_loc()};
           }
         }
       }
     }
-  } else if (islineterminator(current())) {
-    // line continuation
-    // TODO actually we have to consume a line terminator *sequence*, not just a
-    // single char
-
-    // do nothing -- just drop the line break
-  } else if (current() == '0') {
-    // TODO no idea what this is supposed to do
-    return lexer_error{"Not implemented (consume_escape_seq)", loc};
-  } else if (one_of(current(), "'\"\\bfnrtv")) {
-    // single escape characters
-    // it seems like they're just regular SourceCharacters (?)
-    text << '\\';
-    text << current();
-  } else {
-    // Single SourceCodeCharacter after a backslash
-    text << '\\';
-    text << current();
+  } else if (is_line_terminator(current())) {
+    // line continuation, where CRLF counts as one line terminator
+    if (current() == '\r' && peek_is('\n')) {
+      advance();
+    }
+    // The backslash and line break are dropped from the token text, so the
+    // raw source text cannot be used as is
+    needs_cooking = true;
+  } else if (current() == '0' && has_peek() && is_digit(peek())) {
+    // Legacy octal escape sequence
+    return lexer_error{"Not implemented (consume_escape_seq)", current_loc()};
   }
-  if (!peek()) {
-    return lexer_error{"Unexpected EOF after escape sequence", loc};
+  // Single escape characters (see SingleEscapeCharacter in ECMA spec) and
+  // any other SourceCharacter after a backslash stay in the text verbatim
+  if (!has_peek()) {
+    return lexer_error{"Unexpected EOF after escape sequence", current_loc()};
   }
   return std::nullopt;
 }
@@ -686,21 +1601,20 @@ std::optional<lexer_error> lexer_base::consume_escape_seq() {
 /// minimal code duplication
 #define LEX_SPECIAL_BASE_INT(NAME, PREFIX, TYPE, IS_DIGIT)                     \
   do { /* idiomatic do-while-false-wrapper */                                  \
-    assert(current() == PREFIX[0] && *peek() == PREFIX[1]);                    \
-    text << PREFIX;                                                            \
+    assert(current() == PREFIX[0] && (peek() | 0x20) == PREFIX[1]);            \
     advance(); /* now points to second char of prefix */                       \
-    if (!peek() || !IS_DIGIT(*peek())) {                                       \
-      return lexer_error{NAME " literal must have digits after " PREFIX, loc}; \
+    if (!has_peek() || !IS_DIGIT(peek())) {                                    \
+      return lexer_error{NAME " literal must have digits after " PREFIX,       \
+                         current_loc()};                                       \
     }                                                                          \
     do {                                                                       \
       advance();                                                               \
-      text << current();                                                       \
-    } while (peek() && IS_DIGIT(*peek()));                                     \
-    return token{token_type::TYPE, str_table.get_handle(text.str()), {}};      \
+    } while (has_peek() && IS_DIGIT(peek()));                                  \
+    return number_token(token_type::TYPE);                                     \
   } while (false)
 
 result lexer_base::lex_hex_int() {
-  LEX_SPECIAL_BASE_INT("Hex", "0x", HEX_LITERAL, std::isxdigit);
+  LEX_SPECIAL_BASE_INT("Hex", "0x", HEX_LITERAL, is_hex_digit);
 }
 result lexer_base::lex_bin_int() {
   LEX_SPECIAL_BASE_INT("Binary", "0b", BIN_LITERAL,
@@ -713,116 +1627,399 @@ result lexer_base::lex_oct_int() {
 #undef LEX_SPECIAL_BASE_INT
 
 result lexer_base::lex_number() {
-  assert(std::isdigit(current()) || current() == '.');
+  assert(is_digit(current()) || current() == '.');
   token_type ty = token_type::INT_LITERAL;
   if (current() != '.') { // we got a digit
-    if (!peek()) {
-      text << current();
-      return token{
-          token_type::INT_LITERAL, str_table.get_handle(text.str()), {}};
+    if (!has_peek()) {
+      return number_token(token_type::INT_LITERAL);
     }
     if (current() == '0') {
-      if (*peek() == '.') {
+      if (peek() == '.') {
         // fall through
-      } else if (*peek() == 'x' || *peek() == 'X') {
+      } else if (peek() == 'x' || peek() == 'X') {
         return lex_hex_int();
-      } else if (*peek() == 'b' || *peek() == 'B') {
+      } else if (peek() == 'b' || peek() == 'B') {
         return lex_bin_int();
-      } else if (*peek() == 'o' || *peek() == 'O') {
+      } else if (peek() == 'o' || peek() == 'O') {
         return lex_oct_int();
-      } else if (std::isdigit(*peek())) {
+      } else if (is_digit(peek())) {
         return lexer_error{"Number literals mustn't have more than the first "
                            "digit when starting with '0'",
-                           loc};
+                           current_loc()};
       }
     }
-    text << current();
     // consume remaining leading digits
-    while (peek() && std::isdigit(*peek())) {
+    while (has_peek() && is_digit(peek())) {
       advance();
-      text << current();
     }
     // a dot will also be part of the number
-    if (peek() && *peek() == '.') {
+    if (peek_is('.')) {
       advance();
     }
-  } else if (!peek() || !std::isdigit(*peek())) {
+  } else if (!has_peek() || !is_digit(peek())) {
     return lexer_error{"Expected number, but no digits after leading dot ('.')",
-                       loc};
+                       current_loc()};
   }
   // now we're looking at a leading dot (if it exists)
   if (current() == '.') {
     ty = token_type::FLOAT_LITERAL;
-    text << current();
     // consume decimal places
-    while (peek() && std::isdigit(*peek())) {
+    while (has_peek() && is_digit(peek())) {
       advance();
-      text << current();
     }
   }
-  if (!peek()) {
-    return token{ty, str_table.get_handle(text.str()), {}};
+  if (!has_peek()) {
+    return number_token(ty);
   }
-  if (*peek() == 'e' || *peek() == 'E') {
+  if (peek() == 'e' || peek() == 'E') {
     advance();
-    text << current();
-    if (!peek() ||
-        (!std::isdigit(*peek()) && *peek() != '+' && *peek() != '-')) {
+    if (!has_peek() ||
+        (!is_digit(peek()) && peek() != '+' && peek() != '-')) {
       return lexer_error{"Missing digits after exponent part of number literal",
-                         loc};
+                         current_loc()};
     }
-    if (*peek() == '-') {
+    if (peek() == '-') {
       ty = token_type::FLOAT_LITERAL;
     }
-    if (*peek() == '-' || *peek() == '+') {
+    if (peek() == '-' || peek() == '+') {
       advance(); // consume sign
-      text << current();
     }
-    if (!peek() || !std::isdigit(*peek())) {
+    if (!has_peek() || !is_digit(peek())) {
       return lexer_error{
-          "Missing digits after exponent part's sign of number literal", loc};
+          "Missing digits after exponent part's sign of number literal",
+          current_loc()};
     }
     // consume exponent
-    while (peek() && std::isdigit(*peek())) {
+    while (has_peek() && is_digit(peek())) {
       advance();
-      text << current();
     }
   }
-  return token{ty, str_table.get_handle(text.str()), {}};
+  return number_token(ty);
 }
 
 result lexer_base::lex_id_keyword() {
-  assert(std::isalpha(current()) || current() == '_' || current() == '$');
-  text << current();
-  while (peek() && (std::isalnum(*peek()) || *peek() == '_' || *peek() == '$' ||
-                    *peek() == '\\')) {
-    // TODO backslash may be used to start unicode id sequence, so we
-    // should dispatch to some method that can handle that correctly
-    advance();
-    text << current();
+  assert(is_ident_start(current()));
+  // TODO backslash may be used to start unicode id sequence, so we
+  // should dispatch to some method that can handle that correctly
+  cur = scan::skip_ident(cur, buf_end);
+  std::string_view raw(token_begin, cur - token_begin);
+  token tok{token_type::IDENTIFIER};
+  tok.has_text = true;
+  // Names are interned so later stages can compare and index them by id.
+  // The table keeps its own copy, a source buffer might not outlive it.
+  tok.sym = str_table.get_handle(raw).id();
+  tok.kw = lookup_keyword(raw);
+  if (tok.kw != keyword_type::none) {
+    tok.type = token_type::KEYWORD;
+  }
+  return tok;
+}
+
+/// number values impl
+/// Decimal literals with at most 19 significant digits whose value is an
+/// exact double times an exact power of ten are decoded by one correctly
+/// rounded multiplication or division (Clinger's fast path). That covers
+/// nearly every literal in real code, everything else goes to strtod.
+/// Literals in power-of-two bases are always decoded exactly.
+namespace {
+constexpr double exact_powers_of_ten[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+constexpr int max_exact_power = std::size(exact_powers_of_ten) - 1;
+constexpr uint64_t max_exact_mantissa = uint64_t(1) << 53;
+
+/// Keeps the leading 64 bits of the digits. The bits after them only
+/// decide how to round, so they are folded into the lowest kept bit, which
+/// is far below the rounding position of a double.
+double decode_pow2_digits(std::string_view digits, unsigned bits_per_digit) {
+  uint64_t mantissa = 0;
+  int dropped_bits = 0;
+  bool sticky = false;
+  for (auto u : digits) {
+    auto digit = digit_value(u);
+    if (dropped_bits || mantissa >> (64 - bits_per_digit)) {
+      dropped_bits += bits_per_digit;
+      sticky |= digit != 0;
+    } else {
+      mantissa = mantissa << bits_per_digit | digit;
+    }
   }
-  auto str = str_table.get_handle(text.str());
-  if (is_keyword(str)) {
-    return token{token_type::KEYWORD, str, {}};
+  return std::ldexp(double(mantissa | uint64_t(sticky)), dropped_bits);
+}
+
+double decode_decimal(std::string_view text) {
+  uint64_t mantissa = 0;
+  int significant = 0;
+  int exp10 = 0;
+  size_t i = 0;
+  auto add_digit = [&](unit u) {
+    if (significant == 0 && u == '0') {
+      return;
+    }
+    if (significant < 19) {
+      mantissa = mantissa * 10 + (u - '0');
+    }
+    ++significant;
+  };
+  for (; i < text.size() && is_digit(text[i]); ++i) {
+    add_digit(text[i]);
+  }
+  if (i < text.size() && text[i] == '.') {
+    for (++i; i < text.size() && is_digit(text[i]); ++i) {
+      add_digit(text[i]);
+      --exp10;
+    }
+  }
+  if (i < text.size()) {
+    assert(text[i] == 'e' || text[i] == 'E');
+    bool negative = text[++i] == '-';
+    if (text[i] == '-' || text[i] == '+') {
+      ++i;
+    }
+    int exponent = 0;
+    for (; i < text.size(); ++i) {
+      // Anything this large is out of range anyway
+      exponent = std::min(exponent * 10 + (text[i] - '0'), 100000);
+    }
+    exp10 += negative ? -exponent : exponent;
+  }
+  if (mantissa == 0) {
+    return 0;
+  }
+#if FLT_EVAL_METHOD == 0
+  if (significant <= 19 && mantissa <= max_exact_mantissa) {
+    if (exp10 < 0 && exp10 >= -max_exact_power) {
+      return double(mantissa) / exact_powers_of_ten[-exp10];
+    }
+    // Moving some of the exponent into the mantissa keeps it exact, as
+    // long as the mantissa stays exact
+    for (; exp10 > max_exact_power && mantissa * 10 <= max_exact_mantissa;
+         --exp10) {
+      mantissa *= 10;
+    }
+    if (exp10 >= 0 && exp10 <= max_exact_power) {
+      return double(mantissa) * exact_powers_of_ten[exp10];
+    }
+  }
+#endif
+  return std::strtod(std::string{text}.c_str(), nullptr);
+}
+
+double decode_number(token_type ty, std::string_view text) {
+  switch (ty) {
+  case token_type::HEX_LITERAL:
+    return decode_pow2_digits(text.substr(2), 4);
+  case token_type::OCT_LITERAL:
+    return decode_pow2_digits(text.substr(2), 3);
+  case token_type::BIN_LITERAL:
+    return decode_pow2_digits(text.substr(2), 1);
+  default:
+    return decode_decimal(text);
+  }
+}
+} // namespace
+
+token lexer_base::number_token(token_type ty) {
+  auto tok = text_token(ty);
+  std::string_view raw(token_begin, cur - token_begin);
+  numbers.push_back({decode_number(ty, raw), tok.sym});
+  tok.sym = numbers.size() - 1;
+  return tok;
+}
+
+/// string values impl
+/// Only literals with escape sequences get a cooked text of their own, the
+/// cooked text of all others is a view into their text. Escape sequences
+/// are validated while lexing, so cooking doesn't check them again.
+namespace {
+/// Returns how many units of delimiters a string literal or template part
+/// has before and after its contents
+std::pair<size_t, size_t> delimiters(token_type ty) {
+  bool opens_substitution =
+      ty == token_type::TEMPLATE_HEAD || ty == token_type::TEMPLATE_MIDDLE;
+  return {1, opens_substitution ? 2 : 1};
+}
+
+std::string_view contents(token_type ty, std::string_view text) {
+  auto [before, after] = delimiters(ty);
+  if (text.size() < before + after) {
+    return {};
+  }
+  return text.substr(before, text.size() - before - after);
+}
+
+/// Lone surrogates are encoded like any other code point (WTF-8), because
+/// JavaScript strings may contain them
+void append_utf8(std::string &out, uint32_t code_point) {
+  if (code_point < 0x80) {
+    out += char(code_point);
+  } else if (code_point < 0x800) {
+    out += char(0xC0 | code_point >> 6);
+    out += char(0x80 | (code_point & 0x3F));
+  } else if (code_point < 0x10000) {
+    out += char(0xE0 | code_point >> 12);
+    out += char(0x80 | (code_point >> 6 & 0x3F));
+    out += char(0x80 | (code_point & 0x3F));
   } else {
-    return token{token_type::IDENTIFIER, str, {}};
+    out += char(0xF0 | code_point >> 18);
+    out += char(0x80 | (code_point >> 12 & 0x3F));
+    out += char(0x80 | (code_point >> 6 & 0x3F));
+    out += char(0x80 | (code_point & 0x3F));
   }
 }
 
-keyword_type lexer_base::get_keyword_type(const token &t) {
-  assert(t.type == token_type::KEYWORD);
-#define KEYWORD(NAME)                                                          \
-  constexpr const char *kw_##NAME##_str = #NAME;                               \
-  constexpr std::string_view kw_##NAME##_view(kw_##NAME##_str);                \
-  if (t.text == kw_##NAME##_view) {                                            \
-    return keyword_type::kw_##NAME;                                            \
+/// Decodes the hex digits of the escape sequence whose letter ('x' or 'u')
+/// is at \p i. Afterwards, \p i is at the sequence's last unit.
+uint32_t decode_hex_escape(std::string_view raw, size_t &i) {
+  size_t digits = raw[i] == 'x' ? 2 : 4;
+  bool braced = raw[i] == 'u' && raw[i + 1] == '{';
+  if (braced) {
+    ++i;
+    digits = raw.find('}', i) - i - 1;
   }
-#include "jnsn/js/keywords.def"
-  unreachable("Unknown keyword type");
+  uint32_t code_point = 0;
+  for (; digits > 0; --digits) {
+    code_point = code_point << 4 | digit_value(raw[++i]);
+  }
+  if (braced) {
+    ++i;
+  }
+  return code_point;
+}
+} // namespace
+
+string_table::id_type lexer_base::cook(std::string_view raw) {
+  cooked.clear();
+  for (size_t i = 0; i < raw.size(); ++i) {
+    if (raw[i] != '\\') {
+      cooked += raw[i];
+      continue;
+    }
+    auto u = raw[++i];
+    switch (u) {
+    case 'n':
+      cooked += '\n';
+      break;
+    case 't':
+      cooked += '\t';
+      break;
+    case 'r':
+      cooked += '\r';
+      break;
+    case 'b':
+      cooked += '\b';
+      break;
+    case 'f':
+      cooked += '\f';
+      break;
+    case 'v':
+      cooked += '\v';
+      break;
+    case '0':
+      cooked += '\0';
+      break;
+    case 'x':
+    case 'u': {
+      auto code_point = decode_hex_escape(raw, i);
+      // A surrogate pair written as two escape sequences is one code point
+      if (code_point >= 0xD800 && code_point < 0xDC00 &&
+          raw.substr(i + 1, 2) == "\\u") {
+        size_t j = i + 2;
+        auto low = decode_hex_escape(raw, j);
+        if (low >= 0xDC00 && low < 0xE000) {
+          code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+          i = j;
+        }
+      }
+      append_utf8(cooked, code_point);
+      break;
+    }
+    case '\r':
+      // Line continuations are dropped, including CRLF ones
+      if (i + 1 < raw.size() && raw[i + 1] == '\n') {
+        ++i;
+      }
+      break;
+    default:
+      if (!is_line_terminator(u)) {
+        cooked += u;
+      }
+    }
+  }
+  return str_table.get_handle(cooked).id();
+}
+
+token lexer_base::string_token(token_type ty) {
+  auto tok = text_token(ty);
+  auto cooked_id = string_table::entry::no_id;
+  if (has_escapes) {
+    cooked_id = cook(contents(ty, {token_begin, size_t(cur - token_begin)}));
+  }
+  strings.push_back({tok.sym, cooked_id});
+  tok.sym = strings.size() - 1;
+  return tok;
+}
+
+string_table::entry lexer_base::cooked_text_of(const token &t) const {
+  assert(t.has_string_value());
+  auto cooked_id = strings[t.sym].cooked;
+  if (cooked_id != string_table::entry::no_id) {
+    return str_table[cooked_id];
+  }
+  return string_table::get_borrowed_handle(contents(t.type, text_of(t)));
+}
+
+token lexer_base::text_token(token_type ty) {
+  token tok{ty};
+  tok.has_text = true;
+  std::string_view raw(token_begin, cur - token_begin);
+  if (needs_cooking) {
+    // Drop line continuations. Every other escape sequence is kept verbatim.
+    cooked.clear();
+    for (size_t i = 0; i < raw.size(); ++i) {
+      if (raw[i] == '\\' && i + 1 < raw.size()) {
+        ++i;
+        if (is_line_terminator(raw[i])) {
+          if (raw[i] == '\r' && i + 1 < raw.size() && raw[i + 1] == '\n') {
+            ++i;
+          }
+          continue;
+        }
+        cooked += '\\';
+      }
+      cooked += raw[i];
+    }
+    tok.sym = str_table.get_handle(cooked).id();
+  } else if (!borrow_texts) {
+    tok.sym = str_table.get_handle(raw).id();
+  }
+  return tok;
 }
 
 token lexer_base::make_token(token_type ty, const char *text) {
-  return token{ty, str_table.get_handle(text), {}};
+  token tok{ty};
+  std::string_view view = text;
+  if (!view.empty()) {
+    tok.has_text = true;
+    tok.sym = str_table.get_handle(view).id();
+  }
+  if (ty == token_type::KEYWORD) {
+    tok.kw = lookup_keyword(view);
+  }
+  if (tok.is_number_literal()) {
+    numbers.push_back({decode_number(ty, view), tok.sym});
+    tok.sym = numbers.size() - 1;
+  }
+  if (tok.has_string_value()) {
+    auto raw = contents(ty, view);
+    auto cooked_id = string_table::entry::no_id;
+    if (raw.find('\\') != std::string_view::npos) {
+      cooked_id = cook(raw);
+    }
+    strings.push_back({tok.sym, cooked_id});
+    tok.sym = strings.size() - 1;
+  }
+  return tok;
 }
 
 } // namespace jnsn
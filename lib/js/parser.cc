@@ -9,19 +9,6 @@
 using namespace jnsn;
 template <class nodety> using res = parser_base::res<nodety>;
 
-template <class resty>
-static std::optional<parser_error> is_error(const resty &res) {
-  if (std::holds_alternative<parser_error>(res)) {
-    return std::get<parser_error>(res);
-  }
-  return std::nullopt;
-}
-template <class base, class child> static res<base> upcast_res(res<child> res) {
-  if (std::holds_alternative<parser_error>(res))
-    return std::get<parser_error>(res);
-  return std::get<0>(res);
-}
-
 lexer_base::result parser_base::next_token() { return get_lexer().next(); }
 
 static std::string to_string(token_type t) {
@@ -37,18 +24,18 @@ static std::string to_string(token_type t) {
 #define ADVANCE_OR_ERROR(MESSAGE)                                              \
   do {                                                                         \
     auto adv = advance();                                                      \
-    if (auto error = is_error(adv)) {                                          \
-      return *error;                                                           \
+    if (adv == advanced::failed) {                                             \
+      return nullptr;                                                          \
     }                                                                          \
-    if (!std::get<bool>(adv)) {                                                \
-      return parser_error{MESSAGE, current_token.loc};                         \
+    if (adv == advanced::eof) {                                                \
+      return fail(MESSAGE);                                                    \
     }                                                                          \
   } while (false)
 
 #define TYPELIST(...)                                                          \
   { __VA_ARGS__ }
 
-#define EXPECT_SEVERAL(TYPES, RETURN_VAL)                                      \
+#define EXPECT_SEVERAL(TYPES)                                                  \
   do {                                                                         \
     bool found_expected = false;                                               \
     std::initializer_list<token_type> types TYPES;                             \
@@ -59,26 +46,17 @@ static std::string to_string(token_type t) {
       }                                                                        \
     }                                                                          \
     if (!found_expected) {                                                     \
-      return parser_error{"Unexpected token. Expected: " #TYPES ". Was: " +    \
-                              to_string(current_token.type),                   \
-                          current_token.loc};                                  \
+      return fail_unexpected("Unexpected token. Expected: " #TYPES ". Was: "); \
     }                                                                          \
   } while (false)
 
-#define EXPECT(TYPE, RETURN_VAL)                                               \
-  EXPECT_SEVERAL(TYPELIST(token_type::TYPE), RETURN_VAL)
-
-#define ASSERT_PARSE_RESULT(VARNAME)                                           \
-  do {                                                                         \
-    if (std::holds_alternative<parser_error>(VARNAME)) {                       \
-      return std::get<parser_error>(VARNAME);                                  \
-    }                                                                          \
-  } while (false)
+#define EXPECT(TYPE) EXPECT_SEVERAL(TYPELIST(token_type::TYPE))
 
 #define SUBPARSE(VARNAME, PARSE_CALL)                                          \
-  auto VARNAME##_or_err = PARSE_CALL;                                          \
-  ASSERT_PARSE_RESULT(VARNAME##_or_err);                                       \
-  auto *VARNAME = std::get<0>(VARNAME##_or_err);
+  auto *VARNAME = (PARSE_CALL).get();                                          \
+  if (!VARNAME) {                                                              \
+    return nullptr;                                                            \
+  }
 
 namespace jnsn {
 std::ostream &operator<<(std::ostream &stream, const parser_error &err) {
@@ -86,79 +64,155 @@ std::ostream &operator<<(std::ostream &stream, const parser_error &err) {
 }
 } // namespace jnsn
 
-std::variant<bool, parser_error> parser_base::advance() {
-  if (!rewind_stack.empty()) {
-    current_token = rewind_stack.top();
-    rewind_stack.pop();
-    return true;
+parser_error parser_base::describe_failure() {
+  auto &f = last_failure;
+  switch (f.kind) {
+  case failure::message:
+    return {f.msg, loc_of(f.at)};
+  case failure::unexpected_token:
+    return {f.msg + to_string(f.at.type) + f.suffix, loc_of(f.at)};
+  case failure::lexing:
+    return {"Lexer Error: " + f.lex_error.message(), f.lex_error.loc};
+  }
+  unreachable("Unknown failure kind");
+}
+
+parser_base::advanced parser_base::advance() {
+  ++work.advances;
+  if (mode == lexing_mode::buffered) {
+    if (token_pos < tokens.size()) {
+      current_token = tokens[token_pos++];
+      return advanced::token;
+    }
+    if (tokens.error) {
+      last_failure.kind = failure::lexing;
+      last_failure.lex_error = *tokens.error;
+      return advanced::failed;
+    }
+    return advanced::eof;
+  }
+  if (lookahead != 0) {
+    --lookahead;
+    current_token = history[(lexed - lookahead - 1) & (history_size - 1)];
+    return advanced::token;
   }
   do {
     lexer_base::result T = next_token();
     if (std::holds_alternative<lexer_base::eof_t>(T)) {
-      return false;
-    } else if (std::holds_alternative<lexer_error>(T)) {
-      auto err = std::get<lexer_error>(T);
-      return parser_error{"Lexer Error: " + err.msg, err.loc};
+      return advanced::eof;
+    } else if (auto *err = std::get_if<lexer_error>(&T)) {
+      last_failure.kind = failure::lexing;
+      last_failure.lex_error = *err;
+      return advanced::failed;
     }
     current_token = std::get<token>(T);
   } while (current_token.type == token_type::LINE_COMMENT ||
            current_token.type == token_type::BLOCK_COMMENT);
-  return true;
+  history[lexed++ & (history_size - 1)] = current_token;
+  return advanced::token;
 }
 
 void parser_base::rewind(token t) {
   assert(t.type != token_type::BLOCK_COMMENT &&
          t.type != token_type::LINE_COMMENT);
-  rewind_stack.emplace(current_token);
+  if (mode == lexing_mode::buffered) {
+    // t is always the token before the current one
+    assert(token_pos >= 2 && tokens.offsets[token_pos - 2] == t.offset);
+    --token_pos;
+    current_token = t;
+    return;
+  }
+  // t is always the token before the current one, which is still in the ring
+  assert(lookahead < max_lookahead && "Rewound more than max_lookahead tokens");
+  ++lookahead;
+  assert(lexed > lookahead &&
+         history[(lexed - lookahead - 1) & (history_size - 1)].offset ==
+             t.offset);
   current_token = t;
 }
 
+template <class nodety>
+node_list<nodety *> parser_base::freeze_children(size_t mark) {
+  assert(mark <= child_stack.size());
+  auto list = nodes.make_list<nodety *>(child_stack.size() - mark);
+  std::transform(child_stack.begin() + mark, child_stack.end(), list.begin(),
+                 [](ast_node *child) { return static_cast<nodety *>(child); });
+  child_stack.resize(mark);
+  return list;
+}
+
+node_list<string_table::entry> parser_base::freeze_strs(size_t mark) {
+  assert(mark <= str_stack.size());
+  auto list = nodes.make_list<string_table::entry>(str_stack.size() - mark);
+  std::copy(str_stack.begin() + mark, str_stack.end(), list.begin());
+  str_stack.resize(mark);
+  return list;
+}
+
 void parser_base::reset() {
   nodes.clear();
-  module = nodes.make_module({0, 0});
-  rewind_stack = {};
+  module = nodes.make_module({});
+  lexed = 0;
+  lookahead = 0;
+  token_pos = 0;
+  pending_ops.clear();
+  operands.clear();
+  work = {};
+  child_stack.clear();
+  str_stack.clear();
+  if (mode == lexing_mode::buffered) {
+    get_lexer().tokenize_all(tokens);
+  }
 }
 
 parser_base::result parser_base::parse(bool verify) {
   reset();
   for (;;) {
     auto adv = advance();
-    if (auto error = is_error(adv)) {
-      return *error;
+    if (adv == advanced::failed) {
+      return describe_failure();
     }
-    if (!std::get<bool>(adv))
+    if (adv == advanced::eof)
       break;
-    SUBPARSE(stmt, parse_statement());
-    module->stmts.emplace_back(stmt);
+    auto *stmt = parse_statement().get();
+    if (!stmt) {
+      return describe_failure();
+    }
+    child_stack.emplace_back(stmt);
   }
+  module->stmts = freeze_children<statement_node>(0);
 
   if (verify) {
     auto report = analyze_js_ast(*module);
     if (report) {
       std::stringstream ss;
       ss << "\n" << report;
-      return parser_error{ss.str(), {0, 0}};
+      return parser_error{ss.str(), {}};
     }
   }
   return module;
 }
 
 static number_literal_node *make_number_expression(token t,
+                                                   source_location loc,
+                                                   string_table::entry text,
+                                                   double value,
                                                    ast_node_store &nodes) {
   number_literal_node *res = nullptr;
   if (t.type == token_type::INT_LITERAL) {
-    res = nodes.make_int_literal(t.loc);
+    res = nodes.make_int_literal(loc);
   } else if (t.type == token_type::FLOAT_LITERAL) {
-    res = nodes.make_float_literal(t.loc);
+    res = nodes.make_float_literal(loc);
   } else if (t.type == token_type::HEX_LITERAL) {
-    res = nodes.make_float_literal(t.loc);
+    res = nodes.make_float_literal(loc);
   } else if (t.type == token_type::OCT_LITERAL) {
-    res = nodes.make_float_literal(t.loc);
+    res = nodes.make_float_literal(loc);
   } else if (t.type == token_type::BIN_LITERAL) {
-    res = nodes.make_float_literal(t.loc);
+    res = nodes.make_float_literal(loc);
   }
   assert(res && "Token not a (known) number literal");
-  res->val = t.text;
+  res->val = text;
+  res->value = value;
   return res;
 }
 
@@ -223,7 +277,7 @@ static bool is_follow_expression(token t) {
   case token_type::TEMPLATE_END:
     return true;
   case token_type::KEYWORD: {
-    switch (lexer_base::get_keyword_type(t)) {
+    switch (t.kw) {
     case keyword_type::kw_typeof:
     case keyword_type::kw_instanceof:
     case keyword_type::kw_in:
@@ -260,11 +314,14 @@ static bool is_unary_prefix_op(token op) {
     return true;
 #include "jnsn/js/operators.def"
   if (op.type == token_type::KEYWORD) {
-    auto kwty = lexer_base::get_keyword_type(op);
+    switch (op.kw) {
 #define PREFIX_OP_KW(TYPE, PRECEDENCE)                                         \
-  if (kwty == keyword_type::kw_##TYPE)                                         \
+  case keyword_type::kw_##TYPE:                                                \
     return true;
 #include "jnsn/js/operators.def"
+    default:
+      break;
+    }
   }
   return false;
 }
@@ -279,11 +336,14 @@ static bool is_binary_operator(token op, bool comma_is_operator = true) {
   }
 #include "jnsn/js/operators.def"
   if (op.type == token_type::KEYWORD) {
-    auto kwty = lexer_base::get_keyword_type(op);
+    switch (op.kw) {
 #define INFIX_OP_KW(TYPE, X, Y)                                                \
-  if (kwty == keyword_type::kw_##TYPE)                                         \
+  case keyword_type::kw_##TYPE:                                                \
     return true;
 #include "jnsn/js/operators.def"
+    default:
+      break;
+    }
   }
   return false;
 }
@@ -305,9 +365,8 @@ static bool is_possible_object_key(token t) {
 }
 
 static bool is_var_decl_kw(token t) {
-  auto kwty = lexer_base::get_keyword_type(t);
-  return kwty == keyword_type::kw_var || kwty == keyword_type::kw_const ||
-         kwty == keyword_type::kw_let;
+  return t.kw == keyword_type::kw_var || t.kw == keyword_type::kw_const ||
+         t.kw == keyword_type::kw_let;
 }
 
 static int get_precedence(token op) {
@@ -316,13 +375,15 @@ static int get_precedence(token op) {
   case token_type::TYPE:                                                       \
     return PRECEDENCE;
 #include "jnsn/js/operators.def"
-  case token_type::KEYWORD: {
-    auto kwty = lexer_base::get_keyword_type(op);
+  case token_type::KEYWORD:
+    switch (op.kw) {
 #define INFIX_OP_KW(TYPE, PRECEDENCE, ASSOCIATIVITY)                           \
-  if (kwty == keyword_type::kw_##TYPE)                                         \
+  case keyword_type::kw_##TYPE:                                                \
     return PRECEDENCE;
 #include "jnsn/js/operators.def"
-  }
+    default:
+      return -1;
+    }
   default:
     return -1; // FIXME more explicit error handling
   }
@@ -336,39 +397,43 @@ static associativity get_associativity(token op) {
     return associativity::ASSOCIATIVITY;
 #include "jnsn/js/operators.def"
   if (op.type == token_type::KEYWORD) {
-    auto kwty = lexer_base::get_keyword_type(op);
+    switch (op.kw) {
 #define INFIX_OP_KW(TYPE, PRECEDENCE, ASSOCIATIVITY)                           \
-  if (kwty == keyword_type::kw_##TYPE)                                         \
+  case keyword_type::kw_##TYPE:                                                \
     return associativity::ASSOCIATIVITY;
 #include "jnsn/js/operators.def"
+    default:
+      break;
+    }
   }
   unreachable("Unknown binary operator");
 }
 
-static unary_expr_node *make_unary_prefix_op(token op, expression_node *value,
+static unary_expr_node *make_unary_prefix_op(token op, source_location loc,
+                                             expression_node *value,
                                              ast_node_store &nodes) {
   assert(is_unary_prefix_op(op));
   unary_expr_node *expr = nullptr;
   if (op.type == token_type::INCR) {
-    expr = nodes.make_prefix_increment(op.loc);
+    expr = nodes.make_prefix_increment(loc);
   } else if (op.type == token_type::DECR) {
-    expr = nodes.make_prefix_decrement(op.loc);
+    expr = nodes.make_prefix_decrement(loc);
   } else if (op.type == token_type::PLUS) {
-    expr = nodes.make_prefix_plus(op.loc);
+    expr = nodes.make_prefix_plus(loc);
   } else if (op.type == token_type::MINUS) {
-    expr = nodes.make_prefix_minus(op.loc);
+    expr = nodes.make_prefix_minus(loc);
   } else if (op.type == token_type::EXMARK) {
-    expr = nodes.make_not_expr(op.loc);
+    expr = nodes.make_not_expr(loc);
   } else if (op.type == token_type::TILDE) {
-    expr = nodes.make_binverse_expr(op.loc);
+    expr = nodes.make_binverse_expr(loc);
   } else if (op.type == token_type::KEYWORD) {
-    auto kwty = lexer_base::get_keyword_type(op);
+    auto kwty = op.kw;
     if (kwty == keyword_type::kw_typeof) {
-      expr = nodes.make_typeof_expr(op.loc);
+      expr = nodes.make_typeof_expr(loc);
     } else if (kwty == keyword_type::kw_void) {
-      expr = nodes.make_void_expr(op.loc);
+      expr = nodes.make_void_expr(loc);
     } else if (kwty == keyword_type::kw_delete) {
-      expr = nodes.make_delete_expr(op.loc);
+      expr = nodes.make_delete_expr(loc);
     }
   }
   assert(expr && "Unary prefix operator not implemented");
@@ -376,95 +441,115 @@ static unary_expr_node *make_unary_prefix_op(token op, expression_node *value,
   return expr;
 }
 
-static bin_op_expr_node *make_binary_expr(token op, expression_node *lhs,
+/// How far an operator extends to the right. The last operand of ?: is an
+/// assignment expression, so it takes in everything but the comma operator.
+static int get_right_precedence(token op) {
+  if (op.type == token_type::QMARK) {
+    return get_precedence(token{token_type::EQ});
+  }
+  return get_precedence(op);
+}
+
+/// Whether operator \p stacked, which comes first, has to be applied before
+/// \p next
+static bool binds_before(token stacked, token next) {
+  auto stacked_prec = get_right_precedence(stacked);
+  auto next_prec = get_precedence(next);
+  return stacked_prec > next_prec ||
+         (stacked_prec == next_prec &&
+          get_associativity(next) == associativity::LEFT_TO_RIGHT);
+}
+
+static bin_op_expr_node *make_binary_expr(token op, source_location loc,
+                                          expression_node *lhs,
                                           expression_node *rhs,
                                           ast_node_store &nodes) {
   assert(is_binary_operator(op));
   bin_op_expr_node *res = nullptr;
   // arithmetic
   if (op.type == token_type::PLUS)
-    res = nodes.make_add(op.loc);
+    res = nodes.make_add(loc);
   if (op.type == token_type::MINUS)
-    res = nodes.make_subtract(op.loc);
+    res = nodes.make_subtract(loc);
   if (op.type == token_type::ASTERISK)
-    res = nodes.make_multiply(op.loc);
+    res = nodes.make_multiply(loc);
   if (op.type == token_type::SLASH)
-    res = nodes.make_divide(op.loc);
+    res = nodes.make_divide(loc);
   if (op.type == token_type::POW)
-    res = nodes.make_pow_expr(op.loc);
+    res = nodes.make_pow_expr(loc);
   if (op.type == token_type::PERCENT)
-    res = nodes.make_modulo_expr(op.loc);
+    res = nodes.make_modulo_expr(loc);
   // comparison
   if (op.type == token_type::LT)
-    res = nodes.make_less_expr(op.loc);
+    res = nodes.make_less_expr(loc);
   if (op.type == token_type::LT_EQ)
-    res = nodes.make_less_eq_expr(op.loc);
+    res = nodes.make_less_eq_expr(loc);
   if (op.type == token_type::GT)
-    res = nodes.make_greater_expr(op.loc);
+    res = nodes.make_greater_expr(loc);
   if (op.type == token_type::GT_EQ)
-    res = nodes.make_greater_eq_expr(op.loc);
+    res = nodes.make_greater_eq_expr(loc);
   if (op.type == token_type::EQEQ)
-    res = nodes.make_equals_expr(op.loc);
+    res = nodes.make_equals_expr(loc);
   if (op.type == token_type::EQEQEQ)
-    res = nodes.make_strong_equals_expr(op.loc);
+    res = nodes.make_strong_equals_expr(loc);
   if (op.type == token_type::NEQ)
-    res = nodes.make_not_equals_expr(op.loc);
+    res = nodes.make_not_equals_expr(loc);
   if (op.type == token_type::NEQEQ)
-    res = nodes.make_strong_not_equals_expr(op.loc);
+    res = nodes.make_strong_not_equals_expr(loc);
   if (op.type == token_type::LOG_AND)
-    res = nodes.make_log_and_expr(op.loc);
+    res = nodes.make_log_and_expr(loc);
   if (op.type == token_type::LOG_OR)
-    res = nodes.make_log_or_expr(op.loc);
+    res = nodes.make_log_or_expr(loc);
   // bitwise
   if (op.type == token_type::LSHIFT)
-    res = nodes.make_lshift_expr(op.loc);
+    res = nodes.make_lshift_expr(loc);
   if (op.type == token_type::RSHIFT)
-    res = nodes.make_rshift_expr(op.loc);
+    res = nodes.make_rshift_expr(loc);
   if (op.type == token_type::LOG_RSHIFT)
-    res = nodes.make_log_rshift_expr(op.loc);
+    res = nodes.make_log_rshift_expr(loc);
   if (op.type == token_type::AMPERSAND)
-    res = nodes.make_bitwise_and_expr(op.loc);
+    res = nodes.make_bitwise_and_expr(loc);
   if (op.type == token_type::VERT_BAR)
-    res = nodes.make_bitwise_or_expr(op.loc);
+    res = nodes.make_bitwise_or_expr(loc);
   if (op.type == token_type::CARET)
-    res = nodes.make_bitwise_xor_expr(op.loc);
+    res = nodes.make_bitwise_xor_expr(loc);
   // assignments
   if (op.type == token_type::EQ)
-    res = nodes.make_assign(op.loc);
+    res = nodes.make_assign(loc);
   if (op.type == token_type::PLUS_EQ)
-    res = nodes.make_add_assign(op.loc);
+    res = nodes.make_add_assign(loc);
   if (op.type == token_type::MINUS_EQ)
-    res = nodes.make_subtract_assign(op.loc);
+    res = nodes.make_subtract_assign(loc);
   if (op.type == token_type::MUL_EQ)
-    res = nodes.make_multiply_assign(op.loc);
+    res = nodes.make_multiply_assign(loc);
   if (op.type == token_type::DIV_EQ)
-    res = nodes.make_divide_assign(op.loc);
+    res = nodes.make_divide_assign(loc);
   if (op.type == token_type::MOD_EQ)
-    res = nodes.make_modulo_assign(op.loc);
+    res = nodes.make_modulo_assign(loc);
   if (op.type == token_type::POW_EQ)
-    res = nodes.make_pow_assign(op.loc);
+    res = nodes.make_pow_assign(loc);
   if (op.type == token_type::LSH_EQ)
-    res = nodes.make_lshift_assign(op.loc);
+    res = nodes.make_lshift_assign(loc);
   if (op.type == token_type::RSH_EQ)
-    res = nodes.make_rshift_assign(op.loc);
+    res = nodes.make_rshift_assign(loc);
   if (op.type == token_type::LOG_RSH_EQ)
-    res = nodes.make_log_rshift_assign(op.loc);
+    res = nodes.make_log_rshift_assign(loc);
   if (op.type == token_type::AND_EQ)
-    res = nodes.make_and_assign(op.loc);
+    res = nodes.make_and_assign(loc);
   if (op.type == token_type::OR_EQ)
-    res = nodes.make_or_assign(op.loc);
+    res = nodes.make_or_assign(loc);
   if (op.type == token_type::CARET_EQ)
-    res = nodes.make_xor_assign(op.loc);
+    res = nodes.make_xor_assign(loc);
   // other
   if (op.type == token_type::COMMA)
-    res = nodes.make_comma_operator(op.loc);
+    res = nodes.make_comma_operator(loc);
   // keyword operators
   if (op.type == token_type::KEYWORD) {
-    auto kwty = lexer_base::get_keyword_type(op);
+    auto kwty = op.kw;
     if (kwty == keyword_type::kw_instanceof)
-      res = nodes.make_instanceof_expr(op.loc);
+      res = nodes.make_instanceof_expr(loc);
     if (kwty == keyword_type::kw_in)
-      res = nodes.make_in_expr(op.loc);
+      res = nodes.make_in_expr(loc);
   }
   assert(res && "make_binary_expr not implemented for operator");
   res->lhs = lhs;
@@ -475,7 +560,7 @@ static bin_op_expr_node *make_binary_expr(token op, expression_node *lhs,
 res<statement_node> parser_base::parse_statement() {
   statement_node *stmt = nullptr;
   if (current_token.type == token_type::SEMICOLON) {
-    return nodes.make_empty_stmt(current_token.loc);
+    return nodes.make_empty_stmt(loc_of(current_token));
   } else if (current_token.type == token_type::BRACE_OPEN) {
     SUBPARSE(block, parse_block());
     return block;
@@ -485,14 +570,14 @@ res<statement_node> parser_base::parse_statement() {
   } else if (current_token.type == token_type::IDENTIFIER) {
     auto ident = current_token;
     auto adv = advance();
-    if (auto error = is_error(adv)) {
-      return *error;
-    } else if (!std::get<bool>(adv)) {
+    if (adv == advanced::failed) {
+      return nullptr;
+    } else if (adv == advanced::eof) {
       SUBPARSE(expr, parse_expression(true));
       stmt = expr;
     } else if (current_token.type == token_type::COLON) {
-      auto *label = nodes.make_label_stmt(current_token.loc);
-      label->label = ident.text;
+      auto *label = nodes.make_label_stmt(loc_of(current_token));
+      label->label = text_of(ident);
       ADVANCE_OR_ERROR("Unexpected EOF after label");
       SUBPARSE(follow, parse_statement());
       label->stmt = follow;
@@ -510,13 +595,11 @@ res<statement_node> parser_base::parse_statement() {
   assert(stmt);
   auto final_token = current_token;
   auto adv = advance();
-  if (auto error = is_error(adv)) {
-    return *error;
-  } else if (std::get<bool>(adv)) {
+  if (adv == advanced::failed) {
+    return nullptr;
+  } else if (adv == advanced::token) {
     if (!is_stmt_end(current_token)) {
-      return parser_error{"Unexpected token after statement: " +
-                              to_string(current_token.type),
-                          current_token.loc};
+      return fail_unexpected("Unexpected token after statement: ");
     }
     if (current_token.type != token_type::SEMICOLON) {
       rewind(final_token);
@@ -527,43 +610,44 @@ res<statement_node> parser_base::parse_statement() {
 
 res<statement_node> parser_base::parse_keyword_stmt() {
   assert(current_token.type == token_type::KEYWORD);
-  auto kwty = lexer_base::get_keyword_type(current_token);
+  auto kwty = current_token.kw;
   if (kwty == keyword_type::kw_function) {
-    return upcast_res<statement_node>(parse_function_stmt());
+    return parse_function_stmt();
   } else if (kwty == keyword_type::kw_if) {
-    return upcast_res<statement_node>(parse_if_stmt());
+    return parse_if_stmt();
   } else if (kwty == keyword_type::kw_do) {
-    return upcast_res<statement_node>(parse_do_while());
+    return parse_do_while();
   } else if (kwty == keyword_type::kw_while) {
-    return upcast_res<statement_node>(parse_while_stmt());
+    return parse_while_stmt();
   } else if (kwty == keyword_type::kw_for) {
-    return upcast_res<statement_node>(parse_for_stmt());
+    return parse_for_stmt();
   } else if (kwty == keyword_type::kw_switch) {
-    return upcast_res<statement_node>(parse_switch_stmt());
+    return parse_switch_stmt();
   } else if (kwty == keyword_type::kw_break) {
-    return nodes.make_break_stmt(current_token.loc); // FIXME break LABEL
+    return nodes.make_break_stmt(loc_of(current_token)); // FIXME break LABEL
   } else if (kwty == keyword_type::kw_continue) {
-    return nodes.make_continue_stmt(current_token.loc); // FIXME continue LABEL
+    // FIXME continue LABEL
+    return nodes.make_continue_stmt(loc_of(current_token));
   } else if (kwty == keyword_type::kw_return) {
-    return upcast_res<statement_node>(parse_return_stmt());
+    return parse_return_stmt();
   } else if (kwty == keyword_type::kw_throw) {
-    return upcast_res<statement_node>(parse_throw_stmt());
+    return parse_throw_stmt();
   } else if (kwty == keyword_type::kw_try) {
-    return upcast_res<statement_node>(parse_try_stmt());
+    return parse_try_stmt();
   } else if (kwty == keyword_type::kw_import) {
-    return upcast_res<statement_node>(parse_import());
+    return parse_import();
   } else if (kwty == keyword_type::kw_export) {
-    return upcast_res<statement_node>(parse_export());
+    return parse_export();
   } else if (kwty == keyword_type::kw_class) {
-    return upcast_res<statement_node>(parse_class_stmt());
+    return parse_class_stmt();
   } else if (kwty == keyword_type::kw_super) {
-    auto *id = nodes.make_identifier_expr(current_token.loc);
-    id->str = current_token.text;
-    return upcast_res<statement_node>(parse_call(id));
+    auto *id = nodes.make_identifier_expr(loc_of(current_token));
+    id->str = text_of(current_token);
+    return parse_call(id);
   } else if (is_var_decl_kw(current_token)) {
-    return upcast_res<statement_node>(parse_var_decl());
+    return parse_var_decl();
   } else {
-    return upcast_res<statement_node>(parse_keyword_expr());
+    return parse_keyword_expr();
   }
 }
 
@@ -577,25 +661,25 @@ res<expression_node> parser_base::parse_keyword_expr() {
 
 res<if_stmt_node> parser_base::parse_if_stmt() {
   assert(current_token.type == token_type::KEYWORD &&
-         lexer_base::get_keyword_type(current_token) == keyword_type::kw_if);
-  auto *if_stmt = nodes.make_if_stmt(current_token.loc);
+         current_token.kw == keyword_type::kw_if);
+  auto *if_stmt = nodes.make_if_stmt(loc_of(current_token));
   ADVANCE_OR_ERROR("Unexpected EOF after if");
-  EXPECT(PAREN_OPEN, nullptr);
+  EXPECT(PAREN_OPEN);
   ADVANCE_OR_ERROR("Unexpected EOF after if (");
   SUBPARSE(condition, parse_expression(true));
   ADVANCE_OR_ERROR("Unexpected EOF after if condition");
-  EXPECT(PAREN_CLOSE, nullptr);
+  EXPECT(PAREN_CLOSE);
   ADVANCE_OR_ERROR("Unexpected EOF. Expected if body");
   SUBPARSE(body, parse_statement());
   if_stmt->condition = condition;
   if_stmt->body = body;
   auto last_token = current_token;
   auto adv = advance();
-  if (auto error = is_error(adv)) {
-    return *error;
-  } else if (std::get<bool>(adv)) {
+  if (adv == advanced::failed) {
+    return nullptr;
+  } else if (adv == advanced::token) {
     if (current_token.type == token_type::KEYWORD &&
-        lexer_base::get_keyword_type(current_token) == keyword_type::kw_else) {
+        current_token.kw == keyword_type::kw_else) {
       ADVANCE_OR_ERROR("Unexpected EOF after else");
       SUBPARSE(else_stmt, parse_statement());
       if_stmt->else_stmt = else_stmt;
@@ -608,21 +692,21 @@ res<if_stmt_node> parser_base::parse_if_stmt() {
 
 res<do_while_node> parser_base::parse_do_while() {
   assert(current_token.type == token_type::KEYWORD &&
-         lexer_base::get_keyword_type(current_token) == keyword_type::kw_do);
-  auto *dowhile_stmt = nodes.make_do_while(current_token.loc);
+         current_token.kw == keyword_type::kw_do);
+  auto *dowhile_stmt = nodes.make_do_while(loc_of(current_token));
   ADVANCE_OR_ERROR("Unexpected EOF after do");
   SUBPARSE(body, parse_statement());
   ADVANCE_OR_ERROR("Unexpected EOF. Expected 'while'");
-  EXPECT(KEYWORD, nullptr);
-  if (lexer_base::get_keyword_type(current_token) != keyword_type::kw_while) {
-    return parser_error{"Expected while after do", current_token.loc};
+  EXPECT(KEYWORD);
+  if (current_token.kw != keyword_type::kw_while) {
+    return fail("Expected while after do");
   }
   ADVANCE_OR_ERROR("Unexpected EOF after do...while");
-  EXPECT(PAREN_OPEN, nullptr);
+  EXPECT(PAREN_OPEN);
   ADVANCE_OR_ERROR("Unexpected EOF after do...while(");
   SUBPARSE(condition, parse_expression(true));
   ADVANCE_OR_ERROR("Unexpected EOF after do...while condition");
-  EXPECT(PAREN_CLOSE, nullptr);
+  EXPECT(PAREN_CLOSE);
   dowhile_stmt->body = body;
   dowhile_stmt->condition = condition;
   return dowhile_stmt;
@@ -630,14 +714,14 @@ res<do_while_node> parser_base::parse_do_while() {
 
 res<while_stmt_node> parser_base::parse_while_stmt() {
   assert(current_token.type == token_type::KEYWORD &&
-         lexer_base::get_keyword_type(current_token) == keyword_type::kw_while);
-  auto *while_stmt = nodes.make_while_stmt(current_token.loc);
+         current_token.kw == keyword_type::kw_while);
+  auto *while_stmt = nodes.make_while_stmt(loc_of(current_token));
   ADVANCE_OR_ERROR("Unexpected EOF after while");
-  EXPECT(PAREN_OPEN, nullptr);
+  EXPECT(PAREN_OPEN);
   ADVANCE_OR_ERROR("Unexpected EOF after while(");
   SUBPARSE(condition, parse_expression(true));
   ADVANCE_OR_ERROR("Unexpected EOF after while condition");
-  EXPECT(PAREN_CLOSE, nullptr);
+  EXPECT(PAREN_CLOSE);
   ADVANCE_OR_ERROR("Unexpected EOF. Expected while body");
   SUBPARSE(body, parse_statement());
   while_stmt->condition = condition;
@@ -647,10 +731,10 @@ res<while_stmt_node> parser_base::parse_while_stmt() {
 
 res<statement_node> parser_base::parse_for_stmt() {
   assert(current_token.type == token_type::KEYWORD &&
-         lexer_base::get_keyword_type(current_token) == keyword_type::kw_for);
+         current_token.kw == keyword_type::kw_for);
   auto for_tok = current_token;
   ADVANCE_OR_ERROR("Unexpected EOF after for");
-  EXPECT(PAREN_OPEN, nullptr);
+  EXPECT(PAREN_OPEN);
   ADVANCE_OR_ERROR("Unexpected EOF after for (");
 
   std::optional<token> keyword;
@@ -658,42 +742,41 @@ res<statement_node> parser_base::parse_for_stmt() {
       is_var_decl_kw(current_token)) {
     keyword = current_token;
     ADVANCE_OR_ERROR("Unexpected EOF after variable decl keyword");
-    EXPECT(IDENTIFIER, nullptr);
+    EXPECT(IDENTIFIER);
   }
   // Try for (... in ... ) or for (... of ...)
   if (current_token.type == token_type::IDENTIFIER) {
     auto var = current_token;
     ADVANCE_OR_ERROR("Unexpected EOF in for head");
     if (current_token.type == token_type::IDENTIFIER &&
-        current_token.text == "of") {
+        text_of(current_token) == "of") {
       ADVANCE_OR_ERROR("Unexpected EOF after for (... of");
       SUBPARSE(iterable, parse_expression(true));
       ADVANCE_OR_ERROR("Unexpected EOF after for (... of <iterable>");
-      EXPECT(PAREN_CLOSE, nullptr);
+      EXPECT(PAREN_CLOSE);
       ADVANCE_OR_ERROR("Unexpected EOF after for (... of <iterable>)");
       SUBPARSE(body, parse_statement());
-      auto *forof = nodes.make_for_of(for_tok.loc);
+      auto *forof = nodes.make_for_of(loc_of(for_tok));
       if (keyword) {
-        forof->keyword = keyword->text;
+        forof->keyword = text_of(*keyword);
       }
-      forof->var = var.text;
+      forof->var = text_of(var);
       forof->iterable = iterable;
       forof->body = body;
       return forof;
     } else if (current_token.type == token_type::KEYWORD &&
-               lexer_base::get_keyword_type(current_token) ==
-                   keyword_type::kw_in) {
+               current_token.kw == keyword_type::kw_in) {
       ADVANCE_OR_ERROR("Unexpected EOF after for (... in");
       SUBPARSE(iterable, parse_expression(true));
       ADVANCE_OR_ERROR("Unexpected EOF after for (... in <iterable>");
-      EXPECT(PAREN_CLOSE, nullptr);
+      EXPECT(PAREN_CLOSE);
       ADVANCE_OR_ERROR("Unexpected EOF after for (... in <iterable>)");
       SUBPARSE(body, parse_statement());
-      auto *forin = nodes.make_for_in(for_tok.loc);
+      auto *forin = nodes.make_for_in(loc_of(for_tok));
       if (keyword) {
-        forin->keyword = keyword->text;
+        forin->keyword = text_of(*keyword);
       }
-      forin->var = var.text;
+      forin->var = text_of(var);
       forin->iterable = iterable;
       forin->body = body;
       return forin;
@@ -706,18 +789,18 @@ res<statement_node> parser_base::parse_for_stmt() {
   }
   // parse c-style for (...;...;...)
   SUBPARSE(pre_stmt, parse_statement());
-  EXPECT(SEMICOLON, nullptr);
+  EXPECT(SEMICOLON);
   ADVANCE_OR_ERROR("Unexpected EOF after for-loop pre-statement");
   SUBPARSE(condition, parse_expression(true));
   ADVANCE_OR_ERROR("Unexpected EOF after for-loop condition");
-  EXPECT(SEMICOLON, nullptr);
+  EXPECT(SEMICOLON);
   ADVANCE_OR_ERROR("Unexpected EOF after for-loop condition;");
   SUBPARSE(latch_stmt, parse_statement());
   ADVANCE_OR_ERROR("Unexpected EOF after for-loop latch stmt");
-  EXPECT(PAREN_CLOSE, nullptr);
+  EXPECT(PAREN_CLOSE);
   ADVANCE_OR_ERROR("Unexpected EOF after for(...)");
   SUBPARSE(body, parse_statement());
-  auto *for_stmt = nodes.make_for_stmt(for_tok.loc);
+  auto *for_stmt = nodes.make_for_stmt(loc_of(for_tok));
   for_stmt->pre_stmt = pre_stmt;
   for_stmt->condition = condition;
   for_stmt->latch_stmt = latch_stmt;
@@ -727,33 +810,31 @@ res<statement_node> parser_base::parse_for_stmt() {
 
 res<switch_stmt_node> parser_base::parse_switch_stmt() {
   assert(current_token.type == token_type::KEYWORD &&
-         lexer_base::get_keyword_type(current_token) ==
-             keyword_type::kw_switch);
-  auto *switch_stmt = nodes.make_switch_stmt(current_token.loc);
+         current_token.kw == keyword_type::kw_switch);
+  auto *switch_stmt = nodes.make_switch_stmt(loc_of(current_token));
   ADVANCE_OR_ERROR("Unexpected EOF after switch");
-  EXPECT(PAREN_OPEN, nullptr);
+  EXPECT(PAREN_OPEN);
   ADVANCE_OR_ERROR("Unexpected EOF after switch (");
   SUBPARSE(value, parse_expression(true));
   switch_stmt->value = value;
   ADVANCE_OR_ERROR("Unexpected EOF after switch value");
-  EXPECT(PAREN_CLOSE, nullptr);
+  EXPECT(PAREN_CLOSE);
   ADVANCE_OR_ERROR("Unexpected EOF after switch (value)");
-  EXPECT(BRACE_OPEN, nullptr);
+  EXPECT(BRACE_OPEN);
   ADVANCE_OR_ERROR("Unexpected EOF after switch (value) {");
   bool hasDefault = false;
+  auto clauses_mark = child_stack.size();
   do {
-    EXPECT_SEVERAL(TYPELIST(token_type::KEYWORD, token_type::BRACE_CLOSE),
-                   nullptr);
+    EXPECT_SEVERAL(TYPELIST(token_type::KEYWORD, token_type::BRACE_CLOSE));
     if (current_token.type == token_type::BRACE_CLOSE) {
       break;
     }
-    auto loc = current_token.loc;
-    auto kwty = lexer_base::get_keyword_type(current_token);
+    auto loc = loc_of(current_token);
+    auto kwty = current_token.kw;
     switch_clause_node *clause = nullptr;
     if (kwty == keyword_type::kw_default) {
       if (hasDefault) {
-        return parser_error{"Switch statement already has a default clause",
-                            current_token.loc};
+        return fail("Switch statement already has a default clause");
       }
       hasDefault = true;
       clause = nodes.make_switch_clause(loc);
@@ -766,14 +847,15 @@ res<switch_stmt_node> parser_base::parse_switch_stmt() {
       ADVANCE_OR_ERROR("Unexpected EOF after case condition");
       clause = case_clause;
     } else {
-      return parser_error{"Unexpected keyword in switch", current_token.loc};
+      return fail("Unexpected keyword in switch");
     }
-    EXPECT(COLON, nullptr);
-    switch_stmt->clauses.emplace_back(clause);
+    EXPECT(COLON);
+    child_stack.emplace_back(clause);
     ADVANCE_OR_ERROR("Unexpected EOF after colon (switch clause)");
+    auto stmts_mark = child_stack.size();
     do {
       if (current_token.type == token_type::KEYWORD) {
-        auto kwty = lexer_base::get_keyword_type(current_token);
+        auto kwty = current_token.kw;
         if (kwty == keyword_type::kw_case || kwty == keyword_type::kw_default) {
           break;
         }
@@ -781,22 +863,23 @@ res<switch_stmt_node> parser_base::parse_switch_stmt() {
         break;
       }
       SUBPARSE(stmt, parse_statement());
-      clause->stmts.emplace_back(stmt);
+      child_stack.emplace_back(stmt);
       ADVANCE_OR_ERROR("Unexpected EOF in switch clauses block");
     } while (true);
+    clause->stmts = freeze_children<statement_node>(stmts_mark);
   } while (true);
+  switch_stmt->clauses = freeze_children<switch_clause_node>(clauses_mark);
   return switch_stmt;
 }
 
 res<return_stmt_node> parser_base::parse_return_stmt() {
   assert(current_token.type == token_type::KEYWORD &&
-         lexer_base::get_keyword_type(current_token) ==
-             keyword_type::kw_return);
-  auto *ret = nodes.make_return_stmt(current_token.loc);
+         current_token.kw == keyword_type::kw_return);
+  auto *ret = nodes.make_return_stmt(loc_of(current_token));
   auto adv = advance();
-  if (auto error = is_error(adv))
-    return *error;
-  if (std::get<bool>(adv) && !is_stmt_end(current_token)) {
+  if (adv == advanced::failed)
+    return nullptr;
+  if (adv == advanced::token && !is_stmt_end(current_token)) {
     SUBPARSE(expr, parse_expression(true));
     ret->value = expr;
   }
@@ -805,8 +888,8 @@ res<return_stmt_node> parser_base::parse_return_stmt() {
 
 res<throw_stmt_node> parser_base::parse_throw_stmt() {
   assert(current_token.type == token_type::KEYWORD &&
-         lexer_base::get_keyword_type(current_token) == keyword_type::kw_throw);
-  auto *thro = nodes.make_throw_stmt(current_token.loc);
+         current_token.kw == keyword_type::kw_throw);
+  auto *thro = nodes.make_throw_stmt(loc_of(current_token));
   ADVANCE_OR_ERROR("Unexpected EOF after throw");
   SUBPARSE(expr, parse_expression(true));
   thro->value = expr;
@@ -815,70 +898,131 @@ res<throw_stmt_node> parser_base::parse_throw_stmt() {
 
 res<try_stmt_node> parser_base::parse_try_stmt() {
   assert(current_token.type == token_type::KEYWORD &&
-         lexer_base::get_keyword_type(current_token) == keyword_type::kw_try);
-  auto *try_stmt = nodes.make_try_stmt(current_token.loc);
+         current_token.kw == keyword_type::kw_try);
+  auto *try_stmt = nodes.make_try_stmt(loc_of(current_token));
   ADVANCE_OR_ERROR("Unexpected EOF after try");
-  EXPECT(BRACE_OPEN, nullptr);
+  EXPECT(BRACE_OPEN);
   SUBPARSE(body, parse_block());
   try_stmt->body = body;
   ADVANCE_OR_ERROR("Unexpected EOF after try {}");
   if (current_token.type == token_type::KEYWORD &&
-      lexer_base::get_keyword_type(current_token) == keyword_type::kw_catch) {
-    auto *ctch = nodes.make_catch(current_token.loc);
+      current_token.kw == keyword_type::kw_catch) {
+    auto *ctch = nodes.make_catch(loc_of(current_token));
     ADVANCE_OR_ERROR("Unexpected EOF after catch");
-    EXPECT(PAREN_OPEN, nullptr);
+    EXPECT(PAREN_OPEN);
     ADVANCE_OR_ERROR("Unexpected EOF after catch(");
-    EXPECT(IDENTIFIER, nullptr);
+    EXPECT(IDENTIFIER);
     auto id = current_token;
     ADVANCE_OR_ERROR("Unexpected EOF after catch(<name>");
-    EXPECT(PAREN_CLOSE, nullptr);
+    EXPECT(PAREN_CLOSE);
     ADVANCE_OR_ERROR("Unexpected EOF after catch(<name>)");
-    EXPECT(BRACE_OPEN, nullptr);
+    EXPECT(BRACE_OPEN);
     SUBPARSE(catch_block, parse_block());
-    ctch->var = id.text;
+    ctch->var = text_of(id);
     ctch->body = catch_block;
     try_stmt->catch_block = ctch;
     auto adv = advance();
-    if (auto error = is_error(adv))
-      return *error;
-    if (!std::get<bool>(adv)) {
+    if (adv == advanced::failed)
+      return nullptr;
+    if (adv == advanced::eof) {
       return try_stmt;
     }
   }
   if (current_token.type == token_type::KEYWORD &&
-      lexer_base::get_keyword_type(current_token) == keyword_type::kw_finally) {
+      current_token.kw == keyword_type::kw_finally) {
     ADVANCE_OR_ERROR("Unexpected EOF after finally");
-    EXPECT(BRACE_OPEN, nullptr);
+    EXPECT(BRACE_OPEN);
     SUBPARSE(finally_block, parse_block());
     try_stmt->finally = finally_block;
   }
   if (!try_stmt->catch_block && !try_stmt->finally) {
-    return parser_error{"Encountered try without any catch or finally block",
-                        current_token.loc};
+    return fail("Encountered try without any catch or finally block");
   }
   return try_stmt;
 }
 
+/// Precedence climbing over the operator tables in operators.def. Operators
+/// wait on pending_ops until one that binds less tightly comes along, so
+/// chains of binary operators take neither recursion nor rewinding.
 res<expression_node> parser_base::parse_expression(bool comma_is_operator) {
+  const auto ops_base = pending_ops.size();
+  const auto operands_base = operands.size();
   SUBPARSE(front, parse_unary_or_atomic_expr());
-  expression_node *expr = front;
-  auto final_token = current_token;
-  auto adv = advance();
-  if (auto error = is_error(adv))
-    return *error;
-  if (!std::get<bool>(adv))
-    return expr;
-  if (is_expression_end(current_token, comma_is_operator)) {
-    rewind(final_token);
-    return expr;
+  operands.push_back(front);
+  work.max_operands = std::max(work.max_operands, operands.size());
+  bool is_binop = false;
+  for (;;) {
+    auto final_token = current_token;
+    auto adv = advance();
+    if (adv == advanced::failed)
+      return nullptr;
+    if (adv == advanced::eof)
+      break;
+    if (is_expression_end(current_token, comma_is_operator)) {
+      rewind(final_token);
+      break;
+    }
+    if (!is_binary_operator(current_token, comma_is_operator)) {
+      if (is_binop) {
+        return fail("Unexpected token after binop expression");
+      }
+      rewind(final_token);
+      break;
+    }
+    auto op = current_token;
+    while (pending_ops.size() != ops_base &&
+           binds_before(pending_ops.back().op, op)) {
+      reduce_bin_op();
+    }
+    pending_op pending{op, loc_of(op), nullptr};
+    ADVANCE_OR_ERROR(
+        "Unexpected EOF. Expected right hand side argument of binary operation");
+    // special case for ternary operator
+    if (op.type == token_type::QMARK) {
+      SUBPARSE(mid, parse_expression(false));
+      ADVANCE_OR_ERROR(
+          "Unexpected EOF. Expected colon for ternary operator (?:)");
+      EXPECT(COLON);
+      ADVANCE_OR_ERROR(
+          "Unexpected EOF. Expected third argument to ternary operator (?:)");
+      pending.mid = mid;
+    }
+    pending_ops.push_back(pending);
+    work.max_pending_ops = std::max(work.max_pending_ops, pending_ops.size());
+    SUBPARSE(rhs, parse_unary_or_atomic_expr());
+    operands.push_back(rhs);
+    work.max_operands = std::max(work.max_operands, operands.size());
+    is_binop = true;
   }
-  if (is_binary_operator(current_token, comma_is_operator)) {
-    return upcast_res<expression_node>(parse_bin_op(expr, comma_is_operator));
+  while (pending_ops.size() != ops_base) {
+    reduce_bin_op();
   }
-  rewind(final_token);
+  assert(operands.size() == operands_base + 1);
+  (void)operands_base;
+  auto *expr = operands.back();
+  operands.pop_back();
   return expr;
 }
 
+/// Replaces the topmost operator and its two operands by their node
+void parser_base::reduce_bin_op() {
+  ++work.reductions;
+  auto pending = pending_ops.back();
+  pending_ops.pop_back();
+  auto *rhs = operands.back();
+  operands.pop_back();
+  auto *&lhs = operands.back();
+  if (pending.op.type == token_type::QMARK) {
+    auto *ternary = nodes.make_ternary_operator(pending.loc);
+    ternary->lhs = lhs;
+    ternary->mid = pending.mid;
+    ternary->rhs = rhs;
+    lhs = ternary;
+  } else {
+    lhs = make_binary_expr(pending.op, pending.loc, lhs, rhs, nodes);
+  }
+}
+
 /// Parses everything with operator precedence >= 16
 res<expression_node> parser_base::parse_unary_or_atomic_expr() {
   expression_node *expr = nullptr;
@@ -886,7 +1030,7 @@ res<expression_node> parser_base::parse_unary_or_atomic_expr() {
     auto op = current_token;
     ADVANCE_OR_ERROR("Unexpected EOF after unary prefix operator");
     SUBPARSE(value, parse_atomic_expr());
-    expr = make_unary_prefix_op(op, value, nodes);
+    expr = make_unary_prefix_op(op, loc_of(op), value, nodes);
   } else {
     SUBPARSE(atomic, parse_atomic_expr());
     expr = atomic;
@@ -902,8 +1046,8 @@ res<expression_node> parser_base::parse_atomic_expr() {
     SUBPARSE(atomic, parse_atomic_keyword_expr());
     expr = atomic;
   } else if (current_token.type == token_type::IDENTIFIER) {
-    auto *id = nodes.make_identifier_expr(current_token.loc);
-    id->str = current_token.text;
+    auto *id = nodes.make_identifier_expr(loc_of(current_token));
+    id->str = text_of(current_token);
     expr = id;
   } else if (current_token.is_number_literal()) {
     SUBPARSE(num, parse_number_literal());
@@ -916,8 +1060,8 @@ res<expression_node> parser_base::parse_atomic_expr() {
     SUBPARSE(tmplt, parse_template_literal());
     expr = tmplt;
   } else if (current_token.type == token_type::REGEX_LITERAL) {
-    auto *regex = nodes.make_regex_literal(current_token.loc);
-    regex->val = current_token.text;
+    auto *regex = nodes.make_regex_literal(loc_of(current_token));
+    regex->val = text_of(current_token);
     expr = regex;
   } else if (current_token.type == token_type::BRACKET_OPEN) {
     SUBPARSE(arr, parse_array_literal());
@@ -929,17 +1073,16 @@ res<expression_node> parser_base::parse_atomic_expr() {
     SUBPARSE(parens, parse_parens_expr());
     expr = parens;
   } else {
-    return parser_error{"Unexpected token: " + to_string(current_token.type) +
-                            ". Expected atomic expression",
-                        current_token.loc};
+    return fail_unexpected("Unexpected token: ",
+                           ". Expected atomic expression");
   }
   /// parse everything up to operator precedence >= 18
   do {
     auto prev_token = current_token;
     auto adv = advance();
-    if (auto error = is_error(adv))
-      return *error;
-    if (std::get<bool>(adv)) {
+    if (adv == advanced::failed)
+      return nullptr;
+    if (adv == advanced::token) {
       if (current_token.type == token_type::DOT) {
         // member access
         SUBPARSE(acc, parse_member_access(expr));
@@ -963,15 +1106,15 @@ res<expression_node> parser_base::parse_atomic_expr() {
   /// parse everything up to operator precedence >= 17
   auto prev_token = current_token;
   auto adv = advance();
-  if (auto error = is_error(adv))
-    return *error;
-  if (std::get<bool>(adv)) {
+  if (adv == advanced::failed)
+    return nullptr;
+  if (adv == advanced::token) {
     if (current_token.type == token_type::INCR) {
-      auto *incr = nodes.make_postfix_increment(current_token.loc);
+      auto *incr = nodes.make_postfix_increment(loc_of(current_token));
       incr->value = expr;
       expr = incr;
     } else if (current_token.type == token_type::DECR) {
-      auto *decr = nodes.make_postfix_decrement(current_token.loc);
+      auto *decr = nodes.make_postfix_decrement(loc_of(current_token));
       decr->value = expr;
       expr = decr;
     } else {
@@ -983,32 +1126,32 @@ res<expression_node> parser_base::parse_atomic_expr() {
 
 res<expression_node> parser_base::parse_parens_expr() {
   assert(current_token.type == token_type::PAREN_OPEN);
-  auto loc = current_token.loc;
+  auto loc = loc_of(current_token);
   ADVANCE_OR_ERROR("Unexpected EOF after opening parenthesis");
   std::optional<token> reason_no_paramlist;
   std::optional<token> rest_param;
-  std::vector<expression_node *> exprs;
+  std::optional<token> rest_dots; // in case they cause an error later
+  auto exprs_mark = child_stack.size();
   if (current_token.type != token_type::PAREN_CLOSE) {
     do {
       token begin = current_token;
       if (current_token.type == token_type::DOTDOTDOT) {
         ADVANCE_OR_ERROR("Unexpected EOF after rest operator");
-        EXPECT(IDENTIFIER, nullptr);
+        EXPECT(IDENTIFIER);
         rest_param = current_token;
-        rest_param->loc = begin.loc; // in case this causes an error later
+        rest_dots = begin;
         ADVANCE_OR_ERROR("Unexpected EOF in param list");
-        EXPECT(PAREN_CLOSE, nullptr);
+        EXPECT(PAREN_CLOSE);
         break;
       }
       SUBPARSE(expr, parse_expression(false));
       if (!reason_no_paramlist && !isa<identifier_expr_node>(expr)) {
         reason_no_paramlist = begin;
       }
-      exprs.emplace_back(expr);
+      child_stack.emplace_back(expr);
       ADVANCE_OR_ERROR(
           "Unexpected EOF before closing parenthesis was encountered");
-      EXPECT_SEVERAL(TYPELIST(token_type::PAREN_CLOSE, token_type::COMMA),
-                     nullptr);
+      EXPECT_SEVERAL(TYPELIST(token_type::PAREN_CLOSE, token_type::COMMA));
       if (current_token.type == token_type::PAREN_CLOSE) {
         break;
       } else if (current_token.type == token_type::COMMA) {
@@ -1017,27 +1160,27 @@ res<expression_node> parser_base::parse_parens_expr() {
       }
     } while (true);
   }
-  EXPECT(PAREN_CLOSE, nullptr);
+  EXPECT(PAREN_CLOSE);
   auto paren_close = current_token;
   auto adv = advance();
-  if (auto error = is_error(adv))
-    return *error;
-  if (std::get<bool>(adv)) {
+  if (adv == advanced::failed)
+    return nullptr;
+  if (adv == advanced::token) {
     if (current_token.type == token_type::ARROW) {
       if (reason_no_paramlist) {
-        return parser_error{"Invalid entry in arrow function param list",
-                            reason_no_paramlist->loc};
+        return fail("Invalid entry in arrow function param list",
+                    *reason_no_paramlist);
       }
-      std::vector<string_table::entry> param_names;
-      std::transform(exprs.begin(), exprs.end(),
-                     std::back_inserter(param_names),
-                     [](expression_node *expr) {
+      auto *params = nodes.make_param_list(loc);
+      params->names = nodes.make_list<string_table::entry>(child_stack.size() -
+                                                           exprs_mark);
+      std::transform(child_stack.begin() + exprs_mark, child_stack.end(),
+                     params->names.begin(), [](ast_node *expr) {
                        return static_cast<identifier_expr_node *>(expr)->str;
                      });
-      auto *params = nodes.make_param_list(loc);
-      params->names = param_names;
+      child_stack.resize(exprs_mark);
       if (rest_param) {
-        params->rest = rest_param->text;
+        params->rest = text_of(*rest_param);
       }
       ADVANCE_OR_ERROR("Unexpected EOF after arrow");
       statement_node *body = nullptr;
@@ -1057,111 +1200,51 @@ res<expression_node> parser_base::parse_parens_expr() {
     rewind(paren_close);
   }
   if (rest_param) {
-    return parser_error{"Unexpected token", rest_param->loc};
+    return fail("Unexpected token", *rest_dots);
   }
-  auto *expr = exprs.front();
-  auto it = exprs.begin();
-  ++it;
-  while (it != exprs.end()) {
+  assert(child_stack.size() > exprs_mark);
+  auto *expr = static_cast<expression_node *>(child_stack[exprs_mark]);
+  for (auto i = exprs_mark + 1; i < child_stack.size(); ++i) {
     auto *comma =
         nodes.make_comma_operator(expr->loc); // FIXME bad location estimation
     comma->lhs = expr;
-    comma->rhs = *it;
+    comma->rhs = static_cast<expression_node *>(child_stack[i]);
     expr = comma;
-    ++it;
   }
+  child_stack.resize(exprs_mark);
   return expr;
 }
 
-res<bin_op_expr_node> parser_base::parse_bin_op(expression_node *lhs,
-                                                bool comma_is_operator) {
-  auto op = current_token;
-  assert(is_binary_operator(op, comma_is_operator));
-  ADVANCE_OR_ERROR(
-      "Unexpected EOF. Expected right hand side argument of binary operation");
-  bin_op_expr_node *binop = nullptr;
-  // special case for ternary operator
-  if (op.type == token_type::QMARK) {
-    SUBPARSE(mid, parse_expression(false));
-    ADVANCE_OR_ERROR(
-        "Unexpected EOF. Expected colon for ternary operator (?:)");
-    EXPECT(COLON, nullptr);
-    ADVANCE_OR_ERROR(
-        "Unexpected EOF. Expected third argument to ternary operator (?:)");
-    SUBPARSE(rhs, parse_expression(false));
-
-    auto *ternary = nodes.make_ternary_operator(op.loc);
-    ternary->lhs = lhs;
-    ternary->mid = mid;
-    ternary->rhs = rhs;
-    binop = ternary;
-  } else {
-    SUBPARSE(rhs, parse_unary_or_atomic_expr());
-    binop = make_binary_expr(op, lhs, rhs, nodes);
-  }
-
-  auto prev_token = current_token;
-  auto adv = advance();
-  if (auto error = is_error(adv))
-    return *error;
-  if (!std::get<bool>(adv))
-    return binop;
-  if (is_expression_end(current_token, comma_is_operator)) {
-    rewind(prev_token);
-    return binop;
-  }
-  // Extend rhs if followed by stronger-binding operator
-  if (is_binary_operator(current_token, comma_is_operator)) {
-    auto current_prec = get_precedence(op);
-    auto next_prec = get_precedence(current_token);
-    if (next_prec > current_prec) {
-      SUBPARSE(new_rhs, parse_bin_op(binop->rhs, comma_is_operator));
-      binop->rhs = new_rhs;
-    } else if (next_prec == current_prec &&
-               get_associativity(op) == associativity::RIGHT_TO_LEFT) {
-      SUBPARSE(new_rhs, parse_bin_op(binop->rhs, comma_is_operator));
-      binop->rhs = new_rhs;
-    } else {
-      SUBPARSE(new_binop, parse_bin_op(binop, comma_is_operator));
-      binop = new_binop;
-    }
-    return binop;
-  }
-
-  return parser_error{"Unexpected token after binop expression",
-                      current_token.loc};
-}
-
 res<expression_node> parser_base::parse_atomic_keyword_expr() {
-  EXPECT(KEYWORD, nullptr);
-  auto kwty = get_lexer().get_keyword_type(current_token);
+  EXPECT(KEYWORD);
+  auto kwty = current_token.kw;
   if (kwty == keyword_type::kw_null) {
-    return nodes.make_null_literal(current_token.loc);
+    return nodes.make_null_literal(loc_of(current_token));
   } else if (kwty == keyword_type::kw_true) {
-    return nodes.make_true_literal(current_token.loc);
+    return nodes.make_true_literal(loc_of(current_token));
   } else if (kwty == keyword_type::kw_false) {
-    return nodes.make_false_literal(current_token.loc);
+    return nodes.make_false_literal(loc_of(current_token));
   } else if (kwty == keyword_type::kw_class) {
-    return upcast_res<expression_node>(parse_class_expr());
+    return parse_class_expr();
   } else if (kwty == keyword_type::kw_function) {
-    return upcast_res<expression_node>(parse_function_expr());
+    return parse_function_expr();
   } else if (kwty == keyword_type::kw_new) {
-    return upcast_res<expression_node>(parse_new_keyword());
+    return parse_new_keyword();
   } else {
-    return parser_error{"Not implemented (keyword)", current_token.loc};
+    return fail("Not implemented (keyword)");
   }
 }
 
 res<expression_node> parser_base::parse_new_keyword() {
   assert(current_token.type == token_type::KEYWORD &&
-         lexer_base::get_keyword_type(current_token) == keyword_type::kw_new);
-  auto loc = current_token.loc;
+         current_token.kw == keyword_type::kw_new);
+  auto loc = loc_of(current_token);
   ADVANCE_OR_ERROR("Unexpected EOF after new");
   if (current_token.type == token_type::DOT) {
     ADVANCE_OR_ERROR("Unexpected EOF after new.");
-    EXPECT(IDENTIFIER, nullptr);
-    if (static_cast<std::string_view>(current_token.text) != "target") {
-      return parser_error{"Expected new.target after new.", current_token.loc};
+    EXPECT(IDENTIFIER);
+    if (static_cast<std::string_view>(text_of(current_token)) != "target") {
+      return fail("Expected new.target after new.");
     }
     return nodes.make_new_target(loc);
   }
@@ -1179,95 +1262,105 @@ res<expression_node> parser_base::parse_new_keyword() {
 
 res<statement_node> parser_base::parse_import() {
   assert(current_token.type == token_type::KEYWORD &&
-         lexer_base::get_keyword_type(current_token) ==
-             keyword_type::kw_import);
-  return parser_error{"Not implemented (parse_import)", current_token.loc};
+         current_token.kw == keyword_type::kw_import);
+  return fail("Not implemented (parse_import)");
 }
 
 res<statement_node> parser_base::parse_export() {
   assert(current_token.type == token_type::KEYWORD &&
-         lexer_base::get_keyword_type(current_token) ==
-             keyword_type::kw_export);
-  return parser_error{"Not implemented (parse_export)", current_token.loc};
+         current_token.kw == keyword_type::kw_export);
+  return fail("Not implemented (parse_export)");
 }
 
 res<class_stmt_node> parser_base::parse_class_stmt() {
   assert(current_token.type == token_type::KEYWORD &&
-         lexer_base::get_keyword_type(current_token) == keyword_type::kw_class);
-  return parser_error{"Not implemented (parse_class_stmt)", current_token.loc};
+         current_token.kw == keyword_type::kw_class);
+  return fail("Not implemented (parse_class_stmt)");
 }
 
 res<number_literal_node> parser_base::parse_number_literal() {
   auto literal = current_token;
-  auto res = make_number_expression(current_token, nodes);
-  res->val = current_token.text;
+  auto res = make_number_expression(current_token, loc_of(current_token),
+                                    text_of(current_token),
+                                    value_of(current_token), nodes);
   auto adv = advance();
-  if (auto error = is_error(adv))
-    return *error;
-  bool eof = !std::get<bool>(adv);
+  if (adv == advanced::failed)
+    return nullptr;
+  bool eof = adv == advanced::eof;
   if (eof || is_follow_expression(current_token)) {
     if (!eof) {
       rewind(literal);
     }
     return res;
   }
-  return parser_error{"Unexpected token after number literal",
-                      current_token.loc};
+  return fail("Unexpected token after number literal");
 }
 
 res<string_literal_node> parser_base::parse_string_literal() {
   assert(current_token.type == token_type::STRING_LITERAL ||
          current_token.type == token_type::TEMPLATE_STRING);
   auto str = current_token;
-  auto res = nodes.make_string_literal(current_token.loc);
-  res->val = current_token.text;
+  auto res = nodes.make_string_literal(loc_of(current_token));
+  res->val = text_of(current_token);
+  res->value = cooked_text_of(current_token);
   auto adv = advance();
-  if (auto error = is_error(adv))
-    return *error;
-  bool eof = !std::get<bool>(adv);
+  if (adv == advanced::failed)
+    return nullptr;
+  bool eof = adv == advanced::eof;
   if (eof || is_follow_expression(current_token)) {
     if (!eof) {
       rewind(str);
     }
     return res;
   }
-  return parser_error{"Unexpected token after string literal",
-                      current_token.loc};
+  return fail("Unexpected token after string literal");
 }
 
 res<template_literal_node> parser_base::parse_template_literal() {
   assert(current_token.type == token_type::TEMPLATE_HEAD);
-  auto *tmplt = nodes.make_template_literal(current_token.loc);
-  tmplt->strs.emplace_back(current_token.text);
+  auto *tmplt = nodes.make_template_literal(loc_of(current_token));
+  // Texts and cooked values are pushed in pairs
+  auto strs_mark = str_stack.size();
+  auto exprs_mark = child_stack.size();
+  str_stack.emplace_back(text_of(current_token));
+  str_stack.emplace_back(cooked_text_of(current_token));
   do {
     ADVANCE_OR_ERROR("Unexpected EOF in template literal");
     SUBPARSE(expr, parse_expression(true));
-    tmplt->exprs.emplace_back(expr);
+    child_stack.emplace_back(expr);
     ADVANCE_OR_ERROR(
         "Unexpected EOF after interpolated expression in template literal");
     EXPECT_SEVERAL(
-        TYPELIST(token_type::TEMPLATE_MIDDLE, token_type::TEMPLATE_END),
-        nullptr);
-    tmplt->strs.emplace_back(current_token.text);
+        TYPELIST(token_type::TEMPLATE_MIDDLE, token_type::TEMPLATE_END));
+    str_stack.emplace_back(text_of(current_token));
+    str_stack.emplace_back(cooked_text_of(current_token));
   } while (current_token.type == token_type::TEMPLATE_MIDDLE);
+  tmplt->exprs = freeze_children<expression_node>(exprs_mark);
+  auto num_strs = (str_stack.size() - strs_mark) / 2;
+  tmplt->strs = nodes.make_list<string_table::entry>(num_strs);
+  tmplt->values = nodes.make_list<string_table::entry>(num_strs);
+  for (size_t i = 0; i < num_strs; ++i) {
+    tmplt->strs[i] = str_stack[strs_mark + 2 * i];
+    tmplt->values[i] = str_stack[strs_mark + 2 * i + 1];
+  }
+  str_stack.resize(strs_mark);
   assert(tmplt->strs.size() == tmplt->exprs.size() + 1);
   return tmplt;
 }
 
 res<function_stmt_node> parser_base::parse_function_stmt() {
   assert(current_token.type == token_type::KEYWORD &&
-         lexer_base::get_keyword_type(current_token) ==
-             keyword_type::kw_function);
-  auto func = nodes.make_function_stmt(current_token.loc);
+         current_token.kw == keyword_type::kw_function);
+  auto func = nodes.make_function_stmt(loc_of(current_token));
   ADVANCE_OR_ERROR("Unexpected EOF while parsing function");
-  EXPECT(IDENTIFIER, nullptr);
-  func->name = current_token.text;
+  EXPECT(IDENTIFIER);
+  func->name = text_of(current_token);
   ADVANCE_OR_ERROR("Unexpected EOF while parsing function");
-  EXPECT(PAREN_OPEN, nullptr);
+  EXPECT(PAREN_OPEN);
   SUBPARSE(params, parse_param_list());
   func->params = params;
   ADVANCE_OR_ERROR("Unexpected EOF while parsing function");
-  EXPECT(BRACE_OPEN, nullptr);
+  EXPECT(BRACE_OPEN);
   SUBPARSE(body, parse_block());
   func->body = body;
   return func;
@@ -1275,19 +1368,18 @@ res<function_stmt_node> parser_base::parse_function_stmt() {
 
 res<function_expr_node> parser_base::parse_function_expr() {
   assert(current_token.type == token_type::KEYWORD &&
-         lexer_base::get_keyword_type(current_token) ==
-             keyword_type::kw_function);
-  auto func = nodes.make_function_expr(current_token.loc);
+         current_token.kw == keyword_type::kw_function);
+  auto func = nodes.make_function_expr(loc_of(current_token));
   ADVANCE_OR_ERROR("Unexpected EOF while parsing function");
   if (current_token.type == token_type::IDENTIFIER) {
-    func->name = current_token.text;
+    func->name = text_of(current_token);
     ADVANCE_OR_ERROR("Unexpected EOF while parsing function");
   }
-  EXPECT(PAREN_OPEN, nullptr);
+  EXPECT(PAREN_OPEN);
   SUBPARSE(params, parse_param_list());
   func->params = params;
   ADVANCE_OR_ERROR("Unexpected EOF while parsing function");
-  EXPECT(BRACE_OPEN, nullptr);
+  EXPECT(BRACE_OPEN);
   SUBPARSE(body, parse_block());
   func->body = body;
   return func;
@@ -1295,24 +1387,26 @@ res<function_expr_node> parser_base::parse_function_expr() {
 
 res<class_expr_node> parser_base::parse_class_expr() {
   assert(current_token.type == token_type::KEYWORD &&
-         lexer_base::get_keyword_type(current_token) == keyword_type::kw_class);
-  return parser_error{"Not implemented (parse_class_expr)", current_token.loc};
+         current_token.kw == keyword_type::kw_class);
+  return fail("Not implemented (parse_class_expr)");
 }
 
 res<param_list_node> parser_base::parse_param_list() {
   assert(current_token.type == token_type::PAREN_OPEN);
-  auto node = nodes.make_param_list(current_token.loc);
+  auto node = nodes.make_param_list(loc_of(current_token));
+  auto names_mark = str_stack.size();
   do {
     ADVANCE_OR_ERROR("Unexpected EOF while parsing parameter list");
     if (current_token.type == token_type::IDENTIFIER) {
-      node->names.emplace_back(current_token.text);
+      str_stack.emplace_back(text_of(current_token));
       ADVANCE_OR_ERROR("Unexpected EOF while parsing parameter list");
     }
   } while (current_token.type == token_type::COMMA);
+  node->names = freeze_strs(names_mark);
   if (current_token.type == token_type::DOTDOTDOT) {
     ADVANCE_OR_ERROR("Unexpected EOF while parsing parameter list");
     if (current_token.type == token_type::IDENTIFIER) {
-      node->rest = current_token.text;
+      node->rest = text_of(current_token);
       ADVANCE_OR_ERROR("Unexpected EOF while parsing parameter list");
     }
   }
@@ -1320,38 +1414,41 @@ res<param_list_node> parser_base::parse_param_list() {
     return node;
   }
 
-  return parser_error{"Unexpected token in parameter list", current_token.loc};
+  return fail("Unexpected token in parameter list");
 }
 
 res<block_node> parser_base::parse_block() {
-  EXPECT(BRACE_OPEN, nullptr);
-  auto block = nodes.make_block(current_token.loc);
+  EXPECT(BRACE_OPEN);
+  auto block = nodes.make_block(loc_of(current_token));
   ADVANCE_OR_ERROR("Unexpected EOF while parsing block");
+  auto stmts_mark = child_stack.size();
   while (current_token.type != token_type::BRACE_CLOSE) {
     assert(current_token.type != token_type::BRACE_OPEN);
     SUBPARSE(stmt, parse_statement());
-    block->stmts.emplace_back(stmt);
+    child_stack.emplace_back(stmt);
     ADVANCE_OR_ERROR("Unexpected EOF while parsing block");
   }
+  block->stmts = freeze_children<statement_node>(stmts_mark);
   return block;
 }
 
 res<var_decl_node> parser_base::parse_var_decl() {
   assert(is_var_decl_kw(current_token));
-  auto decl = nodes.make_var_decl(current_token.loc);
-  decl->keyword = current_token.text;
+  auto decl = nodes.make_var_decl(loc_of(current_token));
+  decl->keyword = text_of(current_token);
   ADVANCE_OR_ERROR("Unecpected EOF while parsing variable declaration");
-  EXPECT(IDENTIFIER, nullptr);
-  auto *part = nodes.make_var_decl_part(current_token.loc);
+  EXPECT(IDENTIFIER);
+  auto *part = nodes.make_var_decl_part(loc_of(current_token));
   auto id = current_token;
-  part->name = id.text;
-  decl->parts.emplace_back(part);
+  part->name = text_of(id);
+  auto parts_mark = child_stack.size();
+  child_stack.emplace_back(part);
   do {
     auto end_token = current_token;
     auto adv = advance();
-    if (auto error = is_error(adv))
-      return *error;
-    if (std::get<bool>(adv)) {
+    if (adv == advanced::failed)
+      return nullptr;
+    if (adv == advanced::token) {
       if (current_token.type == token_type::EQ) {
         ADVANCE_OR_ERROR(
             "Unexpected EOF in variable initialization. Expected expression");
@@ -1359,10 +1456,10 @@ res<var_decl_node> parser_base::parse_var_decl() {
         part->init = init;
       } else if (current_token.type == token_type::COMMA) {
         ADVANCE_OR_ERROR("Unexpected EOF in variable declaration");
-        EXPECT(IDENTIFIER, nullptr);
-        part = nodes.make_var_decl_part(current_token.loc);
-        part->name = current_token.text;
-        decl->parts.emplace_back(part);
+        EXPECT(IDENTIFIER);
+        part = nodes.make_var_decl_part(loc_of(current_token));
+        part->name = text_of(current_token);
+        child_stack.emplace_back(part);
       } else {
         rewind(end_token);
         break;
@@ -1371,18 +1468,20 @@ res<var_decl_node> parser_base::parse_var_decl() {
       break;
     }
   } while (true);
+  decl->parts = freeze_children<var_decl_part_node>(parts_mark);
   return decl;
 }
 
 res<array_literal_node> parser_base::parse_array_literal() {
   assert(current_token.type == token_type::BRACKET_OPEN);
   ADVANCE_OR_ERROR("Unexpected EOF inside array literal");
-  auto *array = nodes.make_array_literal(current_token.loc);
+  auto *array = nodes.make_array_literal(loc_of(current_token));
+  auto values_mark = child_stack.size();
   if (current_token.type != token_type::BRACKET_CLOSE) {
     do {
       expression_node *expr = nullptr;
       if (current_token.type == token_type::DOTDOTDOT) {
-        auto *spread = nodes.make_spread_expr(current_token.loc);
+        auto *spread = nodes.make_spread_expr(loc_of(current_token));
         ADVANCE_OR_ERROR("Unexpected EOF after spread operator");
         SUBPARSE(tail, parse_expression(false));
         spread->list = tail;
@@ -1391,10 +1490,9 @@ res<array_literal_node> parser_base::parse_array_literal() {
         SUBPARSE(sub, parse_expression(false));
         expr = sub;
       }
-      array->values.emplace_back(expr);
+      child_stack.emplace_back(expr);
       ADVANCE_OR_ERROR("Unexpected EOF inside array literal");
-      EXPECT_SEVERAL(TYPELIST(token_type::BRACKET_CLOSE, token_type::COMMA),
-                     nullptr);
+      EXPECT_SEVERAL(TYPELIST(token_type::BRACKET_CLOSE, token_type::COMMA));
       if (current_token.type == token_type::BRACKET_CLOSE) {
         break;
       }
@@ -1403,60 +1501,62 @@ res<array_literal_node> parser_base::parse_array_literal() {
       }
     } while (true);
   }
+  array->values = freeze_children<expression_node>(values_mark);
   return array;
 }
 
 res<object_literal_node> parser_base::parse_object_literal() {
   assert(current_token.type == token_type::BRACE_OPEN);
-  auto *object = nodes.make_object_literal(current_token.loc);
+  auto *object = nodes.make_object_literal(loc_of(current_token));
   ADVANCE_OR_ERROR("Unexpected EOF in object literal");
+  auto entries_mark = child_stack.size();
   do {
     if (current_token.type == token_type::BRACE_CLOSE) {
       break;
     } else if (current_token.type == token_type::DOTDOTDOT) {
-      auto *spread = nodes.make_spread_expr(current_token.loc);
+      auto *spread = nodes.make_spread_expr(loc_of(current_token));
       ADVANCE_OR_ERROR("Unexpected EOF after spread operator");
       SUBPARSE(expr, parse_expression(false));
       spread->list = expr;
-      object->entries.emplace_back(spread);
+      child_stack.emplace_back(spread);
     } else if (is_possible_object_key(current_token)) {
       auto id = current_token;
       ADVANCE_OR_ERROR("Unexpected EOF in object literal");
       if (current_token.type != token_type::COLON) {
-        auto *expr = nodes.make_identifier_expr(id.loc);
-        expr->str = id.text;
-        object->entries.emplace_back(expr);
+        auto *expr = nodes.make_identifier_expr(loc_of(id));
+        expr->str = text_of(id);
+        child_stack.emplace_back(expr);
         rewind(id);
       } else {
         ADVANCE_OR_ERROR("Unexpected EOF in object literal");
-        auto *entry = nodes.make_object_entry(id.loc);
-        entry->key = id.text;
+        auto *entry = nodes.make_object_entry(loc_of(id));
+        entry->key = text_of(id);
         SUBPARSE(val, parse_expression(false));
         entry->val = val;
-        object->entries.emplace_back(entry);
+        child_stack.emplace_back(entry);
       }
     } else {
-      return parser_error{"Unexpected token", current_token.loc};
+      return fail("Unexpected token");
     }
     ADVANCE_OR_ERROR("Unexpected EOF in object literal");
-    EXPECT_SEVERAL(TYPELIST(token_type::BRACE_CLOSE, token_type::COMMA),
-                   nullptr);
+    EXPECT_SEVERAL(TYPELIST(token_type::BRACE_CLOSE, token_type::COMMA));
     if (current_token.type == token_type::COMMA) {
       ADVANCE_OR_ERROR("Unexpected EOF in object literal");
     }
   } while (true);
-  EXPECT(BRACE_CLOSE, nullptr);
+  EXPECT(BRACE_CLOSE);
+  object->entries = freeze_children<expression_node>(entries_mark);
   return object;
 }
 
 res<computed_member_access_node>
 parser_base::parse_computed_access(expression_node *base) {
-  auto *access = nodes.make_computed_member_access(current_token.loc);
+  auto *access = nodes.make_computed_member_access(loc_of(current_token));
   assert(current_token.type == token_type::BRACKET_OPEN);
   ADVANCE_OR_ERROR("Unexpected EOF inside computed member access");
   SUBPARSE(member, parse_expression(true));
   ADVANCE_OR_ERROR("Unexpected EOF inside computed member access");
-  EXPECT(BRACKET_CLOSE, nullptr);
+  EXPECT(BRACKET_CLOSE);
   access->base = base;
   access->member = member;
   return access;
@@ -1464,18 +1564,18 @@ parser_base::parse_computed_access(expression_node *base) {
 res<member_access_node>
 parser_base::parse_member_access(expression_node *base) {
   assert(current_token.type == token_type::DOT);
-  auto *node = nodes.make_member_access(current_token.loc);
+  auto *node = nodes.make_member_access(loc_of(current_token));
   ADVANCE_OR_ERROR("Unexpected EOF while parsing member access");
-  EXPECT(IDENTIFIER, nullptr);
+  EXPECT(IDENTIFIER);
   node->base = base;
-  node->member = current_token.text;
+  node->member = text_of(current_token);
   return node;
 }
 
 res<call_expr_node> parser_base::parse_call(expression_node *callee) {
   assert(current_token.type == token_type::PAREN_OPEN);
-  auto *call = nodes.make_call_expr(current_token.loc);
-  auto *args = nodes.make_argument_list(current_token.loc);
+  auto *call = nodes.make_call_expr(loc_of(current_token));
+  auto *args = nodes.make_argument_list(loc_of(current_token));
   call->callee = callee;
   call->args = args;
 
@@ -1483,19 +1583,20 @@ res<call_expr_node> parser_base::parse_call(expression_node *callee) {
   if (current_token.type == token_type::PAREN_CLOSE) {
     return call;
   }
+  auto values_mark = child_stack.size();
   do {
     SUBPARSE(arg, parse_expression(false));
-    args->values.emplace_back(arg);
+    child_stack.emplace_back(arg);
     ADVANCE_OR_ERROR("Unexpected EOF in argument list");
     if (current_token.type == token_type::COMMA) {
       ADVANCE_OR_ERROR("Unexpected EOF in argument list");
     } else if (current_token.type == token_type::PAREN_CLOSE) {
       break;
     } else {
-      return parser_error{"Unexpected token in argument list",
-                          current_token.loc};
+      return fail("Unexpected token in argument list");
     }
   } while (true);
   assert(current_token.type == token_type::PAREN_CLOSE);
+  args->values = freeze_children<expression_node>(values_mark);
   return call;
 }
@@ -0,0 +1,186 @@
+#include "jnsn/js/scan.h"
+#include "char_class.h"
+#include "jnsn/util.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define JNSN_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace jnsn {
+namespace scan {
+
+/// Scalar kernels. The vector kernels use them for their tails.
+static const char *find_any_scalar(const char *it, const char *end, char a,
+                                   char b, char c, char d) {
+  for (; it != end; ++it) {
+    if (*it == a || *it == b || *it == c || *it == d) {
+      break;
+    }
+  }
+  return it;
+}
+static const char *skip_space_scalar(const char *it, const char *end) {
+  while (it != end && is_space(*it)) {
+    ++it;
+  }
+  return it;
+}
+static const char *skip_ident_scalar(const char *it, const char *end) {
+  while (it != end && is_ident_part(*it)) {
+    ++it;
+  }
+  return it;
+}
+
+#ifdef JNSN_SCAN_X86
+/// Bit mask with one bit per lane of a vector of the given width
+static constexpr unsigned lane_mask(unsigned width) {
+  return width == 32 ? ~0u : (1u << width) - 1;
+}
+
+/// Generates the kernels for one vector width. All of them look at a whole
+/// vector of units at once, turn the matching lanes into a bit mask and
+/// stop at its lowest set bit.
+/// Unsigned "x <= max" is spelled min(x, max) == x, since there is no
+/// unsigned byte comparison before AVX-512.
+#define VECTOR_KERNELS(ISA, TARGET, VEC, WIDTH, PREFIX, SI, MOVEMASK)          \
+  __attribute__((target(TARGET))) static const char *find_any_##ISA(           \
+      const char *it, const char *end, char a, char b, char c, char d) {       \
+    const VEC va = PREFIX##_set1_epi8(a), vb = PREFIX##_set1_epi8(b);          \
+    const VEC vc = PREFIX##_set1_epi8(c), vd = PREFIX##_set1_epi8(d);          \
+    for (; end - it >= WIDTH; it += WIDTH) {                                   \
+      VEC v = PREFIX##_loadu_##SI(reinterpret_cast<const VEC *>(it));          \
+      VEC hit = PREFIX##_or_##SI(                                              \
+          PREFIX##_or_##SI(PREFIX##_cmpeq_epi8(v, va),                         \
+                           PREFIX##_cmpeq_epi8(v, vb)),                        \
+          PREFIX##_or_##SI(PREFIX##_cmpeq_epi8(v, vc),                         \
+                           PREFIX##_cmpeq_epi8(v, vd)));                       \
+      if (unsigned mask = MOVEMASK(hit)) {                                     \
+        return it + __builtin_ctz(mask);                                       \
+      }                                                                        \
+    }                                                                          \
+    return find_any_scalar(it, end, a, b, c, d);                               \
+  }                                                                            \
+  __attribute__((target(TARGET))) static unsigned space_mask_##ISA(VEC v) {    \
+    const VEC tab = PREFIX##_set1_epi8('\t');                                  \
+    const VEC four = PREFIX##_set1_epi8('\r' - '\t');                          \
+    VEC ctrl = PREFIX##_sub_epi8(v, tab);                                      \
+    VEC is_ctrl = PREFIX##_cmpeq_epi8(PREFIX##_min_epu8(ctrl, four), ctrl);    \
+    VEC is_blank = PREFIX##_cmpeq_epi8(v, PREFIX##_set1_epi8(' '));            \
+    return MOVEMASK(PREFIX##_or_##SI(is_ctrl, is_blank));                      \
+  }                                                                            \
+  __attribute__((target(TARGET))) static const char *skip_space_##ISA(         \
+      const char *it, const char *end) {                                       \
+    for (; end - it >= WIDTH; it += WIDTH) {                                   \
+      VEC v = PREFIX##_loadu_##SI(reinterpret_cast<const VEC *>(it));          \
+      if (unsigned mask = ~space_mask_##ISA(v) & lane_mask(WIDTH)) {           \
+        return it + __builtin_ctz(mask);                                       \
+      }                                                                        \
+    }                                                                          \
+    return skip_space_scalar(it, end);                                         \
+  }                                                                            \
+  __attribute__((target(TARGET))) static unsigned ident_mask_##ISA(VEC v) {    \
+    VEC lower = PREFIX##_or_##SI(v, PREFIX##_set1_epi8(0x20));                 \
+    VEC alpha = PREFIX##_sub_epi8(lower, PREFIX##_set1_epi8('a'));             \
+    VEC is_alpha = PREFIX##_cmpeq_epi8(                                        \
+        PREFIX##_min_epu8(alpha, PREFIX##_set1_epi8('z' - 'a')), alpha);       \
+    VEC digit = PREFIX##_sub_epi8(v, PREFIX##_set1_epi8('0'));                 \
+    VEC is_digit = PREFIX##_cmpeq_epi8(                                        \
+        PREFIX##_min_epu8(digit, PREFIX##_set1_epi8('9' - '0')), digit);       \
+    VEC is_other = PREFIX##_or_##SI(                                           \
+        PREFIX##_or_##SI(PREFIX##_cmpeq_epi8(v, PREFIX##_set1_epi8('_')),      \
+                         PREFIX##_cmpeq_epi8(v, PREFIX##_set1_epi8('$'))),     \
+        PREFIX##_cmpeq_epi8(v, PREFIX##_set1_epi8('\\')));                     \
+    return MOVEMASK(                                                           \
+        PREFIX##_or_##SI(PREFIX##_or_##SI(is_alpha, is_digit), is_other));     \
+  }                                                                            \
+  __attribute__((target(TARGET))) static const char *skip_ident_##ISA(         \
+      const char *it, const char *end) {                                       \
+    for (; end - it >= WIDTH; it += WIDTH) {                                   \
+      VEC v = PREFIX##_loadu_##SI(reinterpret_cast<const VEC *>(it));          \
+      if (unsigned mask = ~ident_mask_##ISA(v) & lane_mask(WIDTH)) {           \
+        return it + __builtin_ctz(mask);                                       \
+      }                                                                        \
+    }                                                                          \
+    return skip_ident_scalar(it, end);                                         \
+  }
+
+#define MOVEMASK_SSE2(V) static_cast<unsigned>(_mm_movemask_epi8(V))
+#define MOVEMASK_AVX2(V) static_cast<unsigned>(_mm256_movemask_epi8(V))
+VECTOR_KERNELS(sse2, "sse2", __m128i, 16, _mm, si128, MOVEMASK_SSE2)
+VECTOR_KERNELS(avx2, "avx2", __m256i, 32, _mm256, si256, MOVEMASK_AVX2)
+#undef MOVEMASK_SSE2
+#undef MOVEMASK_AVX2
+#undef VECTOR_KERNELS
+#endif // JNSN_SCAN_X86
+
+namespace {
+struct kernels {
+  isa set;
+  const char *(*find_any)(const char *, const char *, char, char, char, char);
+  const char *(*skip_space)(const char *, const char *);
+  const char *(*skip_ident)(const char *, const char *);
+};
+} // namespace
+
+static kernels get_kernels(isa set) {
+  switch (set) {
+  case isa::scalar:
+    return {set, find_any_scalar, skip_space_scalar, skip_ident_scalar};
+#ifdef JNSN_SCAN_X86
+  case isa::sse2:
+    return {set, find_any_sse2, skip_space_sse2, skip_ident_sse2};
+  case isa::avx2:
+    return {set, find_any_avx2, skip_space_avx2, skip_ident_avx2};
+#else
+  default:
+    break;
+#endif
+  }
+  unreachable("Instruction set not available in this build");
+}
+
+isa best_isa() {
+#ifdef JNSN_SCAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return isa::avx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return isa::sse2;
+  }
+#endif
+  return isa::scalar;
+}
+
+const char *isa_name(isa set) {
+  switch (set) {
+  case isa::scalar:
+    return "scalar";
+  case isa::sse2:
+    return "sse2";
+  case isa::avx2:
+    return "avx2";
+  }
+  unreachable("Unknown instruction set");
+}
+
+static kernels active = get_kernels(best_isa());
+
+void use_isa(isa set) { active = get_kernels(set); }
+isa active_isa() { return active.set; }
+
+const char *find_any(const char *begin, const char *end, char a, char b,
+                     char c, char d) {
+  return active.find_any(begin, end, a, b, c, d);
+}
+const char *skip_space(const char *begin, const char *end) {
+  return active.skip_space(begin, end);
+}
+const char *skip_ident(const char *begin, const char *end) {
+  return active.skip_ident(begin, end);
+}
+
+} // namespace scan
+} // namespace jnsn
@@ -0,0 +1,112 @@
+#include "jnsn/source_manager.h"
+#include "jnsn/js/scan.h"
+#include <algorithm>
+
+using namespace jnsn;
+
+void source_manager::index(buffer &b) {
+  b.newlines.clear();
+  b.returns.clear();
+  auto *begin = b.text.data();
+  auto *end = begin + b.text.size();
+  for (auto *it = begin;; ++it) {
+    it = scan::find_any(it, end, '\n', '\r');
+    if (it == end) {
+      break;
+    }
+    auto &offsets = *it == '\n' ? b.newlines : b.returns;
+    offsets.push_back(uint32_t(b.window_offset + (it - begin)));
+  }
+  b.indexed = true;
+}
+
+source_manager::file_id source_manager::add_buffer(std::string_view text,
+                                                   std::string name) {
+  assert(has_room(text.size()) && "Out of source locations");
+  stream_open = false;
+  buffers.push_back({std::move(name), uint32_t(next_base()), text.size(),
+                     text});
+  return buffers.size() - 1;
+}
+
+source_manager::file_id source_manager::add_stream(std::string name) {
+  auto file = add_buffer({}, std::move(name));
+  stream_open = true;
+  return file;
+}
+
+void source_manager::extend_stream(file_id file, std::string_view text) {
+  assert(stream_open && file + 1 == buffers.size() &&
+         "Only the last buffer can grow");
+  auto &b = buffers[file];
+  auto size = b.window_offset + text.size();
+  assert(size >= b.size && "Streams cannot shrink");
+  assert(has_room(size - b.size) && "Out of source locations");
+  b.text = text;
+  b.size = size;
+  b.indexed = false;
+}
+
+void source_manager::drop_stream_prefix(file_id file, size_t offset) {
+  assert(stream_open && file + 1 == buffers.size() &&
+         "Only the last buffer is a stream");
+  auto &b = buffers[file];
+  assert(offset >= b.window_offset && offset <= b.size);
+  // Only the lines of the dropped units are counted, they are never
+  // indexed
+  auto *begin = b.text.data();
+  auto *end = begin + (offset - b.window_offset);
+  for (auto *it = begin;; ++it) {
+    it = scan::find_any(it, end, '\n', '\r');
+    if (it == end) {
+      break;
+    }
+    if (*it == '\n') {
+      ++b.rows_before;
+      b.line_begin = b.window_offset + (it - begin) + 1;
+      b.line_returns = 0;
+    } else {
+      ++b.line_returns;
+    }
+  }
+  b.text = {};
+  b.window_offset = offset;
+  b.indexed = false;
+  b.newlines.clear();
+  b.returns.clear();
+}
+
+decoded_location source_manager::decode(source_location loc) {
+  if (!loc.is_valid()) {
+    return {};
+  }
+  auto it = std::upper_bound(
+      buffers.begin(), buffers.end(), loc.get_raw(),
+      [](uint32_t raw, const buffer &b) { return raw < b.base; });
+  assert(it != buffers.begin() && "Location is not from this manager");
+  auto &b = *--it;
+  size_t offset = loc.get_raw() - b.base;
+  assert(offset <= b.size && "Location is not from this manager");
+  decoded_location res;
+  res.file = uint32_t(it - buffers.begin());
+  res.offset = offset;
+  if (offset < b.window_offset) {
+    return res;
+  }
+  if (!b.indexed) {
+    index(b);
+  }
+  // The line break itself still belongs to the line it ends
+  auto line = std::lower_bound(b.newlines.begin(), b.newlines.end(), offset);
+  size_t line_begin = b.line_begin;
+  size_t returns = b.line_returns;
+  if (line != b.newlines.begin()) {
+    line_begin = line[-1] + 1;
+    returns = 0;
+  }
+  returns += std::lower_bound(b.returns.begin(), b.returns.end(), offset) -
+             std::lower_bound(b.returns.begin(), b.returns.end(), line_begin);
+  res.row = b.rows_before + (line - b.newlines.begin()) + 1;
+  res.col = offset - line_begin - returns + 1;
+  return res;
+}
@@ -0,0 +1,183 @@
+#include "jnsn/js/ast_file.h"
+#include "jnsn/js/ast_ops.h"
+#include "jnsn/js/ast_walker.h"
+#include "parse_utils.h"
+#include "gtest/gtest.h"
+#include <cstdlib>
+#include <sstream>
+#include <unistd.h>
+
+using namespace jnsn;
+using namespace std;
+
+static const char *const programs[] = {
+    "/.*/.test('abc')",
+    "",
+    "let x = 1, y = 0x1f, z = 0o17, w = 0b101, f = 1.5e3",
+    "let s = 'a\\tb' + \"c\\\"d\" + `1${2}3${`4${5}`}\\n`",
+    "'use strict'; x = y",
+    "if (false) if (false) 1; else 2;",
+    "for (var i = 0; i < 10; ++i) 1;",
+    "for (let i in [1, 2, 3]) 1;",
+    "for (i of [1, 2, 3]) 1;",
+    "while(false) { 1; }",
+    "do 1; while (false);",
+    "switch(1) {case 2: 3; break; 4; break; default: 5;}",
+    "try {} catch(e) { throw {a} } finally {}",
+    "function test(arg1, arg2) { return arg1 ? arg2 : arg1 + arg2; }",
+    "(function() {}); (test) => console.log(test); (...args) => null",
+    "let x = {a, b, ...c, i: 5}; let arr = [1, ...a, 3, ...b]",
+    "a[i].x = b[j].y; window[1,'console'].log(4); new target(1, 2)",
+    "new.target; new target; a = b = c = 1 * 3 - d / e",
+    "a ? b ? c ? 1 : 2 : 3 : 4; a in A; a instanceof A",
+    "!i; +i++; -i; ~i; --i; i--; typeof i; void i; delete i",
+    "{ label: window, console.log(1) }",
+};
+
+class ast_file_test : public ::testing::Test {
+protected:
+  constant_string_parser parser;
+
+  module_node *parse(const char *text) {
+    parser.lexer.set_text(text);
+    auto res = parser.parse();
+    if (auto *err = get_if<parser_error>(&res)) {
+      ADD_FAILURE() << text << ": " << *err;
+      return nullptr;
+    }
+    return get<module_node *>(res);
+  }
+};
+
+static string to_json(const ast_node *node) {
+  stringstream ss;
+  ss << ast_to_json(node);
+  return ss.str();
+}
+
+/// Everything about every node that ast_to_json doesn't print
+struct node_details : public ast_walker<node_details> {
+  stringstream out;
+  // Every node has one of these types as its root type
+#define NODE(NAME, CHILD_NODES)                                                \
+  bool on_enter(const NAME##_node &node) {                                     \
+    out << get_ast_node_typename(node) << '@' << node.loc.get_raw() << ' ';    \
+    return true;                                                               \
+  }
+#define DERIVED(NAME, ANCESTOR, CHILD_NODES)
+#include "jnsn/js/ast.def"
+  bool on_enter(const number_literal_node &node) {
+    out << node.value << ' ';
+    return true;
+  }
+  bool on_enter(const string_literal_node &node) {
+    out << '"' << node.value << "\" ";
+    return true;
+  }
+  bool on_enter(const template_string_node &node) {
+    out << '`' << node.value << "` ";
+    return true;
+  }
+  bool on_enter(const template_literal_node &node) {
+    for (auto value : node.values) {
+      out << '`' << value << "` ";
+    }
+    return true;
+  }
+};
+static string details_of(const ast_node &node) {
+  node_details details;
+  details.visit(node);
+  return details.out.str();
+}
+
+TEST_F(ast_file_test, round_trip) {
+  for (auto *program : programs) {
+    auto *mod = parse(program);
+    ASSERT_TRUE(mod);
+    auto start = parser.start_location();
+    auto data = write_ast(*mod, start);
+
+    ast_node_store store;
+    auto res = read_ast(data, store, start);
+    ASSERT_TRUE(holds_alternative<module_node *>(res))
+        << program << ": " << get<string>(res);
+    auto *loaded = get<module_node *>(res);
+    ASSERT_EQ(to_json(loaded), to_json(mod)) << program;
+    ASSERT_EQ(details_of(*loaded), details_of(*mod)) << program;
+    // Encoding again gives the same bytes
+    ASSERT_EQ(write_ast(*loaded, start), data) << program;
+  }
+}
+
+TEST_F(ast_file_test, locations_are_relative) {
+  auto *mod = parse("a;\n  b + c;");
+  auto data = write_ast(*mod, parser.start_location());
+  // Loaded somewhere else, locations move along
+  ast_node_store store;
+  auto res = read_ast(data, store, source_location(1000));
+  ASSERT_TRUE(holds_alternative<module_node *>(res));
+  auto *loaded = get<module_node *>(res);
+  ASSERT_FALSE(loaded->loc.is_valid());
+  ASSERT_EQ(loaded->stmts[0]->loc.get_raw(), 1000u);
+  ASSERT_EQ(loaded->stmts[1]->loc.get_raw(),
+            1000u + parser.decode(mod->stmts[1]->loc).offset);
+}
+
+TEST_F(ast_file_test, mapped_file) {
+  auto *mod = parse(programs[13]);
+  auto start = parser.start_location();
+  char path[] = "/tmp/jnsn_ast_file_testXXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(fd, -1);
+  auto data = write_ast(*mod, start);
+  ASSERT_EQ(write(fd, data.data(), data.size()), (ssize_t)data.size());
+  close(fd);
+
+  mapped_ast_file file;
+  auto err = file.open(path, start);
+  unlink(path);
+  ASSERT_FALSE(err) << *err;
+  ASSERT_EQ(to_json(file.get_root()), to_json(mod));
+  ASSERT_EQ(details_of(*file.get_root()), details_of(*mod));
+  ASSERT_TRUE(file.open("/nonexistent/file.jast", start));
+  ASSERT_EQ(file.get_root(), nullptr);
+}
+
+TEST_F(ast_file_test, rejects_bad_files) {
+  auto *mod = parse(programs[16]);
+  auto data = write_ast(*mod, parser.start_location());
+  ast_node_store store;
+  auto fails = [&](const string &bad) {
+    return holds_alternative<string>(read_ast(bad, store, {}));
+  };
+  // Every prefix is missing something
+  for (size_t size = 0; size < data.size(); ++size) {
+    ASSERT_TRUE(fails(data.substr(0, size))) << size;
+  }
+  ASSERT_TRUE(fails(data + '\0'));
+  auto with_header = [&](auto change) {
+    auto bad = data;
+    ast_file_header header;
+    memcpy(&header, bad.data(), sizeof(header));
+    change(header);
+    memcpy(bad.data(), &header, sizeof(header));
+    return bad;
+  };
+  ASSERT_TRUE(fails(with_header([](auto &h) { h.magic[0] = 'X'; })));
+  ASSERT_TRUE(fails(with_header([](auto &h) { ++h.version; })));
+  ASSERT_TRUE(fails(with_header([](auto &h) { ++h.schema; })));
+  ASSERT_TRUE(fails(with_header([](auto &h) { ++h.node_count; })));
+  ASSERT_TRUE(fails(with_header([](auto &h) { --h.node_count; })));
+  // Whatever a corrupted byte does, reading must not crash
+  for (size_t i = sizeof(ast_file_header); i < data.size(); ++i) {
+    for (int bit = 0; bit < 8; ++bit) {
+      auto bad = data;
+      bad[i] ^= 1 << bit;
+      auto res = read_ast(bad, store, {});
+      if (auto *loaded = get_if<module_node *>(&res)) {
+        to_json(*loaded);
+      }
+    }
+  }
+}
@@ -26,3 +26,32 @@ TEST(ast_ops_test, isa) {
     ASSERT_FALSE(isa<expression_node>(node));
   }
 }
+
+/// Checks isa<> of \p node against every node type
+template <class nodety> static void check_isa_all(const ast_node &node) {
+#define NODE(NAME, CHILDREN)                                                   \
+  EXPECT_EQ(isa<NAME##_node>(node), (std::is_base_of_v<NAME##_node, nodety>))  \
+      << get_ast_node_typename(node) << " isa " #NAME;
+#define DERIVED(NAME, EXTENDS, CHILDREN) NODE(NAME, CHILDREN)
+#include "jnsn/js/ast.def"
+}
+
+TEST(ast_ops_test, isa_hierarchy) {
+#define NODE(NAME, CHILDREN)                                                   \
+  {                                                                            \
+    auto node = NAME##_node({});                                               \
+    check_isa_all<NAME##_node>(node);                                          \
+  }
+#define DERIVED(NAME, EXTENDS, CHILDREN) NODE(NAME, CHILDREN)
+#include "jnsn/js/ast.def"
+}
+
+TEST(ast_ops_test, typename) {
+#define NODE(NAME, CHILDREN)                                                   \
+  {                                                                            \
+    auto node = NAME##_node({});                                               \
+    ASSERT_STREQ(get_ast_node_typename(node), #NAME);                          \
+  }
+#define DERIVED(NAME, EXTENDS, CHILDREN) NODE(NAME, CHILDREN)
+#include "jnsn/js/ast.def"
+}
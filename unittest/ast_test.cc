@@ -34,21 +34,20 @@ TEST(ast_test, walker) {
   auto *node = store.make_module({});
   auto *block1 = store.make_block({});
   auto *block2 = store.make_block({});
-  node->stmts.emplace_back(block1);
-  node->stmts.emplace_back(block2);
+  node->stmts = store.make_list<statement_node *>({block1, block2});
   struct walker : public ast_walker<walker> {
     std::stringstream &ss;
     walker(std::stringstream &ss) : ss(ss) {}
-    bool on_enter(const module_node &mod) override {
+    bool on_enter(const module_node &mod) {
       ss << "enter mod;";
       return true;
     }
-    void on_leave(const module_node &mod) override { ss << "leave mod;"; }
-    bool on_enter(const block_node &mod) override {
+    void on_leave(const module_node &mod) { ss << "leave mod;"; }
+    bool on_enter(const block_node &mod) {
       ss << "enter block;";
       return true;
     }
-    void on_leave(const block_node &mod) override { ss << "leave block;"; }
+    void on_leave(const block_node &mod) { ss << "leave block;"; }
   } wlk(ss);
   wlk.visit(*node);
   ASSERT_STREQ(
@@ -60,19 +59,50 @@ TEST(ast_test, walker) {
   struct walker2 : public ast_walker<walker2> {
     std::stringstream &ss;
     walker2(std::stringstream &ss) : ss(ss) {}
-    bool on_enter(const module_node &mod) override {
+    bool on_enter(const module_node &mod) {
       ss << "enter mod;";
       return false;
     }
-    void on_leave(const module_node &mod) override { ss << "leave mod;"; }
-    bool on_enter(const block_node &mod) override {
+    void on_leave(const module_node &mod) { ss << "leave mod;"; }
+    bool on_enter(const block_node &mod) {
       ss << "enter block;";
       return true;
     }
-    void on_leave(const block_node &mod) override { ss << "leave block;"; }
+    void on_leave(const block_node &mod) { ss << "leave block;"; }
   } wlk2(ss);
   wlk2.visit(*node);
   ASSERT_STREQ(ss.str().c_str(), "enter mod;leave mod;");
+
+  // Handlers of an ancestor type are called for derived nodes, too
+  struct statement_counter : public ast_walker<statement_counter> {
+    size_t entered = 0;
+    size_t left = 0;
+    bool on_enter(const statement_node &) {
+      ++entered;
+      return true;
+    }
+    void on_leave(const statement_node &) { ++left; }
+  } counter;
+  counter.visit(*node);
+  ASSERT_EQ(counter.entered, 2u);
+  ASSERT_EQ(counter.left, 2u);
+
+  // Const handlers are found, too. Handlers that take no node type, e.g.
+  // `on_enter(const ast_node &)`, fail to compile.
+  struct const_walker : public ast_walker<const_walker> {
+    std::stringstream &ss;
+    const_walker(std::stringstream &ss) : ss(ss) {}
+    bool on_enter(const block_node &) const {
+      ss << "enter block;";
+      return true;
+    }
+    void on_leave(const module_node &) const { ss << "leave mod;"; }
+  } wlk3(ss);
+  ss.str("");
+  wlk3.visit(*node);
+  ASSERT_STREQ(ss.str().c_str(), "enter block;enter block;leave mod;");
+  static_assert(has_enter_handler<const_walker, block_node>::value);
+  static_assert(!has_enter_handler<const_walker, statement_node>::value);
 }
 
 TEST(ast_test, node_store) {
@@ -81,7 +111,7 @@ TEST(ast_test, node_store) {
   name_checker checker;
   auto res = checker.visit(*node);
   ASSERT_STREQ(res, "module");
-  // stress test container insertion
+  // stress test list creation
   constexpr int mod_count = 5000;
   constexpr int stmt_count = 100;
   std::vector<module_node *> modules;
@@ -91,16 +121,42 @@ TEST(ast_test, node_store) {
   }
   auto *stmt = store.make_empty_stmt({});
   for (auto *mod : modules) {
-    for (int i = 0; i < stmt_count; i++) {
-      mod->stmts.emplace_back(stmt);
-    }
+    mod->stmts = store.make_list<statement_node *>(stmt_count);
+    std::fill(mod->stmts.begin(), mod->stmts.end(), stmt);
   }
   for (int i = 0; i < mod_count; i++) {
     store.make_module({});
   }
   for (auto *mod : modules) {
     ASSERT_EQ(mod->stmts.size(), (size_t)stmt_count);
+    ASSERT_EQ(mod->stmts.back(), stmt);
+  }
+}
+
+TEST(ast_test, node_store_sizes) {
+  ast_node_store store;
+  ASSERT_EQ(store.bytes_used(), 0u);
+  store.make_null_literal({});
+  auto small = store.bytes_used();
+  ASSERT_GE(small, sizeof(null_literal_node));
+  store.make_class_expr({});
+  ASSERT_LT(small, store.bytes_used() - small);
+
+  // clear() destroys the nodes, but keeps their memory for the next ones
+  for (int i = 0; i < 10000; i++) {
+    store.make_module({})->stmts =
+        store.make_list<statement_node *>({store.make_empty_stmt({})});
+  }
+  auto used = store.bytes_used();
+  auto reserved = store.bytes_reserved();
+  ASSERT_GE(reserved, used);
+  store.clear();
+  ASSERT_EQ(store.bytes_used(), 0u);
+  for (int i = 0; i < 10000; i++) {
+    store.make_module({})->stmts =
+        store.make_list<statement_node *>({store.make_empty_stmt({})});
   }
+  ASSERT_EQ(store.bytes_reserved(), reserved);
 }
 
 TEST(ast_test, printing) {
@@ -1,10 +1,26 @@
 // stackoverflow.com/questions/16491675/how-to-send-custom-message-in-google-c-testing-framework
+#include <cstdarg>
+#include <cstdio>
 #include <sstream>
 
 namespace testing {
 namespace internal {
 enum GTestColor { COLOR_DEFAULT, COLOR_RED, COLOR_GREEN, COLOR_YELLOW };
 
-extern void ColoredPrintf(GTestColor color, const char *fmt, ...);
+// Recent googletest versions no longer export their ColoredPrintf, so we
+// bring our own (ANSI escapes only)
+inline void ColoredPrintf(GTestColor color, const char *fmt, ...) {
+  static const char *codes[] = {"", "\033[0;31m", "\033[0;32m", "\033[0;33m"};
+  va_list args;
+  va_start(args, fmt);
+  if (color != COLOR_DEFAULT) {
+    std::printf("%s", codes[color]);
+  }
+  std::vprintf(fmt, args);
+  if (color != COLOR_DEFAULT) {
+    std::printf("\033[m");
+  }
+  va_end(args);
+}
 } // namespace internal
-} // namespace testing
\ No newline at end of file
+} // namespace testing
@@ -4,21 +4,19 @@
 namespace jnsn {
 ///
 ///
-class constant_string_lexer : public lexer_base {
-  const char *it;
-  read_t read_unit() override {
-    read_t res;
-    if (*it != '\0') {
-      res = {*it};
-      ++it;
-    }
-    return res;
-  }
+class constant_string_lexer : public source_lexer<constant_string_lexer> {
+  std::string_view text;
 
 public:
+  static constexpr bool stable_text = true;
+  std::string_view source_text() const { return text; }
   void set_text(const char *text) {
-    reset();
-    it = text;
+    this->text = text;
+    load();
+  }
+  void edit_text(const char *text) {
+    this->text = text;
+    load_edited();
   }
 };
 } // namespace jnsn
@@ -1,6 +1,13 @@
 #include "lex_utils.h"
 #include "gtest/gtest.h"
+#include <cmath>
+#include <cstdlib>
 #include <initializer_list>
+#include <iterator>
+#include <map>
+#include <random>
+#include <unistd.h>
+#include <vector>
 
 using namespace jnsn;
 using namespace std;
@@ -17,6 +24,28 @@ TEST_F(string_table_test, keywords) {
 #include "jnsn/js/keywords.def"
 #define KEYWORD(NAME) ASSERT_EQ(NAME##_handle.data(), NAME##_handle2.data());
 #include "jnsn/js/keywords.def"
+#define KEYWORD(NAME) ASSERT_EQ(NAME##_handle.id(), NAME##_handle2.id());
+#include "jnsn/js/keywords.def"
+}
+
+TEST_F(string_table_test, dense_ids) {
+  std::vector<string_table::entry> handles;
+  for (int i = 0; i < 1000; ++i) {
+    handles.emplace_back(str_table.get_handle(std::to_string(i)));
+    ASSERT_EQ(handles.back().id(), (string_table::id_type)i);
+  }
+  ASSERT_EQ(str_table.size(), 1000u);
+  for (int i = 0; i < 1000; ++i) {
+    auto h = str_table.get_handle(std::to_string(i));
+    ASSERT_EQ(h, handles[i]);
+    ASSERT_EQ(h.data(), handles[i].data());
+    ASSERT_EQ(str_table[h.id()].data(), h.data());
+  }
+  ASSERT_EQ(str_table.size(), 1000u);
+  auto borrowed = string_table::get_borrowed_handle("17");
+  ASSERT_FALSE(borrowed.is_interned());
+  ASSERT_EQ(borrowed, handles[17]);
+  ASSERT_NE(borrowed, handles[18]);
 }
 
 class lexer_test : public ::testing::Test {
@@ -26,15 +55,15 @@ protected:
 
 #define TOKEN_SEQUENCE(INPUT, ...)                                             \
   do {                                                                         \
-    std::initializer_list<token> expected_tokens = {__VA_ARGS__};              \
     lexer.set_text(INPUT);                                                     \
+    std::initializer_list<token> expected_tokens = {__VA_ARGS__};              \
     for (auto &expected : expected_tokens) {                                   \
       auto res = lexer.next();                                                 \
       ASSERT_TRUE(std::holds_alternative<token>(res))                          \
           << "Details:\n  Actual: " << res << "\nExpected: " << expected;      \
       auto tok = std::get<token>(res);                                         \
       ASSERT_EQ(tok.type, expected.type);                                      \
-      ASSERT_EQ(tok.text, expected.text);                                      \
+      ASSERT_EQ(lexer.text_of(tok), lexer.text_of(expected));                  \
     }                                                                          \
     auto res = lexer.next();                                                   \
     ASSERT_TRUE(std::holds_alternative<lexer_base::eof_t>(res));               \
@@ -90,6 +119,54 @@ TEST_F(lexer_test, numbers) {
   LEXER_ERROR("1e-");
 }
 
+TEST_F(lexer_test, number_values) {
+  const std::pair<const char *, double> literals[] = {
+      {"0", 0},
+      {"42", 42},
+      {"1.5", 1.5},
+      {".25", .25},
+      {"123.", 123.},
+      {"123e1", 1230},
+      {"1e-3", 1e-3},
+      {"0.000001", 1e-6},
+      {"9007199254740993", 9007199254740992.},
+      {"123456789012345678901234567890", 123456789012345678901234567890.},
+      {"1e400", HUGE_VAL},
+      {"2.2250738585072011e-308", 2.2250738585072011e-308},
+      {"0x1f", 31},
+      {"0XFF", 255},
+      {"0o17", 15},
+      {"0b101", 5},
+      {"0x20000000000001", 9007199254740992.},
+      {"0x20000000000003", 9007199254740996.},
+      {"0x10000000000000000000000000001", 0x1p112}};
+  for (auto &literal : literals) {
+    lexer.set_text(literal.first);
+    auto res = lexer.next();
+    ASSERT_TRUE(std::holds_alternative<token>(res)) << literal.first;
+    ASSERT_EQ(lexer.value_of(std::get<token>(res)), literal.second)
+        << literal.first;
+    ASSERT_EQ(lexer.text_of(std::get<token>(res)), literal.first);
+  }
+  ASSERT_EQ(lexer.value_of(TOKEN(FLOAT_LITERAL, "2.5")), 2.5);
+  // Decimal literals decode like strtod, which rounds correctly
+  std::mt19937 gen(3);
+  for (int i = 0; i < 20000; ++i) {
+    std::string text = std::to_string(gen() % 100000000);
+    if (gen() % 2) {
+      text += '.' + std::to_string(gen());
+    }
+    if (gen() % 2) {
+      text += "e-" + std::to_string(gen() % 40);
+    } else if (gen() % 2) {
+      text += "e" + std::to_string(gen() % 40);
+    }
+    lexer.set_text(text.c_str());
+    auto tok = std::get<token>(lexer.next());
+    ASSERT_EQ(lexer.value_of(tok), std::strtod(text.c_str(), nullptr)) << text;
+  }
+}
+
 TEST_F(lexer_test, comments) {
   TOKEN_SEQUENCE("abc // test", TOKEN(IDENTIFIER, "abc"),
                  TOKEN(LINE_COMMENT, "// test"));
@@ -98,8 +175,11 @@ TEST_F(lexer_test, comments) {
 }
 
 TEST_F(lexer_test, operators) {
+  // A slash only divides after an operand
 #define TOKEN_TYPE(NAME, STR)                                                  \
-  if (string{STR} != "" && string{STR} != ".") {                               \
+  if (string{STR}[0] == '/') {                                                 \
+    TOKEN_SEQUENCE("x " STR, TOKEN(IDENTIFIER, "x"), TOKEN(NAME, ""));         \
+  } else if (string{STR} != "" && string{STR} != ".") {                        \
     SINGLE_NOTEXT_TOKEN(STR, NAME);                                            \
   }
 #include "jnsn/js/tokens.def"
@@ -155,11 +235,110 @@ TEST_F(lexer_test, templates) {
                  TOKEN(INT_LITERAL, "0"), TOKEN(BRACE_CLOSE, ""));
 }
 
+TEST_F(lexer_test, string_values) {
+  const std::pair<const char *, std::string> literals[] = {
+      {"'abc'", "abc"},
+      {"\"\"", ""},
+      {"'a\\nb\\t\\\\'", "a\nb\t\\"},
+      {"'\\'\\\"\\q'", "'\"q"},
+      {"'\\0'", std::string(1, '\0')},
+      {"'\\x41\\u00e9\\u{1F600}'", "A\u00e9\U0001F600"},
+      {"'\\uD83D\\uDE00'", "\U0001F600"},
+      {"'\\x41}'", "A}"},
+      {"'a\\\nb'", "ab"},
+      {"'a\\\r\nb'", "ab"},
+      {"`x\\u{41}y`", "xAy"},
+      {"`\\\n`", ""}};
+  for (auto &literal : literals) {
+    lexer.set_text(literal.first);
+    auto res = lexer.next();
+    ASSERT_TRUE(std::holds_alternative<token>(res)) << literal.first;
+    auto tok = std::get<token>(res);
+    ASSERT_EQ(lexer.cooked_text_of(tok), literal.second) << literal.first;
+  }
+  // Literals without escape sequences are views into the source
+  const char *unescaped = "'abc'";
+  lexer.set_text(unescaped);
+  auto tok = std::get<token>(lexer.next());
+  ASSERT_EQ(lexer.cooked_text_of(tok).data(), unescaped + 1);
+  ASSERT_FALSE(lexer.cooked_text_of(tok).is_interned());
+  lexer.set_text("`a${b}c\\n${d}e`");
+  const char *parts[] = {"a", "c\n", "e"};
+  for (auto *part : parts) {
+    auto tok = std::get<token>(lexer.next());
+    ASSERT_EQ(lexer.cooked_text_of(tok), part);
+    lexer.next();
+  }
+  ASSERT_EQ(lexer.cooked_text_of(TOKEN(STRING_LITERAL, "'\\x41'")), "A");
+  LEXER_ERROR("'\\u{110000}'");
+}
+
 TEST_F(lexer_test, regex) {
   INPUT_IS_TOKEN_TEXT("/abc/", REGEX_LITERAL);
+  INPUT_IS_TOKEN_TEXT("/a\\/b[/\\]]c/gi", REGEX_LITERAL);
   TOKEN_SEQUENCE("1/23/4", TOKEN(INT_LITERAL, "1"), TOKEN(SLASH, ""),
                  TOKEN(INT_LITERAL, "23"), TOKEN(SLASH, ""),
                  TOKEN(INT_LITERAL, "4"));
+  TOKEN_SEQUENCE("x = /=a/g", TOKEN(IDENTIFIER, "x"), TOKEN(EQ, ""),
+                 TOKEN(REGEX_LITERAL, "/=a/g"));
+  TOKEN_SEQUENCE("f(/a/, b[0] / c)", TOKEN(IDENTIFIER, "f"),
+                 TOKEN(PAREN_OPEN, ""), TOKEN(REGEX_LITERAL, "/a/"),
+                 TOKEN(COMMA, ""), TOKEN(IDENTIFIER, "b"),
+                 TOKEN(BRACKET_OPEN, ""), TOKEN(INT_LITERAL, "0"),
+                 TOKEN(BRACKET_CLOSE, ""), TOKEN(SLASH, ""),
+                 TOKEN(IDENTIFIER, "c"), TOKEN(PAREN_CLOSE, ""));
+  TOKEN_SEQUENCE("return /a/", TOKEN(KEYWORD, "return"),
+                 TOKEN(REGEX_LITERAL, "/a/"));
+  TOKEN_SEQUENCE("this /a/ i++ /b", TOKEN(KEYWORD, "this"), TOKEN(SLASH, ""),
+                 TOKEN(IDENTIFIER, "a"), TOKEN(SLASH, ""),
+                 TOKEN(IDENTIFIER, "i"), TOKEN(INCR, ""), TOKEN(SLASH, ""),
+                 TOKEN(IDENTIFIER, "b"));
+  // Comments don't count, blocks end in a closing brace
+  TOKEN_SEQUENCE("'s' /**/ /a/; {} /b/", TOKEN(STRING_LITERAL, "'s'"),
+                 TOKEN(BLOCK_COMMENT, "/**/"), TOKEN(SLASH, ""),
+                 TOKEN(IDENTIFIER, "a"), TOKEN(SLASH, ""),
+                 TOKEN(SEMICOLON, ""), TOKEN(BRACE_OPEN, ""),
+                 TOKEN(BRACE_CLOSE, ""), TOKEN(REGEX_LITERAL, "/b/"));
+  // Statements follow the heads of if, while, for and with
+  TOKEN_SEQUENCE("if (c) /re/.test(s)", TOKEN(KEYWORD, "if"),
+                 TOKEN(PAREN_OPEN, ""), TOKEN(IDENTIFIER, "c"),
+                 TOKEN(PAREN_CLOSE, ""), TOKEN(REGEX_LITERAL, "/re/"),
+                 TOKEN(DOT, ""), TOKEN(IDENTIFIER, "test"),
+                 TOKEN(PAREN_OPEN, ""), TOKEN(IDENTIFIER, "s"),
+                 TOKEN(PAREN_CLOSE, ""));
+  TOKEN_SEQUENCE("while (x) /a/g.exec(y)", TOKEN(KEYWORD, "while"),
+                 TOKEN(PAREN_OPEN, ""), TOKEN(IDENTIFIER, "x"),
+                 TOKEN(PAREN_CLOSE, ""), TOKEN(REGEX_LITERAL, "/a/g"),
+                 TOKEN(DOT, ""), TOKEN(IDENTIFIER, "exec"),
+                 TOKEN(PAREN_OPEN, ""), TOKEN(IDENTIFIER, "y"),
+                 TOKEN(PAREN_CLOSE, ""));
+  TOKEN_SEQUENCE("if (f(a)) /b/", TOKEN(KEYWORD, "if"), TOKEN(PAREN_OPEN, ""),
+                 TOKEN(IDENTIFIER, "f"), TOKEN(PAREN_OPEN, ""),
+                 TOKEN(IDENTIFIER, "a"), TOKEN(PAREN_CLOSE, ""),
+                 TOKEN(PAREN_CLOSE, ""), TOKEN(REGEX_LITERAL, "/b/"));
+  // Object literals and function expressions end operands
+  TOKEN_SEQUENCE("x = {} / 2", TOKEN(IDENTIFIER, "x"), TOKEN(EQ, ""),
+                 TOKEN(BRACE_OPEN, ""), TOKEN(BRACE_CLOSE, ""),
+                 TOKEN(SLASH, ""), TOKEN(INT_LITERAL, "2"));
+  TOKEN_SEQUENCE("x = function f() {} / 2", TOKEN(IDENTIFIER, "x"),
+                 TOKEN(EQ, ""), TOKEN(KEYWORD, "function"),
+                 TOKEN(IDENTIFIER, "f"), TOKEN(PAREN_OPEN, ""),
+                 TOKEN(PAREN_CLOSE, ""), TOKEN(BRACE_OPEN, ""),
+                 TOKEN(BRACE_CLOSE, ""), TOKEN(SLASH, ""),
+                 TOKEN(INT_LITERAL, "2"));
+  TOKEN_SEQUENCE("() => function () {} / 2", TOKEN(PAREN_OPEN, ""),
+                 TOKEN(PAREN_CLOSE, ""), TOKEN(ARROW, ""),
+                 TOKEN(KEYWORD, "function"), TOKEN(PAREN_OPEN, ""),
+                 TOKEN(PAREN_CLOSE, ""), TOKEN(BRACE_OPEN, ""),
+                 TOKEN(BRACE_CLOSE, ""), TOKEN(SLASH, ""),
+                 TOKEN(INT_LITERAL, "2"));
+  TOKEN_SEQUENCE("function f() {} /a/", TOKEN(KEYWORD, "function"),
+                 TOKEN(IDENTIFIER, "f"), TOKEN(PAREN_OPEN, ""),
+                 TOKEN(PAREN_CLOSE, ""), TOKEN(BRACE_OPEN, ""),
+                 TOKEN(BRACE_CLOSE, ""), TOKEN(REGEX_LITERAL, "/a/"));
+  LEXER_ERROR("/abc");
+  LEXER_ERROR("/a\nb/");
+  LEXER_ERROR("/[/");
 }
 
 TEST_F(lexer_test, big1) {
@@ -191,9 +370,441 @@ TEST_F(lexer_test, big1) {
       TOKEN(LINE_COMMENT, "// END"));
 }
 
+TEST_F(lexer_test, unknown_units) {
+  LEXER_ERROR("#");
+  LEXER_ERROR("@a");
+  LEXER_ERROR("\\u0061");
+  LEXER_ERROR("\x01");
+  LEXER_ERROR("\x7f");
+  LEXER_ERROR_AFTER("a \xc3\xa4", 1);
+  INPUT_IS_TOKEN_TEXT("'\xc3\xa4'", STRING_LITERAL);
+}
+
 TEST_F(lexer_test, keyword_types) {
 #define KEYWORD(NAME)                                                          \
   ASSERT_EQ(keyword_type::kw_##NAME,                                           \
             lexer_base::get_keyword_type(TOKEN(KEYWORD, #NAME)));
 #include "jnsn/js/keywords.def"
 }
+
+TEST_F(lexer_test, keyword_lookup) {
+#define KEYWORD(NAME)                                                          \
+  lexer.set_text(#NAME);                                                       \
+  {                                                                            \
+    auto res = lexer.next();                                                   \
+    ASSERT_TRUE(std::holds_alternative<token>(res));                           \
+    ASSERT_EQ(std::get<token>(res).type, token_type::KEYWORD);                 \
+    ASSERT_EQ(std::get<token>(res).kw, keyword_type::kw_##NAME);               \
+  }
+#include "jnsn/js/keywords.def"
+  for (auto *word : {"i", "iff", "fi", "functions", "Function", "vars", "nul",
+                     "instanceOf", "a_very_long_identifier_name"}) {
+    ASSERT_EQ(lexer_base::lookup_keyword(word), keyword_type::none) << word;
+  }
+  TOKEN_SEQUENCE("iff", TOKEN(IDENTIFIER, "iff"));
+}
+
+TEST_F(lexer_test, line_continuations) {
+  TOKEN_SEQUENCE("'ab\\\ncd'", TOKEN(STRING_LITERAL, "'abcd'"));
+  TOKEN_SEQUENCE("`a\\\n\\\\b`", TOKEN(TEMPLATE_STRING, "`a\\\\b`"));
+  lexer.set_text("x = 'a\\\nb'");
+  const std::pair<size_t, size_t> extents[] = {{0, 1}, {2, 1}, {4, 6}};
+  for (auto &extent : extents) {
+    auto res = lexer.next();
+    ASSERT_TRUE(std::holds_alternative<token>(res)) << res;
+    ASSERT_EQ(std::get<token>(res).offset, extent.first);
+    ASSERT_EQ(std::get<token>(res).length, extent.second);
+  }
+}
+
+TEST_F(lexer_test, tokenize_all) {
+  lexer.set_text("a /* c */ += 1; 'x");
+  token_buffer toks;
+  lexer.tokenize_all(toks);
+  ASSERT_EQ(toks.size(), 4u);
+  const token_type types[] = {token_type::IDENTIFIER, token_type::PLUS_EQ,
+                              token_type::INT_LITERAL, token_type::SEMICOLON};
+  const uint32_t offsets[] = {0, 10, 13, 14};
+  for (size_t i = 0; i < toks.size(); ++i) {
+    ASSERT_EQ(toks.kinds[i].type, types[i]);
+    ASSERT_EQ(toks.offsets[i], offsets[i]);
+    ASSERT_EQ(toks[i].offset, offsets[i]);
+  }
+  ASSERT_EQ(lexer.text_of(toks[0]), "a");
+  ASSERT_EQ(lexer.text_of(toks[2]), "1");
+  ASSERT_TRUE(toks.error);
+  lexer.set_text("x");
+  lexer.tokenize_all(toks);
+  ASSERT_EQ(toks.size(), 1u);
+  ASSERT_FALSE(toks.error);
+}
+
+/// Number and string literals are compared by value, because every lexed
+/// literal gets its own id
+static void expect_same_tokens(lexer_base &lexer_a, const token_buffer &a,
+                               lexer_base &lexer_b, const token_buffer &b) {
+  ASSERT_EQ(a.size(), b.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    ASSERT_EQ(a.kinds[i].type, b.kinds[i].type) << "at token " << i;
+    ASSERT_EQ(a.kinds[i].kw, b.kinds[i].kw);
+    ASSERT_EQ(a.kinds[i].has_text, b.kinds[i].has_text);
+    ASSERT_EQ(a.kinds[i].after, b.kinds[i].after) << "at token " << i;
+    ASSERT_EQ(a.offsets[i], b.offsets[i]) << "at token " << i;
+    ASSERT_EQ(a.lengths[i], b.lengths[i]);
+    if (a[i].is_number_literal()) {
+      ASSERT_EQ(lexer_a.value_of(a[i]), lexer_b.value_of(b[i]));
+    } else if (a[i].has_string_value()) {
+      ASSERT_EQ(lexer_a.text_of(a[i]).str(), lexer_b.text_of(b[i]).str());
+      ASSERT_EQ(lexer_a.cooked_text_of(a[i]).str(),
+                lexer_b.cooked_text_of(b[i]).str());
+    } else if (&lexer_a == &lexer_b) {
+      ASSERT_EQ(a.syms[i], b.syms[i]);
+    } else {
+      // Other lexers may number the same texts differently
+      ASSERT_EQ(lexer_a.text_of(a[i]).str(), lexer_b.text_of(b[i]).str());
+    }
+    ASSERT_EQ(a.template_depths[i], b.template_depths[i]);
+  }
+  ASSERT_EQ(a.error.has_value(), b.error.has_value());
+  if (a.error) {
+    ASSERT_EQ(a.error->message(), b.error->message());
+    auto loc_a = lexer_a.decode(a.error->loc);
+    auto loc_b = lexer_b.decode(b.error->loc);
+    ASSERT_EQ(loc_a.row, loc_b.row);
+    ASSERT_EQ(loc_a.col, loc_b.col);
+  }
+}
+
+TEST_F(lexer_test, new_buffers_drop_old_tokens) {
+  // Reused lexers, e.g. one per worker thread, must not grow with every
+  // buffer they lexed
+  std::string text;
+  size_t first_size = 0;
+  for (int i = 0; i < 1000; ++i) {
+    text = "name_" + std::to_string(i) + " = 'str_" + std::to_string(i) +
+           "\\n' + " + std::to_string(i) + ";";
+    lexer.set_text(text.c_str());
+    auto res = lexer.next();
+    ASSERT_TRUE(std::holds_alternative<token>(res));
+    ASSERT_EQ(std::get<token>(res).sym, 0u);
+    while (std::holds_alternative<token>(res)) {
+      res = lexer.next();
+    }
+    if (i == 0) {
+      first_size = lexer.bytes_reserved();
+    }
+  }
+  ASSERT_EQ(lexer.bytes_reserved(), first_size);
+}
+
+TEST_F(lexer_test, relex) {
+  std::string text = R"( /**/ r = /re/g; let s = `a${ b + `c${d}` }e`; // x
+    function f(x) { return 'str' + x / 2; } /* y */ f(0x1f);
+    if (f(x)) /a/.test(s); o = { p: function () {} / 2 } / /b/;)";
+  const char *inserts[] = {"",   " ",  "\n", "a",   "12", "`",   "${",
+                           "}",  "/",  "/*", "*/",  "'",  "x + y", "(",
+                           ")",  "{",  "if", "= {", "function"};
+  std::mt19937 gen(42);
+  token_buffer toks, expected;
+  lexer.set_text(text.c_str());
+  lexer.tokenize_all(toks);
+  for (int i = 0; i < 2000; ++i) {
+    text_edit edit;
+    edit.offset = gen() % (text.size() + 1);
+    edit.removed = std::min<size_t>(gen() % 4, text.size() - edit.offset);
+    std::string inserted = inserts[gen() % std::size(inserts)];
+    edit.inserted = inserted.size();
+    text.replace(edit.offset, edit.removed, inserted);
+    // Keep the text from collapsing or growing without bounds
+    if (text.size() < 20 || text.size() > 400) {
+      text = "let x = `${y}`;";
+      lexer.set_text(text.c_str());
+      lexer.tokenize_all(toks);
+      continue;
+    }
+    lexer.edit_text(text.c_str());
+    lexer.relex(toks, edit);
+    lexer.reset();
+    lexer.tokenize_all(expected);
+    expect_same_tokens(lexer, toks, lexer, expected);
+    if (HasFatalFailure()) {
+      FAIL() << "after edit " << i << ", text:\n" << text;
+    }
+  }
+}
+
+TEST(parallel_lexer_test, same_as_sequential) {
+  // Most fragments contain semicolons that are not SEMICOLON tokens, so
+  // chunks often start inside of literals and comments
+  const char *fragments[] = {"a = b;",
+                             "f(x, 'a;b');",
+                             "s = \"x\\\";y\";",
+                             "// c; 'd\n",
+                             "/* e;\n ` ; */",
+                             "t = `u;${v; w}x`;",
+                             "n = `${`${o;}`;}`;",
+                             "if (p) { q(); }",
+                             "r = 1.5e3; k = 0x1f;",
+                             "l = 'm\\\n;n';",
+                             "\n",
+                             "   ",
+                             "function g() { return h / 2; }",
+                             "if (p) /q;/.test(r);",
+                             "s = function () { t; } / 2;",
+                             "f(function () { u; v; }) / /w;/;",
+                             "x = { y: 1, z: [2] } / 3;",
+                             "z = ';' + \";\";"};
+  std::mt19937 gen(7);
+  constant_string_lexer sequential, parallel;
+  token_buffer expected, toks;
+  for (int i = 0; i < 300; ++i) {
+    std::string text = i % 3 ? "" : "/re;/g;";
+    for (size_t n = gen() % 400; n > 0; --n) {
+      text += fragments[gen() % std::size(fragments)];
+    }
+    if (i % 5 == 0) {
+      text.insert(gen() % (text.size() + 1), i % 2 ? "'" : "/*");
+    }
+    sequential.set_text(text.c_str());
+    sequential.tokenize_all(expected);
+    parallel.set_text(text.c_str());
+    parallel.tokenize_parallel(toks, 1 + gen() % 8, 1 + gen() % 64);
+    expect_same_tokens(parallel, toks, sequential, expected);
+    // Names from different chunks still share ids
+    std::map<std::string, string_table::id_type> ids;
+    for (size_t j = 0; j < toks.size(); ++j) {
+      if (toks.kinds[j].type == token_type::IDENTIFIER) {
+        auto text = parallel.text_of(toks[j]).str();
+        ASSERT_EQ(ids.emplace(text, toks.syms[j]).first->second, toks.syms[j])
+            << text;
+      }
+    }
+    if (HasFatalFailure()) {
+      FAIL() << "in round " << i << ", text:\n" << text;
+    }
+  }
+}
+
+TEST_F(lexer_test, locations) {
+  lexer.set_text("a\n  bc /* x\n */ 'd'");
+  const std::pair<size_t, size_t> expected[] = {{1, 1}, {2, 3}, {2, 6}, {3, 5}};
+  std::vector<token> toks;
+  for (auto &rowcol : expected) {
+    auto res = lexer.next();
+    ASSERT_TRUE(std::holds_alternative<token>(res)) << res;
+    toks.emplace_back(std::get<token>(res));
+    auto loc = lexer.decode(lexer.location_of(toks.back()));
+    ASSERT_EQ(loc.row, rowcol.first);
+    ASSERT_EQ(loc.col, rowcol.second);
+  }
+  // Going back works, too
+  for (size_t i = toks.size(); i-- > 0;) {
+    auto loc = lexer.decode(lexer.location_of(toks[i]));
+    ASSERT_EQ(loc.row, expected[i].first);
+    ASSERT_EQ(loc.col, expected[i].second);
+  }
+  // '\r' takes no column
+  lexer.set_text("a\r\n  b\r\rc");
+  const std::pair<size_t, size_t> expected_cr[] = {{1, 1}, {2, 3}, {2, 4}};
+  for (auto &rowcol : expected_cr) {
+    auto res = lexer.next();
+    ASSERT_TRUE(std::holds_alternative<token>(res)) << res;
+    auto loc = lexer.decode(lexer.location_of(std::get<token>(res)));
+    ASSERT_EQ(loc.row, rowcol.first);
+    ASSERT_EQ(loc.col, rowcol.second);
+  }
+  lexer.set_text("a\n  'b");
+  lexer.next();
+  auto res = lexer.next();
+  ASSERT_TRUE(std::holds_alternative<lexer_error>(res));
+  ASSERT_EQ(lexer.decode(std::get<lexer_error>(res).loc).row, 2u);
+  // Earlier buffers are forgotten, their text may be gone
+  ASSERT_EQ(lexer.get_sources().size(), 1u);
+}
+
+TEST(source_manager_test, buffers) {
+  source_manager sources;
+  ASSERT_FALSE(sources.location(sources.add_buffer("", "empty"), 0) ==
+               source_location());
+  std::string_view first = "ab\ncd\n";
+  auto a = sources.add_buffer(first, "a.js");
+  auto b = sources.add_stream("b.js");
+  sources.extend_stream(b, "x\r");
+  sources.extend_stream(b, "x\r\ny");
+  ASSERT_EQ(sources.name(a), "a.js");
+  ASSERT_EQ(sources.size(), 3u);
+
+  auto check = [&](source_manager::file_id file, size_t offset, size_t row,
+                   size_t col) {
+    auto loc = sources.decode(sources.location(file, offset));
+    ASSERT_EQ(loc.file, file);
+    ASSERT_EQ(loc.offset, offset);
+    ASSERT_EQ(loc.row, row) << "offset " << offset;
+    ASSERT_EQ(loc.col, col) << "offset " << offset;
+  };
+  check(a, 0, 1, 1);
+  check(a, 2, 1, 3);
+  check(a, 3, 2, 1);
+  check(a, 6, 3, 1);
+  check(b, 0, 1, 1);
+  check(b, 2, 1, 2);
+  check(b, 3, 2, 1);
+  check(b, 4, 2, 2);
+  ASSERT_EQ(sources.decode(source_location()).row, 0u);
+  // Dropped units only count their lines
+  sources.drop_stream_prefix(b, 2);
+  sources.extend_stream(b, "\ny\r\nzz");
+  check(b, 1, 0, 0);
+  check(b, 2, 1, 2);
+  check(b, 4, 2, 2);
+  check(b, 6, 3, 1);
+  check(b, 8, 3, 3);
+  sources.drop_stream_prefix(b, 7);
+  sources.extend_stream(b, "z");
+  check(b, 6, 0, 0);
+  check(b, 7, 3, 2);
+}
+
+/// Hands out its text in pieces of changing size, like a pipe would
+class piecewise_lexer : public lexer_base {
+  std::string_view text;
+  size_t pos = 0;
+  size_t round = 0;
+
+protected:
+  ssize_t read_more(unit *dest, size_t n) override {
+    const size_t sizes[] = {1, 7, 300, 13, 100000, 2};
+    n = std::min({n, text.size() - pos, sizes[round++ % std::size(sizes)]});
+    std::copy_n(text.data() + pos, n, dest);
+    pos += n;
+    return n;
+  }
+
+public:
+  piecewise_lexer(std::string_view text) : text(text) { start_stream(); }
+};
+
+TEST(stream_lexer_test, tokens_across_chunks) {
+  std::string prog = "let s = '" + std::string(200000, 'a') + "';\n";
+  prog += "/*" + std::string(70000, '*') + "\n*/ x\n";
+  for (int i = 0; i < 3000; ++i) {
+    prog += "f(`a${ b + `c${i}` }d`, 0x1f, 1.5e3) >>>= a.b...c;\n";
+  }
+  prog += "'unterminated";
+  constant_string_lexer whole;
+  whole.set_text(prog.c_str());
+  piecewise_lexer pieces(prog);
+  for (;;) {
+    auto expected = whole.next();
+    auto res = pieces.next();
+    ASSERT_EQ(expected.index(), res.index()) << res;
+    if (auto *err = std::get_if<lexer_error>(&res)) {
+      auto &expected_err = std::get<lexer_error>(expected);
+      ASSERT_EQ(err->message(), expected_err.message());
+      auto loc = pieces.decode(err->loc);
+      auto expected_loc = whole.decode(expected_err.loc);
+      ASSERT_EQ(loc.row, expected_loc.row);
+      ASSERT_EQ(loc.col, expected_loc.col);
+      break;
+    }
+    ASSERT_TRUE(std::holds_alternative<token>(res)) << res;
+    auto tok = std::get<token>(res);
+    auto expected_tok = std::get<token>(expected);
+    ASSERT_EQ(tok.type, expected_tok.type);
+    ASSERT_EQ(tok.offset, expected_tok.offset);
+    ASSERT_EQ(tok.length, expected_tok.length);
+    ASSERT_EQ(std::string_view{pieces.text_of(tok)},
+              std::string_view{whole.text_of(expected_tok)});
+    // Values of stream tokens are valid until the next token is lexed
+    if (tok.is_number_literal()) {
+      ASSERT_EQ(pieces.value_of(tok), whole.value_of(expected_tok));
+    } else if (tok.type == token_type::STRING_LITERAL) {
+      ASSERT_EQ(std::string_view{pieces.cooked_text_of(tok)},
+                std::string_view{whole.cooked_text_of(expected_tok)});
+    }
+    auto loc = pieces.decode(pieces.location_of(tok));
+    auto expected_loc = whole.decode(whole.location_of(expected_tok));
+    ASSERT_EQ(loc.row, expected_loc.row);
+    ASSERT_EQ(loc.col, expected_loc.col);
+  }
+}
+
+TEST(stream_lexer_test, pipe) {
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+  const std::string prog = "a\n+\n'b'";
+  ASSERT_EQ(write(fds[1], prog.data(), prog.size()), (ssize_t)prog.size());
+  close(fds[1]);
+  fd_lexer lexer(fds[0]);
+  std::vector<token> toks;
+  std::vector<std::string> texts;
+  for (auto res = lexer.next(); std::holds_alternative<token>(res);
+       res = lexer.next()) {
+    toks.emplace_back(std::get<token>(res));
+    texts.emplace_back(lexer.text_of(toks.back())->data(),
+                       lexer.text_of(toks.back())->size());
+  }
+  close(fds[0]);
+  ASSERT_EQ(toks.size(), 3u);
+  ASSERT_EQ(toks[1].type, token_type::PLUS);
+  ASSERT_EQ(texts[2], "'b'");
+  ASSERT_EQ(toks[2].offset, 4u);
+}
+
+TEST(stream_lexer_test, bounded_memory) {
+  // Every name, number and string is new, so nothing could be shared
+  // between chunks
+  std::string prog;
+  size_t lines = 0;
+  for (; prog.size() < (8u << 20); ++lines) {
+    auto n = std::to_string(lines);
+    prog += "var id_" + n + " = 'str_" + n + "\\t' + " + n + ".5 + `t_" + n +
+            "${x_" + n + "}u`;\n";
+  }
+  piecewise_lexer lexer(prog);
+  size_t names = 0, peak = 0;
+  for (auto res = lexer.next(); std::holds_alternative<token>(res);
+       res = lexer.next()) {
+    auto tok = std::get<token>(res);
+    if (tok.type == token_type::IDENTIFIER &&
+        lexer.text_of(tok)->substr(0, 3) == "id_") {
+      ++names;
+    }
+    peak = std::max(peak, lexer.bytes_reserved());
+  }
+  ASSERT_EQ(names, lines);
+  // The input is 8 MiB
+  ASSERT_LT(peak, 1u << 20);
+}
+
+TEST(mapped_file_lexer_test, zero_copy) {
+  char path[] = "/tmp/jnsn_lexer_test_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(fd, -1);
+  const std::string prog = "abc + abc; 'str' // end";
+  ASSERT_EQ(write(fd, prog.data(), prog.size()), (ssize_t)prog.size());
+  close(fd);
+
+  mapped_file_lexer lexer;
+  ASSERT_FALSE(lexer.open(path));
+  std::vector<token> toks;
+  for (auto res = lexer.next(); std::holds_alternative<token>(res);
+       res = lexer.next()) {
+    toks.emplace_back(std::get<token>(res));
+  }
+  unlink(path);
+  ASSERT_EQ(toks.size(), 6u);
+  ASSERT_EQ(lexer.text_of(toks[0]), "abc");
+  ASSERT_EQ(lexer.text_of(toks[2]), "abc");
+  ASSERT_EQ(lexer.text_of(toks[4]), "'str'");
+  ASSERT_EQ(lexer.text_of(toks[5]), "// end");
+  // Names are interned, other token texts are views into the mapped file
+  ASSERT_EQ(toks[2].sym, toks[0].sym);
+  ASSERT_EQ(lexer.text_of(toks[5]).data() - lexer.text_of(toks[4]).data(), 6);
+}
+
+TEST(mapped_file_lexer_test, missing_file) {
+  mapped_file_lexer lexer;
+  ASSERT_TRUE(lexer.open("/nonexistent/jnsn/file.js"));
+  ASSERT_TRUE(std::holds_alternative<lexer_base::eof_t>(lexer.next()));
+}
@@ -2,6 +2,7 @@
 #include "parse_utils.h"
 #include "gtest/gtest.h"
 #include <iostream>
+#include <pthread.h>
 #include <sstream>
 
 using namespace jnsn;
@@ -273,6 +274,14 @@ TEST_F(parser_test, binary_ops) {
       "a in A", MOD_WRAP("{\"type\": \"in_expr\", \"lhs\": {\"type\": "
                          "\"identifier_expr\", \"str\": \"a\"}, \"rhs\": "
                          "{\"type\": \"identifier_expr\", \"str\": \"A\"}}"));
+  ASSERT_PARSED_MATCHES_JSON(
+      "a - b * c - d",
+      MOD_WRAP("{\"type\": \"subtract\", \"lhs\": {\"type\": \"subtract\", "
+               "\"lhs\": {\"type\": \"identifier_expr\", \"str\": \"a\"}, "
+               "\"rhs\": {\"type\": \"multiply\", \"lhs\": {\"type\": "
+               "\"identifier_expr\", \"str\": \"b\"}, \"rhs\": {\"type\": "
+               "\"identifier_expr\", \"str\": \"c\"}}}, \"rhs\": {\"type\": "
+               "\"identifier_expr\", \"str\": \"d\"}}"));
   PARSER_SUCCESS("1=1");
   PARSER_SUCCESS("1==1");
   PARSER_SUCCESS("1===1");
@@ -607,3 +616,145 @@ TEST_F(parser_test, export_stmt) {
   XFAIL("export var i = 0");
   XFAIL("export default class test {}");
 }
+TEST_F(parser_test, error_messages) {
+  const struct {
+    const char *input;
+    const char *msg;
+    size_t row, col;
+  } cases[] = {
+      {"a b", "Unexpected token after statement: IDENTIFIER", 1, 3},
+      {"x = ;", "Unexpected token: SEMICOLON. Expected atomic expression", 1,
+       5},
+      {"(a\n  b)",
+       "Unexpected token. Expected: TYPELIST(token_type::PAREN_CLOSE, "
+       "token_type::COMMA). Was: IDENTIFIER",
+       2, 3},
+      {"(a, ...b) + 1", "Unexpected token", 1, 5},
+      {"a;\n'abc",
+       "Lexer Error: Reached end of file while lexing string literal", 2, 1}};
+  for (auto mode : {parser_base::lexing_mode::streaming,
+                    parser_base::lexing_mode::buffered}) {
+    parser.set_lexing_mode(mode);
+    for (auto &c : cases) {
+      parser.lexer.set_text(c.input);
+      auto res = parser.parse();
+      ASSERT_TRUE(holds_alternative<parser_error>(res)) << c.input;
+      auto &err = get<parser_error>(res);
+      ASSERT_EQ(err.msg, c.msg);
+      auto loc = parser.decode(err.loc);
+      ASSERT_EQ(loc.row, c.row) << c.input;
+      ASSERT_EQ(loc.col, c.col) << c.input;
+    }
+  }
+}
+TEST_F(parser_test, buffered_lexing) {
+  for (auto *input :
+       {"a: while (x) break", "if (a) b; else c", "for (let x of y) f(x)",
+        "for (var x in y) {}", "(a, ...b) => a + b", "a.b[c](d)++; --e",
+        "x = y ? 1 : 2 // comment", "let {a} = obj", "a; 'unterminated",
+        "switch (a) { case 1: b; default: c }"}) {
+    parser.set_lexing_mode(parser_base::lexing_mode::streaming);
+    parser.lexer.set_text(input);
+    auto streamed = parser.parse();
+    stringstream expected;
+    if (auto *err = get_if<parser_error>(&streamed)) {
+      expected << *err;
+    } else {
+      expected << get<ast_root *>(streamed);
+    }
+    parser.set_lexing_mode(parser_base::lexing_mode::buffered);
+    parser.lexer.set_text(input);
+    auto buffered = parser.parse();
+    str.str("");
+    if (auto *err = get_if<parser_error>(&buffered)) {
+      str << *err;
+    } else {
+      str << get<ast_root *>(buffered);
+    }
+    ASSERT_EQ(str.str(), expected.str()) << input;
+  }
+}
+
+/// Runs \p fn on a thread with a small stack, which overflows if parsing
+/// recurses once per operator
+template <class fn_t> static void run_on_small_stack(fn_t fn) {
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, 512 * 1024);
+  pthread_t thread;
+  auto run = [](void *fn) -> void * {
+    (*static_cast<fn_t *>(fn))();
+    return nullptr;
+  };
+  ASSERT_EQ(pthread_create(&thread, &attr, run, &fn), 0);
+  pthread_join(thread, nullptr);
+  pthread_attr_destroy(&attr);
+}
+
+static string operator_chain(const char *op, size_t terms) {
+  string chain = "a";
+  for (size_t i = 1; i < terms; ++i) {
+    chain += op;
+    chain += 'a';
+  }
+  return chain;
+}
+
+/// Follows the operators \p input parses into from the outermost one through
+/// their rhs or lhs. Nodes have no type tag, but only operator nodes are
+/// located where \p input has \p op.
+static size_t chain_length(parser_base &parser, const ast_node *expr,
+                           const string &input, char op, bool through_rhs) {
+  size_t length = 0;
+  while (input[parser.decode(expr->loc).offset] == op) {
+    auto *binop = static_cast<const bin_op_expr_node *>(expr);
+    expr = through_rhs ? binop->rhs : binop->lhs;
+    ++length;
+  }
+  return length;
+}
+
+TEST_F(parser_test, operator_chains) {
+  constexpr size_t terms = 100000;
+  struct {
+    const char *op;
+    bool right_assoc;
+  } chains[] = {
+      {" + ", false}, {" = ", true}, {" ** ", true}, {" ? a : ", true}};
+  for (auto chain : chains) {
+    auto input = operator_chain(chain.op, terms);
+    run_on_small_stack([&] {
+      parser.lexer.set_text(input.c_str());
+      // The AST analysis still recurses, so only parse
+      auto res = parser.parse(false);
+      ASSERT_TRUE(holds_alternative<ast_root *>(res)) << chain.op;
+      auto *stmt = get<ast_root *>(res)->stmts.front();
+      ASSERT_EQ(
+          chain_length(parser, stmt, input, chain.op[1], chain.right_assoc),
+          terms - 1)
+          << chain.op;
+    });
+  }
+}
+
+TEST_F(parser_test, operator_chains_parse_in_linear_time) {
+  auto parse_work = [&](const string &input) {
+    parser.lexer.set_text(input.c_str());
+    auto res = parser.parse(false);
+    EXPECT_TRUE(holds_alternative<ast_root *>(res));
+    return parser.get_work();
+  };
+  for (auto *op : {" + ", " * a - ", " ? a : "}) {
+    // Each 10000 more terms have to add the same amount of work
+    auto a = parse_work(operator_chain(op, 10000));
+    auto b = parse_work(operator_chain(op, 20000));
+    auto c = parse_work(operator_chain(op, 30000));
+    EXPECT_EQ(c.advances - b.advances, b.advances - a.advances) << op;
+    EXPECT_EQ(c.reductions - b.reductions, b.reductions - a.reductions) << op;
+    EXPECT_EQ(c.max_pending_ops - b.max_pending_ops,
+              b.max_pending_ops - a.max_pending_ops)
+        << op;
+    EXPECT_EQ(c.max_operands - b.max_operands, b.max_operands - a.max_operands)
+        << op;
+  }
+}
@@ -0,0 +1,74 @@
+#include "jnsn/js/scan.h"
+#include "gtest/gtest.h"
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace jnsn;
+using namespace std;
+
+static vector<scan::isa> supported_isas() {
+  vector<scan::isa> isas = {scan::isa::scalar};
+  if (scan::best_isa() != scan::isa::scalar) {
+    isas.emplace_back(scan::isa::sse2);
+  }
+  if (scan::best_isa() == scan::isa::avx2) {
+    isas.emplace_back(scan::isa::avx2);
+  }
+  return isas;
+}
+
+class scan_test : public ::testing::Test {
+protected:
+  string input;
+  void SetUp() override {
+    // Mostly identifier and whitespace units, so that runs get long enough
+    // to cross vector boundaries
+    const string alphabet = "aZ09_$\\  \t\n\r\v\f'\"*`.{";
+    mt19937 rng(42);
+    uniform_int_distribution<size_t> pick(0, alphabet.size() - 1);
+    uniform_int_distribution<size_t> run(0, 40);
+    while (input.size() < 4096) {
+      input.append(run(rng), alphabet[pick(rng) % 7]);
+      input += alphabet[pick(rng)];
+    }
+  }
+  void TearDown() override { scan::use_isa(scan::best_isa()); }
+};
+
+TEST_F(scan_test, kernels_agree) {
+  const char *begin = input.data(), *end = begin + input.size();
+  vector<const char *> expected_find, expected_space, expected_ident;
+  scan::use_isa(scan::isa::scalar);
+  for (const char *it = begin; it != end; ++it) {
+    expected_find.emplace_back(scan::find_any(it, end, '\'', '\\', '\n', '*'));
+    expected_space.emplace_back(scan::skip_space(it, end));
+    expected_ident.emplace_back(scan::skip_ident(it, end));
+  }
+  for (auto set : supported_isas()) {
+    scan::use_isa(set);
+    ASSERT_EQ(scan::active_isa(), set);
+    for (const char *it = begin; it != end; ++it) {
+      size_t i = it - begin;
+      ASSERT_EQ(scan::find_any(it, end, '\'', '\\', '\n', '*'),
+                expected_find[i])
+          << scan::isa_name(set) << " at " << i;
+      ASSERT_EQ(scan::skip_space(it, end), expected_space[i])
+          << scan::isa_name(set) << " at " << i;
+      ASSERT_EQ(scan::skip_ident(it, end), expected_ident[i])
+          << scan::isa_name(set) << " at " << i;
+    }
+  }
+}
+
+TEST_F(scan_test, scalar_semantics) {
+  scan::use_isa(scan::isa::scalar);
+  const string text = " \t\r\n\v\fabc_$\\09 x";
+  const char *begin = text.data(), *end = begin + text.size();
+  ASSERT_EQ(scan::skip_space(begin, end), begin + 6);
+  ASSERT_EQ(scan::skip_ident(begin + 6, end), begin + 14);
+  ASSERT_EQ(scan::find(begin, end, 'x'), begin + 15);
+  ASSERT_EQ(scan::find(begin, end, '#'), end);
+  ASSERT_EQ(scan::find_any(begin, end, '\n', '\r'), begin + 2);
+  ASSERT_EQ(scan::find_any(begin + 4, end, '$', 'x'), begin + 10);
+}